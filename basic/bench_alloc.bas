@@ -0,0 +1,13 @@
+10 REM --- STEADY-STATE ALLOCATION BENCHMARK ---
+20 REM A tight numeric loop: after the first pass every variable exists, so
+30 REM the step loop should make no heap allocations. From a host built
+40 REM with -DBASIC_COUNT_ALLOCATIONS, run it with BasicSession::run(steps)
+50 REM and compare allocationCount() between two yields. Time it as well.
+60 LET S = 0
+70 FOR I = 1 TO 1000000
+80 LET X = I * 0.5
+90 LET S = S + SQR(X) - X / (I + 1)
+100 IF S < -1E12 THEN GOTO 130
+110 NEXT I
+120 PRINT "SUM ="; S
+130 END
@@ -0,0 +1,13 @@
+10 REM --- DEF FN COST: inlined, called and CACHED user functions ---
+20 REM FNH is small enough to inline, FNK is called through its slots and
+30 REM FNW memoizes the 360 distinct angles of the sweep.
+40 DEF FNH(X, Y) = SQR(X * X + Y * Y)
+50 DEF FNK(M, E) = M + E * SIN(M) + E * E / 2 * SIN(2 * M) + E * E * E / 8 * (3 * SIN(3 * M) - SIN(M))
+60 DEF FNW(D) = SIN(DEG2RAD(D)) * COS(DEG2RAD(D)) CACHED
+70 LET S = 0
+80 FOR K = 1 TO 200000
+90 LET D = K - INT(K / 360) * 360
+100 LET S = S + FNH(K, 2) / K + FNK(D / 100, 0.0934) + FNW(D)
+110 NEXT K
+120 PRINT "S ="; S
+130 END
@@ -0,0 +1,10 @@
+10 REM --- DISPATCH COST: GOSUB / RETURN ---
+20 REM One call and return per iteration into a one-line subroutine.
+30 LET S = 0
+40 FOR I = 1 TO 1000000
+50 GOSUB 100
+60 NEXT I
+70 PRINT "S ="; S
+80 END
+100 LET S = S + 2
+110 RETURN
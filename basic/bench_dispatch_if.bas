@@ -0,0 +1,8 @@
+10 REM --- DISPATCH COST: IF a < b THEN n ---
+20 REM A counted loop built from LET x = x + c and IF a < b THEN n only.
+30 LET I = 0
+40 LET N = 2000000
+50 LET I = I + 1
+60 IF I < N THEN 50
+70 PRINT "I ="; I
+80 END
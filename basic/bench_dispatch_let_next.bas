@@ -0,0 +1,9 @@
+10 REM --- DISPATCH COST: LET x = x + c FOLLOWED BY NEXT ---
+20 REM The fused LET/NEXT superinstruction: one op per iteration. Compare
+30 REM the time per iteration with bench_dispatch_rem.bas.
+40 LET S = 0
+50 FOR I = 1 TO 2000000
+60 LET S = S + 1
+70 NEXT I
+80 PRINT "S ="; S
+90 END
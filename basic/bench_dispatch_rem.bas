@@ -0,0 +1,11 @@
+10 REM --- DISPATCH COST: GENERIC STATEMENTS ---
+20 REM Lines that decode to no special op (REM), so each one costs a plain
+30 REM dispatch through the statement handler table.
+40 FOR I = 1 TO 500000
+50 REM one
+60 REM two
+70 REM three
+80 REM four
+90 NEXT I
+100 PRINT "I ="; I
+110 END
@@ -0,0 +1,96 @@
+10 REM --- EXPRESSION COST: Kepler's equation and near-parabolic orbits ---
+20 REM The lines from 110 on are Astronomy_BASIC/kepler.bas (line numbers
+30 REM kept: simple, Encke, binary and Herrick methods, true anomaly) and
+40 REM orbits.bas (from 1018: its line numbers plus 1000, ':' written as
+50 REM '\'). A sweep of times stands in for their INPUT and PRINT lines.
+60 P1=PI \ D7=P1/180 \ R1=1/D7
+70 K=.01720209895
+80 S9=0 \ N9=0
+90 Q=.5 \ E0=.6
+95 FOR T=1 TO 1000 STEP .2
+100 A1=Q/(1-E0) \ IF A1<0 THEN M=0 \ GO TO 120
+110 N0=K*A1^(-1.5) \ M=N0*T
+120 GOSUB 490 \ GOSUB 400 \ S9=S9+V+R
+130 GOSUB 560 \ GOSUB 400 \ S9=S9+V+R
+140 GOSUB 260 \ GOSUB 400 \ S9=S9+V+R
+150 NEXT T
+160 Q=.9 \ E0=.98
+170 FOR T=1 TO 1000 STEP .2
+180 GOSUB 640 \ S9=S9+V+R
+190 GOSUB 1000 \ S9=S9+V+R
+200 NEXT T
+210 PRINT "SUM ="; S9
+220 PRINT "NO CONVERGENCE:"; N9
+230 END
+260 REM    BINARY METHOD
+280 F=SGN(M) \ M=ABS(M)/(2*P1) \ M=(M-INT(M))*2*P1*F
+290 IF M<0 THEN M=M+2*P1
+300 F=1 \ IF M>P1 THEN M=2*P1-M \ F=-1
+310 E=P1/2 \ D=P1/4
+320 FOR I1=1 TO 47
+330 M1=E-E0*SIN(E)
+340 E=E+SGN(M-M1)*D \ D=D/2
+350 E1=E
+360 NEXT I1
+370 E=E*F \ I=I1-1
+380 RETURN
+400 REM   TRUE ANOMALY FROM ECCENTRIC ANOMALY
+420 V=2*ATN(SQR((1+E0)/(1-E0))*SIN(E/2)/COS(E/2))
+430 R=A1*(1-E0*COS(E))
+470 RETURN
+490 REM   SIMPLE ITERATION
+510 E=M \ I=0
+520 E1=M+E0*SIN(E) \ I=I+1
+530 IF ABS(E-E1)>1.0000000000000E-10 THEN E=E1 \ GO TO 520
+540 RETURN
+560 REM   ENCKE ITERATION
+580 E=M \ I=0
+590 E1=E+(M+E0*SIN(E)-E)/(1-E0*COS(E)) \ I=I+1
+600 IF ABS(E-E1)>1.0000000000000E-10 THEN E=E1 \ GO TO 590
+610 RETURN
+640 REM    HERRICK'S METHOD
+682 I=0
+690 P=Q*(1+E0)
+700 C=K*(1+E0)*(1+E0)/(2*P^1.5)
+710 X=SGN(T) \ REM  ASSUME V +90 OR -90 TO START
+720 L=(1-E0)/(1+E0)
+730 D2=C*(1+L*X*X)/(1+X*X)
+740 C2=X/(1+L*X*X) \ K1=X*X*X/(1+E0)
+750 C2=C2+K1*(1/(1+L*X*X)-1/3)
+760 N=0 \ S=-1
+770 N=N+1
+775 I=I+1
+780 S=-S
+790 F=K1*S*(L*X*X)^N/(2*N+3)
+800 C2=C2+F \ IF ABS(F)>1.0000000000000E-12 THEN 770
+810 D3=T-C2/C \ IF ABS(D3)<1.0000000000000E-10 THEN 830
+820 X=X+D2*D3 \ GO TO 730
+830 V=2*ATN(X) \ R=Q*(1+E0)/(1+E0*COS(V))
+840 RETURN
+1000 REM   NEAR-PARABOLIC ORBITS
+1018 D1=10000 \ C=1/3
+1020 D=1E-6
+1044 Q1=K*SQR((1+E0)/Q)/(Q*2)
+1046 Q1=Q1*T
+1048 S=2/(3*ABS(Q1))
+1050 X=2/TAN(2*ATN(TAN(ATN(S)/2)^C))
+1052 IF T<0 THEN X=-X
+1054 G=(1-E0)/(1+E0) \ L0=0
+1058 X0=X \ W=1 \ Y=X*X \ G1=-Y*X
+1060 Q3=Q1+2*G*X*Y/3
+1062 W=W+1
+1064 G1=-G1*G*Y
+1066 W1=(W-(W+1)*G)/(2*W+1)
+1068 F=W1*G1
+1070 Q3=Q3+F
+1072 IF W>50 OR ABS(F)>D1 THEN 1096
+1074 IF ABS(F)>D THEN 1062
+1076 L0=L0+1 \ IF L0>50 THEN 1096
+1078 X1=X \ X=(2*X*X*X/3+Q3)/(X*X+1)
+1080 IF ABS(X-X1)>D THEN 1078
+1082 IF ABS(X-X0)>D THEN 1058
+1084 V=2*ATN(X)
+1086 R=Q*(1+E0)/(1+E0*COS(V))
+1088 IF V<0 THEN V=V+2*P1
+1090 RETURN
+1096 N9=N9+1 \ V=0 \ R=0 \ RETURN
@@ -0,0 +1,16 @@
+10 REM --- INPUT# THROUGHPUT BENCHMARK ---
+20 REM Reads bench.csv (three numeric columns per row) to the end of file.
+30 REM Make a ~1 GB input first, e.g.
+40 REM   awk 'BEGIN{for(i=0;i<40000000;i++)printf "%d,%.6f,%.3e\n",i,i/7,i*1e3}' > bench.csv
+50 REM then time the run: LOAD this file and RUN under `time`.
+60 OPEN "bench.csv" FOR INPUT AS #1
+70 LET S = 0
+80 LET N = 0
+90 IF EOF(1) THEN 140
+100 INPUT #1, A, B, C
+110 LET S = S + A + B + C
+120 LET N = N + 1
+130 GOTO 90
+140 PRINT "ROWS ="; N; " BYTES ="; LOC(1); " SUM ="; S
+150 CLOSE #1
+160 END
@@ -0,0 +1,15 @@
+10 REM --- ELEMENTWISE MAT FUNCTION BENCHMARK ---
+20 REM Each MAT statement below maps a builtin over 4M doubles: SIN, EXP
+30 REM and CLOG run four lanes per step, SQR is a plain loop, and large
+40 REM matrices are split across the worker pool.
+50 SEED 1
+60 MAT A = RANDOM(2000, 2000)
+70 FOR I = 1 TO 10
+80 MAT B = SIN(A)
+90 MAT C = EXP(A)
+100 MAT D = CLOG(C)
+110 MAT E = SQR(A)
+120 NEXT I
+130 MAT T = TRACE(D)
+140 PRINT "TRACE OF CLOG(EXP(A)) ="; T
+150 END
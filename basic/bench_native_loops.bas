@@ -0,0 +1,10 @@
+10 REM Scalar loop kernel for RUN NATIVE / TRANSPILE: nested FOR loops
+20 REM with integer counters and a floating-point accumulator
+30 LET S = 0
+40 FOR I = 1 TO 6000
+50 FOR J = 1 TO 6000
+60 LET S = S + (I - J) * (I + J) * 0.000001 + SQR(J)
+70 NEXT J
+80 NEXT I
+90 PRINT "S ="; S
+100 END
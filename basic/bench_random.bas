@@ -0,0 +1,13 @@
+10 REM --- RANDOM NUMBER BENCHMARK ---
+20 REM MAT RANDOM fills 16M doubles per statement with the SIMD lanes of
+30 REM the session's xoshiro256++ engine; lines 80-110 draw one RND per
+40 REM line for comparison. SEED 42, K selects independent stream K, so
+50 REM parallel copies of this program can each use their own K.
+60 SEED 42, 0
+70 MAT A = RANDOM(4000, 4000)
+80 LET S = 0
+90 FOR I = 1 TO 100000
+100 LET S = S + RND()
+110 NEXT I
+120 PRINT "MEAN RND ="; S / 100000
+130 END
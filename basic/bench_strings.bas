@@ -0,0 +1,13 @@
+10 REM --- STRING EVALUATION BENCHMARK ---
+20 REM ELIZA-style slicing and rebuilding of a sentence. LEFT$/MID$/RIGHT$
+30 REM results are views of their source and '+' chains are ropes, so the
+40 REM loop body copies text only when it assigns W$ and R$.
+50 LET S$ = "WHY DO YOU THINK I AM NOT ABLE TO HELP YOU WITH YOUR PROBLEM"
+60 LET N = 0
+70 FOR I = 1 TO 200000
+80 LET W$ = MID$(S$, 5, 2) + " " + LEFT$(S$, 3) + " " + RIGHT$(S$, 7)
+90 LET R$ = LEFT$(W$ + "?" + CHR$(32) + MID$(S$, 12, 5), 20)
+100 LET N = N + 1
+110 NEXT I
+120 PRINT N; " "; R$
+130 END
@@ -1,4 +1,8 @@
 10 REM Test ASIN, ACOS, and ^ operator
+12 REM Line 30 of Astronomy_BASIC/kepler.bas: PI and implicit LET
+14 P1=PI \ D7=P1/180 \ R1=1/D7
+16 PRINT "PI = ", P1, "DEGREES PER RADIAN = ", R1
+18 PRINT "-2^2 = ", -2^2, "2^-1 = ", 2^-1, "2^3^2 = ", 2^3^2
 20 LET A = ASIN(0.5)
 30 LET B = ACOS(0.5)
 40 LET C = 2 ^ 3
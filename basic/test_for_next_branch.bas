@@ -0,0 +1,18 @@
+10 REM A FOR body may branch to another NEXT of its variable
+12 REM Expected: a 1, b 2, a 3, done
+20 FOR I=1 TO 3
+30 IF I=2 THEN 60
+40 PRINT "a";I
+50 NEXT I
+55 GOTO 80
+60 PRINT "b";I
+70 NEXT I
+80 PRINT "done"
+100 REM Jumping past the last NEXT J drops the J loop's frame
+110 FOR K=1 TO 5000
+120 FOR J=1 TO 10
+130 IF J=2 THEN 150
+140 NEXT J
+150 NEXT K
+160 PRINT "left 5000 inner loops"
+170 END
@@ -0,0 +1,13 @@
+10 REM Built-in calls are checked for their argument count, in any case
+12 REM and whatever the length of the name
+14 REM Expected: 1024, 3.141592653589793, then "error 5" three times, done
+20 ON ERROR GOTO 200
+30 PRINT pow(2, 10)
+40 PRINT Deg2Rad(180)
+50 X = POW(2)
+60 X = SIN(1, 2)
+70 X = NOTABUILTINATALL(1)
+80 PRINT "done"
+90 END
+200 PRINT "error"; ERR
+210 RESUME NEXT
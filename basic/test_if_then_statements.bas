@@ -0,0 +1,25 @@
+10 REM Statements after THEN run as they would on a line of their own
+20 IF 1 THEN REM a remark after THEN
+30 IF 1 THEN GO TO 50
+40 PRINT "GO TO not taken"
+50 IF 1 THEN GOSUB 300
+60 IF 1 THEN DIM A(2,2)
+70 PRINT "DIM A(2,2):"
+80 MAT PRINT A
+90 K = 2
+100 IF 1 THEN ON K GOTO 110, 120
+110 PRINT "ON went to the wrong line"
+120 IF 1 THEN FOR I = 1 TO 3
+130 PRINT "FOR I ="; I
+140 NEXT I
+150 IF 1 THEN OPEN "if_then_test.txt" FOR OUTPUT AS #1
+160 PRINT #1, "written after THEN"
+170 IF 1 THEN CLOSE #1
+180 OPEN "if_then_test.txt" FOR INPUT AS #1
+190 INPUT #1, L$
+200 CLOSE #1
+210 PRINT "read back: "; L$
+220 END
+300 PRINT "in the subroutine"
+310 IF 1 THEN RETURN
+320 PRINT "RETURN not taken"
@@ -0,0 +1,14 @@
+10 REM PRINT spacing: a blank follows each number, and ',' moves to the
+12 REM next 14-column zone of the output line, even one an earlier PRINT
+14 REM started
+16 REM Expected (columns 1, 15, 29):
+18 REM -2.5 3
+20 REM 1             2             X
+22 REM ABC           D
+24 REM 1234567890123456            Z
+30 PRINT -2.5; 3
+40 PRINT 1, 2, "X"
+50 PRINT "AB";
+60 PRINT "C", "D"
+70 PRINT "1234567890123456", "Z"
+80 END
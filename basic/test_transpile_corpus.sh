@@ -0,0 +1,89 @@
+#!/bin/sh
+# Corpus test for TRANSPILE: every Astronomy_BASIC program the transpiler
+# accepts is compiled and run, and what it prints is diffed against the
+# interpreter running the same program on the same input (40 lines of "1").
+# Only a program that runs to END or STOP can PASS; one that stops at a
+# runtime error (most run out of input) is a SKIP naming that error, even
+# when the compiled program stops at the same place. The generated C++ is
+# built with -Wall -Wextra and any warning in it is a FAIL.
+#
+# Run from the repository root:   sh basic/test_transpile_corpus.sh
+# Prints PASS, FAIL or SKIP (with the reason) for each program and exits 1
+# if any program FAILs. CXX picks the compiler (default c++).
+
+set -u
+CXX=${CXX:-c++}
+CXXFLAGS="-std=c++17 -O1 -I$(pwd)/include"
+TIMEOUT=10
+ROOT=$(pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir "$WORK/obj"
+echo "Building the interpreter in $WORK ..."
+ls src/*.cpp | xargs -P "$(nproc)" -I{} sh -c \
+  "$CXX $CXXFLAGS -c {} -o $WORK/obj/\$(basename {} .cpp).o" || exit 1
+$CXX $WORK/obj/*.o -o "$WORK/basic" -ldl -lpthread || exit 1
+ar rcs "$WORK/libbasic.a" $(ls $WORK/obj/*.o | grep -v basic_runtime_env)
+
+i=0
+while [ $i -lt 40 ]; do echo 1; i=$((i + 1)); done >"$WORK/input"
+
+pass=0 fail=0 skip=0
+cd "$WORK" # the programs' data files land here
+for f in "$ROOT"/Astronomy_BASIC/*.bas; do
+  n=$(basename "$f" .bas)
+
+  msg=$(echo "TRANSPILE $n.cpp" | ./basic "$f" 2>&1 |
+        sed -n 's/.*TRANSPILE ERROR: //p')
+  if [ -n "$msg" ]; then
+    echo "SKIP $n: $msg"; skip=$((skip + 1)); continue
+  fi
+  if ! $CXX $CXXFLAGS -Wall -Wextra "$n.cpp" libbasic.a -o "$n" \
+       -ldl -lpthread 2>"$n.cc.err"; then
+    echo "FAIL $n: does not compile"; sed -n '/error/{p;q}' "$n.cc.err"
+    fail=$((fail + 1)); continue
+  fi
+  if grep -q 'warning:' "$n.cc.err"; then
+    echo "FAIL $n: compiles with warnings"; grep -m 3 'warning:' "$n.cc.err"
+    fail=$((fail + 1)); continue
+  fi
+
+  # The REPL's output between the first two prompts is the program's;
+  # its error lines also carry " (line N[, column C])", which the
+  # binary's do not.
+  (echo RUN; cat input) | timeout $TIMEOUT ./basic "$f" >"$n.raw" 2>&1
+  if [ $? -eq 124 ]; then
+    echo "SKIP $n: the interpreter does not finish in ${TIMEOUT}s"
+    skip=$((skip + 1)); continue
+  fi
+  awk 'BEGIN { RS = "\001" } {
+         s = substr($0, index($0, "READY. ") + 7)
+         e = index(s, "READY. ")
+         printf "%s", e ? substr(s, 1, e - 1) : s
+       }' "$n.raw" |
+    sed 's/\(Runtime error: .*\) (line [0-9]*\(, column [0-9]*\)\{0,1\})$/\1/' >"$n.want"
+  timeout $TIMEOUT "./$n" <input >"$n.got" 2>&1
+
+  # A run that stops at an error (INPUT past end, a statement outside this
+  # dialect, ...) tests only the part before it, so it is not a PASS.
+  stop=$(sed -n 's/.*Runtime error: //p' "$n.want" | tail -1 | cut -c1-60)
+  undef=$(echo "$stop" | sed -n 's/^Unknown identifier: //p')
+  if cmp -s "$n.want" "$n.got"; then
+    if [ -n "$stop" ]; then
+      echo "SKIP $n: both stop at: $stop"; skip=$((skip + 1))
+    else
+      echo "PASS $n"; pass=$((pass + 1))
+    fi
+  elif [ -n "$undef" ]; then
+    echo "SKIP $n: reads $undef before assigning it, which compiled code" \
+         "takes as 0 and the interpreter stops at"
+    skip=$((skip + 1))
+  else
+    echo "FAIL $n: output differs"; diff "$n.want" "$n.got" | head -10
+    fail=$((fail + 1))
+  fi
+done
+
+echo "$pass passed, $fail failed, $skip skipped"
+[ $fail -eq 0 ]
@@ -0,0 +1,64 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+//-----------------------------------------------------------------------------
+// Run-scoped arena
+//-----------------------------------------------------------------------------
+
+// Bytes requested from the heap per arena block (doubled as the run grows).
+constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+// Heap allocations made by the whole process so far (operator new, plain
+// and array forms). Counted only when built with -DBASIC_COUNT_ALLOCATIONS
+// (alloccount.cpp); always 0 otherwise. A host checks that a steady-state
+// loop allocates nothing by sampling it between two yields.
+size_t heapAllocations();
+
+// Monotonic memory resource for one run's interpreter state. Containers
+// built on it never free individual nodes; everything goes back in one
+// release() when the run state is reset (NEW / RUN / load).
+//
+// allocations() counts the requests it served and heapBlocks() the blocks
+// it took from the heap.
+struct RunArena : std::pmr::memory_resource {
+  // Heap side of the arena; counts the blocks it hands out.
+  struct Upstream : std::pmr::memory_resource {
+    size_t blocks = 0;
+    void *do_allocate(size_t bytes, size_t align) override {
+      ++blocks;
+      return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+      std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+  };
+
+  Upstream upstream;
+  std::pmr::monotonic_buffer_resource pool{ARENA_BLOCK_SIZE, &upstream};
+  size_t served = 0;
+
+  size_t allocations() const { return served; }
+  size_t heapBlocks() const { return upstream.blocks; }
+
+  // Free every block at once. Containers using the arena must be empty
+  // (or destroyed) first.
+  void release() { pool.release(); }
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override {
+    ++served;
+    return pool.allocate(bytes, align);
+  }
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+#endif // ARENA_H
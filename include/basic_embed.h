@@ -0,0 +1,84 @@
+#ifndef BASIC_EMBED_H
+#define BASIC_EMBED_H
+
+#include "program_structure.h"
+
+//-----------------------------------------------------------------------------
+// Embedding API: run BASIC programs from a host C++ application.
+//
+// A BasicSession owns one PROGRAM_STRUCTURE, so sessions share no state and
+// can run concurrently on different threads. Link every src/*.cpp except
+// basic_runtime_env.cpp (which holds the REPL's main()).
+//-----------------------------------------------------------------------------
+
+enum BasicRunStatus {
+  BASIC_DONE,    // ran off the last line or executed END or STOP
+  BASIC_YIELDED, // maxSteps lines executed; run() again to resume
+  BASIC_ERROR    // runtime error; see error()
+};
+
+// Zero-copy window onto a dense numeric matrix (row-major). The pointer
+// stays valid until the matrix is re-dimensioned or reassigned.
+struct MatrixView {
+  double *data = nullptr;
+  int rows = 0;
+  int cols = 0;
+};
+
+class BasicSession {
+public:
+  // Replace the program with numbered source text ("10 PRINT X" per line)
+  // and clear all variables, arrays and functions.
+  void load(const std::string &source);
+
+  // Scalars; a trailing '$' selects the string variable (e.g. "A$").
+  void setVar(const std::string &name, double value);
+  void setVar(const std::string &name, const std::string &value);
+  double getVar(const std::string &name) const;
+  std::string getString(const std::string &name) const;
+
+  // Create (or re-dimension) a dense rows x cols matrix and return its
+  // storage so the host can fill it in place.
+  MatrixView dimMatrix(const std::string &name, int rows, int cols);
+  // Direct access to an existing matrix; sparse storage is densified once.
+  MatrixView getMatrix(const std::string &name);
+
+  // Execute up to maxSteps lines (0 = until done). A yielded run resumes
+  // where it stopped; a finished one restarts from the first line.
+  BasicRunStatus run(size_t maxSteps = 0);
+  // Run the subroutine at line until its RETURN, then restore the
+  // position of any run in progress.
+  BasicRunStatus callGosub(int line);
+
+  // Maximum GOSUB/FOR/WHILE/REPEAT nesting (default DEFAULT_FRAME_LIMIT),
+  // set between runs. Deeper programs stop with a stack overflow error
+  // naming the line.
+  void setStackLimit(size_t frames) { program_.frames.setLimit(frames); }
+
+  // Same as SEED seed, stream: give each parallel session its own stream
+  // of one seed for reproducible, non-overlapping random numbers.
+  void seed(uint64_t seed, uint64_t stream = 0) {
+    program_.rng.seed(seed, stream);
+  }
+
+  // Heap allocations made by the process so far (see heapAllocations in
+  // arena.h: needs a build with -DBASIC_COUNT_ALLOCATIONS). Unchanged
+  // between two yields means the loop in between allocated nothing.
+  size_t allocationCount() const { return heapAllocations(); }
+
+  void onPrint(std::function<void(const std::string &)> hook);
+  void onInput(std::function<bool(std::string &)> hook);
+
+  // The error behind the last BASIC_ERROR: message, line and the column
+  // of the statement within the line.
+  const RunError &error() const { return program_.error; }
+  const std::string &lastError() const { return program_.error.message; }
+  PROGRAM_STRUCTURE &program() { return program_; }
+
+private:
+  BasicRunStatus fail(const std::exception &e);
+
+  PROGRAM_STRUCTURE program_;
+};
+
+#endif // BASIC_EMBED_H
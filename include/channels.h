@@ -0,0 +1,73 @@
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "output.h"
+
+//-----------------------------------------------------------------------------
+// File channels for OPEN / CLOSE / INPUT# / PRINT#
+//-----------------------------------------------------------------------------
+
+// Channel numbers run 1..MAX_CHANNELS-1 and index a dense array.
+constexpr int MAX_CHANNELS = 256;
+// Read-ahead block size and PRINT# write-behind capacity per channel.
+constexpr size_t CHANNEL_BUFFER_SIZE = 1 << 20;
+
+struct FileCloser {
+  void operator()(std::FILE *f) const {
+    if (f)
+      std::fclose(f);
+  }
+};
+
+enum ChannelMode { CHANNEL_CLOSED, CHANNEL_INPUT, CHANNEL_OUTPUT };
+
+// One OPEN channel. The FILE is unbuffered: input is read ahead into
+// readBuf in large blocks and parsed in place, output goes through `out`.
+// Offsets are 64-bit so files larger than 4 GB work.
+struct FileHandle {
+  std::unique_ptr<std::FILE, FileCloser> file;
+  std::string filename;
+  ChannelMode mode = CHANNEL_CLOSED;
+  bool binary = false; // OPEN ... FOR BINARY INPUT|OUTPUT|APPEND
+
+  std::vector<char> readBuf;
+  size_t readPos = 0;         // next unread byte in readBuf
+  size_t readEnd = 0;         // end of valid data in readBuf
+  int64_t bufferOffset = 0;   // file offset of readBuf[0]
+  bool atEof = false;         // the FILE has no more bytes
+
+  OutputBuffer out; // PRINT# buffer
+
+  bool isOpen() const { return mode != CHANNEL_CLOSED; }
+};
+
+struct PROGRAM_STRUCTURE;
+
+// Open channel n, or throw "Channel n not open".
+FileHandle &openChannel(PROGRAM_STRUCTURE &program, int channel);
+void closeAllChannels(PROGRAM_STRUCTURE &program);
+
+// Read the next comma/line separated field from an INPUT channel.
+// Return false at end of file.
+bool readNumberField(FileHandle &fh, double &value);
+bool readStringField(FileHandle &fh, std::string &value);
+
+// Raw byte access for binary channels (MAT READ#/WRITE#/MAP#). Reads drain
+// the read-ahead buffer first; large blocks bypass it. Short reads throw.
+void readChannelBytes(FileHandle &fh, void *dst, size_t n);
+void writeChannelBytes(FileHandle &fh, const void *src, size_t n);
+int64_t channelTell(const FileHandle &fh);
+void channelSkip(FileHandle &fh, int64_t bytes);
+
+// EOF(n), LOC(n) (bytes consumed/written) and LOF(n) (file length)
+bool channelEOF(PROGRAM_STRUCTURE &program, int channel);
+int64_t channelPosition(PROGRAM_STRUCTURE &program, int channel);
+int64_t channelLength(PROGRAM_STRUCTURE &program, int channel);
+
+#endif // CHANNELS_H
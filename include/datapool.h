@@ -0,0 +1,46 @@
+#ifndef DATAPOOL_H
+#define DATAPOOL_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// DATA pool: every DATA item of the program, parsed once before a run.
+// Item i's number is numbers[i]. String items also get their text in one
+// arena; stringsBefore[i] counts the string items before i, so item i is a
+// string when stringsBefore[i + 1] > stringsBefore[i], and a run of items
+// is all numeric when the counts at both ends match.
+//-----------------------------------------------------------------------------
+struct DataPool {
+  std::vector<double> numbers;          // 0 for string items
+  std::vector<uint32_t> stringsBefore;  // size items + 1
+  std::string arena;                    // text of all string items
+  std::vector<uint32_t> stringOffsets;  // arena start of each string, + end
+  // First item at or after each program line, for RESTORE <line>
+  std::unordered_map<int, size_t> lineStart;
+
+  size_t size() const { return numbers.size(); }
+  bool isString(size_t i) const {
+    return stringsBefore[i + 1] != stringsBefore[i];
+  }
+  bool allNumeric(size_t first, size_t count) const {
+    return stringsBefore[first + count] == stringsBefore[first];
+  }
+  std::string text(size_t i) const {
+    uint32_t k = stringsBefore[i];
+    return arena.substr(stringOffsets[k], stringOffsets[k + 1] -
+                                              stringOffsets[k]);
+  }
+};
+
+struct PROGRAM_STRUCTURE;
+
+// Collect the DATA statements of program.statements into program.data.
+void buildDataPool(PROGRAM_STRUCTURE &program);
+// Copy the next n numeric items to dst (memcpy when the run has no
+// strings). Throws on a string item or when DATA runs out.
+void readDataNumbers(PROGRAM_STRUCTURE &program, double *dst, size_t n);
+
+#endif // DATAPOOL_H
@@ -0,0 +1,30 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include "program_structure.h"
+
+//-----------------------------------------------------------------------------
+// Threaded run loop over pre-decoded lines
+//-----------------------------------------------------------------------------
+
+// Decode program.statements once, then run from program.currentStatement
+// until the program halts. Each statement becomes one op; the common shapes get
+// their own operands, parsed here instead of on every execution:
+//   GOTO n, GOSUB n, RETURN, NEXT [v, ...]
+//   LET x = x + c / LET x = x - c          (c a number)
+//   IF a op b THEN n                       (a, b variables or numbers)
+//   LET x = x +/- c on the line before a NEXT runs both lines in one op
+//   LET x = <expr>, IF <expr> THEN n       (compiled on first run, exprvm.h)
+//   ON <expr> GOTO|GOSUB n1, n2, ...       (its jump table, one indexed
+//                                           branch)
+// Anything else (and any op whose fast path does not apply, e.g. an
+// operand that is still undefined) runs through executeStatement, so
+// results and errors match stepInterpreter. With GCC or Clang ops are
+// chained with computed gotos; other compilers use a switch.
+// Returns RUN_HALTED, or RUN_ERROR for a jump to a missing line (also an
+// ON entry) or a RETURN without GOSUB; errors raised by handlers propagate as thrown.
+// Under ON ERROR GOTO any of them continues at the handler's op instead,
+// without decoding again.
+RunStatus runDecoded(PROGRAM_STRUCTURE &program);
+
+#endif // DISPATCH_H
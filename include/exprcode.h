@@ -0,0 +1,74 @@
+#ifndef EXPRCODE_H
+#define EXPRCODE_H
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Numeric expressions compiled to three-address register code (the code
+// itself; compiling and running it is in exprvm.h)
+//-----------------------------------------------------------------------------
+
+struct UserFunction;
+
+// Most arguments a built-in numeric function takes; both evalExpression and
+// the compiler below size their argument lists by it.
+constexpr int MAX_FUNCTION_ARGS = 4;
+
+enum ExprOp : unsigned char {
+  XOP_MOV, // dst = a
+  XOP_NEG, // dst = -a
+  XOP_ADD,
+  XOP_SUB,
+  XOP_MUL,
+  XOP_DIV, // throws "Division by zero" like evalExpression
+  XOP_EQ,  // relations and logic yield -1 / 0
+  XOP_NE,
+  XOP_LT,
+  XOP_GT,
+  XOP_LE,
+  XOP_GE,
+  XOP_AND,
+  XOP_OR,
+  XOP_NOT,
+  XOP_CALL1,  // dst = fn1(a)
+  XOP_CALL2,  // dst = fn2(a, b)
+  XOP_RND,    // dst = the session's next RND
+  XOP_CALLFN  // dst = user(its argument slots), filled by MOVs before
+};
+
+// Operands point straight at their values: a variable's own slot, a
+// constant or a temporary of the ExprCode, so `A1 = Q/(1-E0)` is
+//   SUB t0, 1, E0
+//   DIV A1, Q, t0
+struct ExprInstr {
+  ExprOp op;
+  double *dst;
+  const double *a, *b;
+  double (*fn1)(double);
+  double (*fn2)(double, double);
+  UserFunction *user = nullptr; // XOP_CALLFN only
+};
+
+// One compiled expression. Pointers refer into the constants, temporaries
+// and locals below, so it may be moved but not copied.
+struct ExprCode {
+  std::vector<ExprInstr> code;
+  std::vector<double> constants;
+  std::vector<double> temps;
+  std::vector<double> locals; // arguments of inlined DEF FN calls
+  const double *result = nullptr;
+
+  ExprCode() = default;
+  ExprCode(ExprCode &&) = default;
+  ExprCode &operator=(ExprCode &&) = default;
+  ExprCode(const ExprCode &) = delete;
+  ExprCode &operator=(const ExprCode &) = delete;
+};
+
+enum ExprCompileStatus {
+  EXPR_COMPILED,
+  EXPR_NOT_YET,     // a variable it reads does not exist yet
+  EXPR_UNSUPPORTED  // leave it to evalExpression
+};
+
+#endif // EXPRCODE_H
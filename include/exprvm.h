@@ -0,0 +1,43 @@
+#ifndef EXPRVM_H
+#define EXPRVM_H
+
+#include "exprcode.h"
+#include "program_structure.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compile `expr` with evalExpression's grammar and semantics. Variables
+// are bound to their slots in program.numericVariables (slots keep their
+// address until resetRunState), so every one of them must exist. String
+// operands, INSTR, matrix reductions, channel functions and anything
+// evalExpression would reject are left unsupported; running them through
+// evalExpression keeps its results and messages. DEF FN calls are
+// inlined when the body is small, else called. When `into` is given the
+// last instruction stores the value there directly.
+ExprCompileStatus compileExpression(PROGRAM_STRUCTURE &program,
+                                    const std::string &expr, ExprCode &out,
+                                    double *into = nullptr);
+
+// Run compiled code and return the expression's value.
+double runExpression(PROGRAM_STRUCTURE &program, ExprCode &code);
+
+// Compile a DEF FN body into fn.body, its parameters read from fn.slots,
+// and record in fn.pure whether it depends on nothing else. Leaves the
+// status in fn.status.
+ExprCompileStatus compileFunction(PROGRAM_STRUCTURE &program,
+                                  UserFunction &fn);
+
+// FN<name>(args): the compiled body when there is one, else the body text
+// through evalExpression with the arguments bound to the parameters.
+// CACHED functions look the argument up first.
+double callUserFunction(PROGRAM_STRUCTURE &program, UserFunction &fn,
+                        const double *args, int nargs);
+
+// When identifier `id`, with pos past it and any blanks, starts a DEF FN
+// call (FNAREA( or FN AREA(), set `name` to the function's name and move
+// pos past '('.
+bool userFunctionCall(std::string_view expr, size_t &pos, std::string_view id,
+                      std::string_view &name);
+
+#endif // EXPRVM_H
@@ -9,4 +9,9 @@ void load(PROGRAM_STRUCTURE &program);
 // Saves a BASIC program to program.filename
 void save(PROGRAM_STRUCTURE &program);
 
+// Parses numbered source lines from a stream into program.programSource
+// and splits them into program.statements
+size_t BASIC_Program_loadStream(PROGRAM_STRUCTURE &program, std::istream &in,
+                                bool verbose = false);
+
 #endif // FILEIO_H
@@ -0,0 +1,64 @@
+#ifndef FRAMESTACK_H
+#define FRAMESTACK_H
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+struct VarInfo;
+
+//-----------------------------------------------------------------------------
+// Control stack shared by GOSUB and FOR. WHILE and REPEAT need no frames:
+// they branch through the loop table built before each run (loops.cpp).
+//-----------------------------------------------------------------------------
+
+enum FrameKind : unsigned char { FRAME_GOSUB, FRAME_FOR };
+
+// One stack entry. Plain data, so pushing never allocates.
+struct Frame {
+  FrameKind kind;
+  int line;         // line of the GOSUB / FOR
+  int statement;    // and its index in program.statements
+  int end;          // FOR: statement index of the last NEXT that may
+                    // close it, or -1
+  VarInfo *var;     // FOR: loop variable slot
+  double limit;     // FOR: TO value
+  double step;      // FOR: STEP value
+};
+
+constexpr size_t DEFAULT_FRAME_LIMIT = 4096;
+
+// Fixed array of frames, allocated once for the configured depth limit.
+struct FrameStack {
+  std::unique_ptr<Frame[]> frames{new Frame[DEFAULT_FRAME_LIMIT]};
+  size_t depth = 0;
+  size_t limit = DEFAULT_FRAME_LIMIT;
+
+  // Change the depth limit. Meant for use between runs: clears the stack.
+  void setLimit(size_t n) {
+    frames.reset(new Frame[n]);
+    limit = n;
+    depth = 0;
+  }
+
+  // Push, or throw a stack overflow (reported at the line that pushed).
+  void push(const Frame &f) {
+    if (depth == limit)
+      throw std::runtime_error("RUNTIME ERROR: Stack overflow (" +
+                               std::to_string(limit) + " frames)");
+    frames[depth++] = f;
+  }
+
+  bool empty() const { return depth == 0; }
+  size_t size() const { return depth; }
+  Frame &top() { return frames[depth - 1]; }
+  void pop() { --depth; }
+  void truncate(size_t n) {
+    if (n < depth)
+      depth = n;
+  }
+  void clear() { depth = 0; }
+};
+
+#endif // FRAMESTACK_H
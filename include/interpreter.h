@@ -15,6 +15,7 @@
 #include <stack>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <regex>
 #include <sstream>
 #include <iostream>
@@ -23,9 +24,6 @@
 #include <sstream>
 
 
-extern PROGRAM_STRUCTURE program;
-
-extern int currentLine;
 //
 
 //
@@ -53,8 +51,146 @@ struct IdentifierReturn {
 //             prototypes
 //
 
-void evaluateMATExpression(const std::string &target,
+void evaluateMATExpression(PROGRAM_STRUCTURE &program,
+                           const std::string &target,
                            const std::string &expression);
+
+// Statement kinds, from a line's leading keyword
+enum StatementType {
+  ST_UNKNOWN,
+  ST_LET,
+  ST_PRINTexpr,
+  ST_INPUTops,
+  ST_GOTO,
+  ST_IF,
+  ST_FOR,
+  ST_NEXT,
+  ST_READ,
+  ST_DATA,
+  ST_RESTORE,
+  ST_DEF,
+  ST_DIM,
+  ST_REM,
+  ST_STOP,
+  ST_GOSUB,
+  ST_RETURN,
+  ST_END,
+  ST_ON,
+  ST_PRINTFILEUSING,
+  ST_MATops,
+  ST_FORMAT,
+  ST_BEEP,
+  ST_OPEN,
+  ST_CLOSE,
+  ST_PRINT,
+  ST_WHILE,
+  ST_WEND,
+  ST_REPEAT,
+  ST_UNTIL,
+  ST_SEED,
+  ST_MATREAD,
+  ST_FLUSH,
+  ST_TRACE,
+  ST_INPUTFILE,
+  ST_ON_ERROR,
+  ST_RESUME
+};
+
+// What the dispatcher will run for `code` (one statement);
+// shared with the transpiler so both read programs the same way.
+StatementType classifyStatement(const std::string &code);
+
+// The statements of one source line: a '\' outside string literals
+// separates them and REM keeps the rest of its line. A line without '\'
+// is returned as it is.
+std::vector<std::string> splitStatements(const std::string &text);
+// Split programSource into program.statements: a '\' outside string
+// literals separates statements (REM keeps the rest of its line), and a
+// statement of the form NAME = expr becomes LET NAME = expr. Run when a
+// program is loaded and again by startInterpreter, for edited lines.
+void buildStatementTable(PROGRAM_STRUCTURE &program);
+// Index of the first statement of `line`, or -1 when there is no such line.
+int statementIndex(const PROGRAM_STRUCTURE &program, int line);
+// Position the session at the start of `line` (hosts that run single
+// lines: RUN NATIVE, transpiled programs, BasicSession::callGosub), or at
+// statement index `statement` of program.statements.
+void moveToLine(PROGRAM_STRUCTURE &program, int line);
+void moveToStatement(PROGRAM_STRUCTURE &program, int statement);
+
+// Run the handler for one line of the given kind (no trace, no advance).
+void executeStatement(PROGRAM_STRUCTURE &program, StatementType kind,
+                      const std::string &code);
+
+// Run loop: start resets stacks and moves to the first statement, step
+// executes one statement and returns false once the program has halted
+// (errors not taken by ON ERROR are thrown, for hosts that run single
+// lines).
+// continueInterpreter runs from the current statement: to the end through
+// the threaded dispatcher (dispatch.cpp), or for at most maxSteps
+// statements. It reports how the run ended instead of throwing; a runtime
+// error is left in program.error. Output is flushed before it returns.
+// runInterpreter is start plus continue.
+void startInterpreter(PROGRAM_STRUCTURE &program);
+bool stepInterpreter(PROGRAM_STRUCTURE &program);
+RunStatus continueInterpreter(PROGRAM_STRUCTURE &program, size_t maxSteps = 0);
+RunStatus runInterpreter(PROGRAM_STRUCTURE &program);
+// Record `message` as an error at the current statement and halt.
+RunStatus failRun(PROGRAM_STRUCTURE &program, const std::string &message);
+// NEW / RUN: forget variables, arrays and functions and free the run arena.
+void resetRunState(PROGRAM_STRUCTURE &program);
+
+// Schedule the statement after `statement` as the next one (or halt after
+// the last).
+void jumpAfter(PROGRAM_STRUCTURE &program, int statement);
+// Scanning for the handlers the step loop runs every iteration (LET, IF,
+// GOTO, GOSUB, NEXT, WHILE, UNTIL), which must not allocate: the first
+// position at or after `pos` that is not white space, and the position
+// just after `word` (upper case, matched in any case) at `pos`, or npos.
+size_t skipBlanks(const std::string &text, size_t pos);
+size_t matchWord(const std::string &text, size_t pos, const char *word);
+// Whether identifier `id` is `name` (upper case) in any case.
+bool sameName(std::string_view id, const char *name);
+// NEXT on parsed names ("" for the innermost loop), as executeNEXT after
+// its syntax check (loops.cpp).
+void stepNEXT(PROGRAM_STRUCTURE &program,
+              const std::vector<std::string> &names);
+// Pop the loop frames a jump to statement `target` leaves (loops.cpp).
+void unwindLoops(PROGRAM_STRUCTURE &program, int target);
+// ON ERROR GOTO: send a runtime error to the armed handler, recording ERR,
+// ERL and the statement for RESUME. False when no handler takes it (none
+// armed, or the handler itself failed); otherwise the run continues at
+// program.currentStatement (errortrap.cpp).
+bool trapError(PROGRAM_STRUCTURE &program, const std::string &message);
+// ERR / ERL (any case) when no variable has the name: the last trapped
+// error's code and line. nullptr for other names.
+const double *errorVariable(const PROGRAM_STRUCTURE &program,
+                            std::string_view name);
+// Pair every FOR/WHILE/REPEAT with its NEXT/WEND/UNTIL in one pass over
+// the statements (loops.cpp); run by startInterpreter and
+// BasicSession::load.
+void buildLoopTable(PROGRAM_STRUCTURE &program);
+// Parse an ON GOTO/GOSUB statement into `table` (targets left empty);
+// false when `code` is not one.
+bool parseON(const std::string &code, JumpTable &table);
+// Compile every ON statement to a jump table of statement indices; run
+// with buildLoopTable.
+void buildJumpTables(PROGRAM_STRUCTURE &program);
+// The entry an ON selector picks: truncated, counting from 1, or n (none,
+// so the ON falls through) when out of range.
+inline size_t jumpIndex(double selector, size_t n) {
+  return selector >= 1.0 && selector < static_cast<double>(n) + 1.0
+             ? static_cast<size_t>(selector) - 1
+             : n;
+}
+
+// Buffered console output (output.cpp). basicReadLine flushes pending
+// output before reading; basicFlush also flushes open PRINT# channels.
+void basicWrite(PROGRAM_STRUCTURE &program, const std::string &text);
+void basicFlush(PROGRAM_STRUCTURE &program);
+bool basicReadLine(PROGRAM_STRUCTURE &program, std::string &line);
+OutputBuffer &channelOutput(PROGRAM_STRUCTURE &program, int channel);
+void executeFLUSH(PROGRAM_STRUCTURE &program, const std::string &line);
+void executeTRACE(PROGRAM_STRUCTURE &program, const std::string &line);
  
  
 //=========================================================
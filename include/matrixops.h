@@ -2,38 +2,47 @@
 #define MATRIXOPS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include "program_structure.h"  // defines MatrixValue, MatrixIndex, PROGRAM_STRUCTURE
 
 //-----------------------------------------------------------------------------
 // Core dispatcher: parses a MAT-line and executes the requested operation.
 //   - line: the full source line, e.g. "MAT INV = INVERSE(A)"
-//   - A, B: optional operand matrices (empty if not used by this operation)
-//   - scalar: optional scalar for scalar ops
-//   - intArg: optional integer argument (e.g. exponent for POWER)
 // Returns a MatrixValue when the operation produces a matrix, or a 1×1
-// matrix containing a scalar result (e.g. DETERMINANT, RANK).
-//-----------------------------------------------------------------------------
-MatrixValue executeMATOperation(
-    const std::string &line,
-    const MatrixValue &A = {},
-    const MatrixValue &B = {},
-    double scalar = 0.0,
-    int intArg = 0
-);
+// matrix containing a scalar result (e.g. DET, RANK).
+//-----------------------------------------------------------------------------
+MatrixValue executeMATOperation(PROGRAM_STRUCTURE &program,
+                                const std::string &line);
+
+// MAT statement entry point called from the interpreter's dispatch switch.
+void executeMATops(PROGRAM_STRUCTURE &program, const std::string &line);
+
+// Declared matrix `name`, or a RUNTIME ERROR naming it.
+MatrixValue &matrixNamed(PROGRAM_STRUCTURE &program, const std::string &name);
 
 //-----------------------------------------------------------------------------
 // DIM helper: ensures the runtime’s program.matrices[name] exists and is sized.
 // Should be called from your DIM statement handler.
 //-----------------------------------------------------------------------------
-void executeDIM(const std::string &line);
+void executeDIM(PROGRAM_STRUCTURE &program, const std::string &line);
 
 //-----------------------------------------------------------------------------
 // MAT READ / PRINT
 //-----------------------------------------------------------------------------
-void executeMATREAD(const std::string &line);
-void executeMATPRINT(const std::string &line, std::ostream &out);
-void executeMATPRINTFILE(const std::string &line);
+void executeMATREAD(PROGRAM_STRUCTURE &program, const std::string &line);
+void executeMATPRINT(PROGRAM_STRUCTURE &program, const std::string &line);
+void executeMATPRINTFILE(PROGRAM_STRUCTURE &program, const std::string &line);
+
+//-----------------------------------------------------------------------------
+// Binary matrix files on BINARY channels (matfile.cpp)
+//   MAT WRITE #n, A   raw little-endian doubles after a dimensions header
+//   MAT READ #n, A    reads one record into A, sized from its header
+//   MAT MAP #n, A     maps the record read-only instead of copying it
+//-----------------------------------------------------------------------------
+void executeMATWRITEFILE(PROGRAM_STRUCTURE &program, const std::string &line);
+void executeMATREADFILE(PROGRAM_STRUCTURE &program, const std::string &line);
+void executeMATMAP(PROGRAM_STRUCTURE &program, const std::string &line);
 
 //-----------------------------------------------------------------------------
 // Basic element-wise and scalar operations
@@ -59,20 +68,47 @@ MatrixValue matPower   (const MatrixValue &A, int exponent);
 MatrixValue matTranspose(const MatrixValue &A);
 MatrixValue matInverse  (const MatrixValue &A);
 MatrixValue matSolve    (const MatrixValue &A, const MatrixValue &B);
+MatrixValue matDiagonal (const MatrixValue &A);
 double      matDeterminant(const MatrixValue &A);
 int         matRank      (const MatrixValue &A);
 double      matTrace     (const MatrixValue &A);
+// FUNCTION(x) for every element ("SIN", "SQR", ...; see vecmath.h), split
+// across the worker pool for large matrices.
+MatrixValue matApply    (const MatrixValue &A, const std::string &function);
 void        matLU        (
     const MatrixValue &A,
     MatrixValue &L,
     MatrixValue &U
 );
 
+//-----------------------------------------------------------------------------
+// Reductions: SUM(A), MEAN(A), MINVAL(A), MAXVAL(A) and the 1-based
+// positions MINLOC(A)/MAXLOC(A) (row-major over the whole matrix). Large
+// matrices are split across the worker pool; sums are pairwise.
+//-----------------------------------------------------------------------------
+enum MatReduction {
+  RED_SUM,
+  RED_MEAN,
+  RED_MINVAL,
+  RED_MAXVAL,
+  RED_MINLOC,
+  RED_MAXLOC
+};
+
+// op for a reduction name in any case; false when name is not one
+bool matReductionNamed(std::string_view name, MatReduction &op);
+double matReduce(const MatrixValue &A, MatReduction op);
+// Along dim 1 (down each column, giving 1 x cols; LOC is the row) or dim 2
+// (across each row, giving rows x 1; LOC is the column)
+MatrixValue matReduceAlong(const MatrixValue &A, MatReduction op, int dim);
+
 //-----------------------------------------------------------------------------
 // Special constructors
 //-----------------------------------------------------------------------------
 MatrixValue matIdentity(int n);
 MatrixValue matOnes    (int rows, int cols);
 MatrixValue matZeros   (int rows, int cols);
+// rows x cols uniform [0, 1) values from one bulk RngEngine::fill
+MatrixValue matRandom  (RngEngine &rng, int rows, int cols);
 
 #endif // MATRIXOPS_H
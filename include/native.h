@@ -0,0 +1,51 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include "program_structure.h"
+
+//-----------------------------------------------------------------------------
+// RUN NATIVE: the program transpiled, compiled to a shared object and loaded
+//-----------------------------------------------------------------------------
+
+// Bumped whenever NativeHost or the module entry points change.
+#define BASIC_NATIVE_ABI 2
+
+// Callbacks a module uses to reach the session: its numeric variables, the
+// interpreter for statements it has no native code for (by index in
+// program.statements), expressions, MAT lines, reductions and RND. Spelled
+// once here; the transpiler pastes the same text into every module, so the
+// two cannot drift.
+#define BASIC_NATIVE_HOST_FIELDS                                               \
+  void *program;                                                               \
+  double *(*variable)(void *program, const char *name);                        \
+  int (*step)(void *program, int statement);                                   \
+  double (*eval)(void *program, const char *expr);                             \
+  void (*mat)(void *program, const char *line);                                \
+  double (*reduce)(void *program, const char *matrix, int op);                 \
+  double (*rnd)(void *program);                                                \
+  void (*finish)(void *program);
+
+struct NativeHost {
+  BASIC_NATIVE_HOST_FIELDS
+};
+
+// Module entry points (extern "C"):
+//   int basic_native_abi(void)                  returns BASIC_NATIVE_ABI
+//   void basic_native_run(const NativeHost *)   runs from the first line
+typedef void (*NativeEntry)(const NativeHost *host);
+
+// Entry point for the loaded program, building it when needed. Modules are
+// cached on disk under a hash of their generated source (in
+// $BASIC_NATIVE_CACHE, else $XDG_CACHE_HOME/basic-native, else
+// ~/.cache/basic-native, else a mode 0700 /tmp/basic-native-<uid> that
+// must belong to the user) and stay loaded for the life of the process. The
+// compiler is $BASIC_CXX, else c++. Throws "NATIVE ERROR: ..." when the
+// program cannot be translated, compiled or loaded.
+NativeEntry loadNativeModule(PROGRAM_STRUCTURE &program);
+
+// Run the loaded program through its native module. Like runInterpreter
+// it returns RUN_HALTED or RUN_ERROR (see program.error) and flushes
+// output when it stops; only a module that cannot be built throws.
+RunStatus runNative(PROGRAM_STRUCTURE &program);
+
+#endif // NATIVE_H
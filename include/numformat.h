@@ -0,0 +1,50 @@
+#ifndef NUMFORMAT_H
+#define NUMFORMAT_H
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Number formatting for PRINT and PRINT USING
+//-----------------------------------------------------------------------------
+
+// Longest text formatNumber() can produce (sign, 17 digits, exponent).
+constexpr size_t NUMBER_TEXT_MAX = 32;
+
+// Shortest text that reads back as exactly v ("3", "0.1", "1e+300").
+// Writes into buf (at least NUMBER_TEXT_MAX bytes), returns the length.
+size_t formatNumber(double v, char *buf);
+void appendNumber(std::string &out, double v);
+std::string formatNumber(double v);
+
+enum FieldType { FIELD_TEXT, FIELD_NUMERIC, FIELD_STRING };
+
+// One field of a compiled ":=" format line.
+//   FIELD_TEXT     literal text, copied as is
+//   FIELD_NUMERIC  "$##,###.##": width, decimals, leading '$', ',' grouping
+//   FIELD_STRING   run of l/r/c: width and alignment
+struct FormatField {
+  FieldType type = FIELD_TEXT;
+  std::string text;
+  int width = 0;
+  int decimals = 0;
+  bool dollar = false;
+  bool grouping = false;
+  char align = 'l';
+};
+
+struct CompiledFormat {
+  std::vector<FormatField> fields;
+  size_t valueCount = 0; // numeric + string fields
+};
+
+// Parse a format string once into field descriptors.
+CompiledFormat compileFormat(const std::string &spec);
+
+// Render v into a numeric field (right-aligned; '%' prefix on overflow).
+void renderNumericField(std::string &out, const FormatField &f, double v);
+// Render s into a string field, clipped or padded to the field width.
+void renderStringField(std::string &out, const FormatField &f,
+                       const std::string &s);
+
+#endif // NUMFORMAT_H
@@ -0,0 +1,56 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Write-behind buffer for one output channel (the console or a PRINT# file).
+// Text accumulates until the buffer fills or flush() is called; the
+// interpreter flushes on INPUT, FLUSH, CLOSE and at the end of a run.
+//-----------------------------------------------------------------------------
+struct OutputBuffer {
+  std::string pending;
+  std::ostream *sink = nullptr;
+  // When set, receives each flushed chunk instead of sink (embedding hosts)
+  std::function<void(const std::string &)> hook;
+  size_t capacity = 64 * 1024;
+  // Output column after the text written so far (0 after a newline); PRINT
+  // measures its comma zones from it
+  size_t column = 0;
+
+  // The column that writing `text` would leave.
+  size_t columnAfter(const std::string &text) const {
+    size_t nl = text.rfind('\n');
+    return nl == std::string::npos ? column + text.size()
+                                   : text.size() - nl - 1;
+  }
+
+  void write(const std::string &text) {
+    column = columnAfter(text);
+    pending += text;
+    if (pending.size() >= capacity)
+      drain();
+  }
+
+  // Hand pending text to the hook/sink and flush the sink itself.
+  void flush() {
+    drain();
+    if (sink && !hook)
+      sink->flush();
+  }
+
+private:
+  void drain() {
+    if (pending.empty())
+      return;
+    if (hook)
+      hook(pending);
+    else if (sink)
+      sink->write(pending.data(), static_cast<std::streamsize>(pending.size()));
+    pending.clear();
+  }
+};
+
+#endif // OUTPUT_H
@@ -17,6 +17,7 @@
 #include <limits.h>
 #include <map>
 #include <memory>
+#include <memory_resource>
 #include <ratio>
 #include <regex>
 #include <sstream>
@@ -29,6 +30,15 @@
 #include <unordered_map>
 #include <utility>
 
+#include "arena.h"
+#include "channels.h"
+#include "datapool.h"
+#include "exprcode.h"
+#include "framestack.h"
+#include "numformat.h"
+#include "output.h"
+#include "rng.h"
+#include "strvalue.h"
 
 const size_t DENSE_MATRIX_THRESHOLD = 10000;
 
@@ -102,6 +112,7 @@ struct IdentifierReturn {
   std::string s;
   double d;
 };
+*/
 
 /*
 struct MatrixIndex {
@@ -124,25 +135,65 @@ struct Matrix {
 
 struct MatrixValue {
   std::map<MatrixIndex, VarInfo> sparseValues;
-  std::vector<VarInfo> denseValues;
+  // Dense numeric storage is one contiguous row-major block of doubles so
+  // hosts and bulk MAT operations can work on data() in place. String
+  // matrices keep their dense elements in denseStrings instead.
+  std::vector<double> denseValues;
+  std::vector<std::string> denseStrings;
+  // Read-only elements of a MAT MAP'd file, used instead of denseValues;
+  // the first write copies them into denseValues (see unmap()).
+  std::shared_ptr<const double> mapped;
   std::vector<int> dimensions;
   size_t totalSize = 0;
   bool isSparse = false;
+  bool isString = false;
 
-  void configureStorage(const std::vector<int>& dims) {
+  void configureStorage(const std::vector<int>& dims,
+                        bool forceDense = false) {
+    mapped.reset();
     dimensions = dims;
     totalSize = 1;
     for (int d : dims) totalSize *= d;
 
-    if (totalSize < DENSE_MATRIX_THRESHOLD) {
+    if (forceDense || totalSize < DENSE_MATRIX_THRESHOLD) {
       isSparse = false;
-      denseValues.resize(totalSize);
+      if (isString)
+        denseStrings.resize(totalSize);
+      else
+        denseValues.resize(totalSize);
     } else {
       isSparse = true;
       sparseValues.clear();
     }
   }
 
+  // Move sparse elements into dense storage (no-op when already dense).
+  void makeDense() {
+    if (!isSparse) return;
+    std::map<MatrixIndex, VarInfo> old;
+    old.swap(sparseValues);
+    configureStorage(dimensions, true);
+    for (const auto &entry : old) set(entry.first, entry.second);
+  }
+
+  // Replace a mapped view with a private, writable copy.
+  void unmap() {
+    if (!mapped) return;
+    denseValues.assign(mapped.get(), mapped.get() + totalSize);
+    mapped.reset();
+  }
+
+  // Contiguous row-major elements, or nullptr for sparse/string matrices.
+  double *data() {
+    if (isSparse || isString) return nullptr;
+    unmap();
+    return denseValues.data();
+  }
+  const double *data() const {
+    if (isSparse || isString) return nullptr;
+    return mapped ? mapped.get() : denseValues.data();
+  }
+
   size_t flattenIndex(const MatrixIndex& index) const {
     if (dimensions.size() != 2)
       throw std::runtime_error("Only 2D matrices supported in flattenIndex()");
@@ -159,8 +210,10 @@ struct MatrixValue {
       return fallback;
     } else {
       size_t flat = flattenIndex(idx);
-      if (flat >= denseValues.size()) throw std::out_of_range("Index out of bounds");
-      return denseValues[flat];
+      if (flat >= totalSize) throw std::out_of_range("Index out of bounds");
+      if (isString) return VarInfo(denseStrings[flat]);
+      if (mapped) return VarInfo(mapped.get()[flat]);
+      return VarInfo(denseValues[flat]);
     }
   }
 
@@ -171,7 +224,8 @@ struct MatrixValue {
       static_cast<int>(idx / cols),
       static_cast<int>(idx % cols)
     };
-  
+  }
+
   void set(const MatrixIndex& idx, const VarInfo& value) {
     if (isSparse) {
       if (value.numericValue != 0.0 || value.isString)
@@ -180,31 +234,78 @@ struct MatrixValue {
         sparseValues.erase(idx);
     } else {
       size_t flat = flattenIndex(idx);
-      if (flat >= denseValues.size()) throw std::out_of_range("Index out of bounds");
-      denseValues[flat] = value;
+      if (flat >= totalSize) throw std::out_of_range("Index out of bounds");
+      if (isString) {
+        denseStrings[flat] = value.stringValue;
+      } else {
+        unmap();
+        denseValues[flat] = value.numericValue;
+      }
     }
   }
 };
 
-// Structure to hold FOR loop state
-struct ForInfo {
-  std::string varName; // loop variable
-  double endValue;     // upper bound
-  double step;         // step increment
-  int forLine;         // line number of the FOR statement
-};
 
+// Most parameters a DEF FN function takes (as many as a built-in)
+constexpr int MAX_FN_PARAMS = 4;
+
+// DEF FN<name>(<params>) = <expr> [CACHED]. The body is compiled in place
+// on first call (exprvm.cpp), its parameters read from `slots`, so a
+// compiled function is never moved.
 struct UserFunction {
-  std::string param; // e.g. "X"
-  std::string expr;  // e.g. "SIN(X)+10"
+  std::string name;                // e.g. "AREA", without FN
+  std::vector<std::string> params; // e.g. {"W", "H"}
+  std::string expr;                // e.g. "W*H/2"
+  bool cached = false;    // CACHED: memoize on its one argument
+  bool inlinable = false; // only one DEF line defines it
+  double slots[MAX_FN_PARAMS] = {};
+  ExprCode body;
+  ExprCompileStatus status = EXPR_NOT_YET;
+  bool pure = false;      // body reads only its parameters
+  bool compiling = false; // guards against a body that calls itself
+  bool active = false;
+  std::unordered_map<double, double> memo;
 };
-// File handle wrapper
-struct FileHandle {
-  std::unique_ptr<std::fstream> stream;
+
+// ON <expr> GOTO|GOSUB <lines>, compiled before the run: targets[i] is
+// the statement line lines[i] starts at, or -1 when there is no such line.
+struct JumpTable {
+  std::string selector;
+  bool gosub = false;
+  std::vector<int> lines;
+  std::vector<int> targets;
 };
 
+// One statement of the program. A line holding several statements
+// separated by '\' contributes one entry per statement, in order.
+struct ProgramStatement {
+  int line;         // source line number
+  std::string code; // the statement, an implicit LET spelled out
+  int column = 1;   // where it starts in the line's text, from 1
+};
+
+// How a run loop returned (interpreter.h).
+enum RunStatus {
+  RUN_HALTED,  // END, STOP, or past the last statement
+  RUN_YIELDED, // step budget used up; continue to resume
+  RUN_ERROR    // stopped by a runtime error; see PROGRAM_STRUCTURE::error
+};
+
+// The error that ended the last run, with the statement it occurred in.
+struct RunError {
+  int line = 0;   // 0 when raised before the first statement ran
+  int column = 0; // the statement's ProgramStatement::column
+  std::string message;
+};
+
+// One BASIC session: source, variables, matrices, stacks and open files.
+// Every evaluator and statement handler takes the session explicitly, so
+// independent PROGRAM_STRUCTUREs can run side by side (one per thread).
 struct PROGRAM_STRUCTURE {
   std::map<int, std::string> programSource;
+  // programSource split into statements (buildStatementTable); a
+  // statement's index here is its address while the program runs.
+  std::vector<ProgramStatement> statements;
   std::string filename;
   std::string filepath;
   size_t filesize_bytes = 0;
@@ -212,31 +313,67 @@ struct PROGRAM_STRUCTURE {
   size_t nextLineNumber = 0;
   size_t nextLineNumberSet = 0;
   int currentLine = 0;
+  int currentStatement = 0; // index in statements; currentLine is its line
+  // Set by handlers that resume at a given statement rather than at the
+  // start of a line (RETURN, NEXT, loop exits, a false IF)
+  int nextStatement = 0;
+  bool nextStatementSet = false;
   int seedValue = 0;
-
-  std::map<std::string, VarInfo> numericVariables;
-  std::map<std::string, VarInfo> stringVariables;
+  RngEngine rng; // RND and MAT RANDOM; reseeded by SEED
+  bool running = false;
+  bool trace = false; // TRACE ON: echo each line before executing it
+  RunError error;     // set when a run ends with RUN_ERROR
+  // ON ERROR GOTO: the handler's statement (-1 when none) and, while it
+  // runs, the trapped error: ERR, ERL and the statement RESUME retries
+  int errorHandler = -1;
+  bool inErrorHandler = false;
+  double errCode = 0;
+  double errLine = 0;
+  int errorStatement = 0;
+
+  // Variable tables and user functions allocate from the run arena;
+  // resetRunState() drops them and frees it in one go. Lookups accept
+  // std::string_view keys.
+  std::unique_ptr<RunArena> arena = std::make_unique<RunArena>();
+  std::pmr::map<std::string, VarInfo, std::less<>> numericVariables{
+      arena.get()};
+  std::pmr::map<std::string, VarInfo, std::less<>> stringVariables{
+      arena.get()};
+  StringTemps stringTemps; // owned pieces of string expression results
 
   std::map<std::string, MatrixValue> matrices;
   std::map<std::string, MatrixValue> stringMatrices;
 
-  std::vector<int> gosubStack;
-
-  std::vector<std::pair<std::string, int>> loopStack;
-
-  std::map<std::string, UserFunction> userFunctions;
-
-  std::vector<VarInfo> dataValues;
-  size_t dataPointer = 0;
-
-  std::map<int, std::string> printUsingFormats;
-
-  // Added file handles map
-  std::map<int, FileHandle> fileHandles;
-
-  std::vector<ForInfo> forStack;
-  
-  std::vector<int> repeatStack;
+  // GOSUB/FOR frames, and the loop table paired up before each run, by
+  // statement index: FOR/WHILE/REPEAT -> NEXT/WEND/UNTIL, and WEND/UNTIL
+  // -> WHILE/REPEAT; loopReach maps each FOR to the last NEXT that may
+  // close it (one naming its variable, or a bare NEXT). These tables and
+  // the jump tables are rebuilt on every start while variables may carry
+  // over (BasicSession::run), so they stay off the arena, which only gives
+  // memory back on reset.
+  FrameStack frames;
+  std::unordered_map<int, int> loopEnds;
+  std::unordered_map<int, int> loopStarts;
+  std::unordered_map<int, int> loopReach;
+  // Jump tables of the ON statements, by statement index
+  std::unordered_map<int, JumpTable> jumpTables;
+
+  std::pmr::map<std::string, UserFunction, std::less<>> userFunctions{
+      arena.get()};
+
+  DataPool data;          // built from the DATA lines when a run starts
+  size_t dataPointer = 0; // next item READ takes
+
+  // ":=" format lines compiled on first use, keyed by line number
+  std::map<int, CompiledFormat> printUsingFormats;
+
+  // OPEN channels indexed by channel number (sized on first OPEN)
+  std::vector<FileHandle> channels;
+
+  // Console output; embedding hosts set console.hook to capture PRINT.
+  OutputBuffer console{std::string(), &std::cout, nullptr};
+  // When set, INPUT lines come from inputHook instead of std::cin.
+  std::function<bool(std::string &)> inputHook;
 };
 
 struct pair_hash {
@@ -247,12 +384,33 @@ struct pair_hash {
 
 typedef std::unordered_map<std::pair<int, int>, double, pair_hash> SparseMatrix;
 
-extern PROGRAM_STRUCTURE program;
-
-extern double evalExpression(const std::string &expr);
+extern double evalExpression(PROGRAM_STRUCTURE &program,
+                             const std::string &expr);
 
 extern std::string trim(const std::string &s);
 
-extern std::string evalStringExpression(const std::string &expr);
+extern std::string evalStringExpression(PROGRAM_STRUCTURE &program,
+                                        const std::string &expr);
+
+// String expression as a rope of views (see StrValue); valid until the
+// statement ends or the caller's StringTempScope closes.
+extern StrValue evalStringValue(PROGRAM_STRUCTURE &program,
+                                const std::string &expr);
+
+// A DEF FN body with its parameters bound to `args`.
+extern double evalFunctionBody(PROGRAM_STRUCTURE &program,
+                               const UserFunction &fn, const double *args);
+
+// Parse the numeric / string expression starting at expr[pos] and leave
+// pos on the first character after it (e.g. ',' or ')').
+extern double evalExpressionAt(PROGRAM_STRUCTURE &program,
+                               const std::string &expr, size_t &pos);
+extern StrValue evalStringValueAt(PROGRAM_STRUCTURE &program,
+                                  const std::string &expr, size_t &pos);
+// The numeric expression from expr[pos] to the end of `expr`, checked
+// like evalExpression (statements that end in an expression evaluate it
+// in place instead of copying it out).
+extern double evalExpressionFrom(PROGRAM_STRUCTURE &program,
+                                 const std::string &expr, size_t pos);
 
 #endif // PROGRAM_STRUCTURE_H
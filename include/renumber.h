@@ -7,6 +7,7 @@
 // newStart: starting line number for renumbering
 // delta: increment between lines
 // oldStart: only renumber lines >= oldStart
-void handleRENUMBER(int newStart, int delta, int oldStart);
+void handleRENUMBER(PROGRAM_STRUCTURE &program, int newStart, int delta,
+                   int oldStart);
 
 #endif // RENUMBER_H
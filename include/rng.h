@@ -0,0 +1,61 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstddef>
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+// Random numbers: xoshiro256++ (Blackman & Vigna), one engine per session
+//-----------------------------------------------------------------------------
+
+constexpr uint64_t DEFAULT_RNG_SEED = 0;
+
+// Lanes filled side by side by RngEngine::fill; a fixed count keeps bulk
+// results identical whatever SIMD width the build uses.
+constexpr int RNG_LANES = 4;
+
+struct RngEngine {
+  uint64_t s[4];
+
+  RngEngine() { seed(DEFAULT_RNG_SEED); }
+
+  // Reset from a 64-bit seed (expanded with splitmix64), then skip ahead
+  // `stream` long jumps of 2^192 draws, so streams 0, 1, 2, ... of one
+  // seed never overlap: one per parallel run or worker. Each long jump
+  // costs about as much as 256 draws, so this is O(stream).
+  void seed(uint64_t value, uint64_t stream = 0);
+
+  // Advance 2^128 draws (spaces fill's lanes within a stream).
+  void jump();
+
+  // Advance 2^192 draws (spaces the streams).
+  void longJump();
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t next() {
+    uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  // Uniform double in [0, 1) from the top 53 bits.
+  double nextDouble() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+  // n uniform doubles in [0, 1) with 52-bit resolution. Lane k is the
+  // engine jumped k times, all run in lockstep as SIMD vectors; afterwards
+  // the engine is where lane 0 stopped. Every lane so continues its own
+  // sequence from one call to the next, and all stay inside the stream.
+  void fill(double *out, size_t n);
+
+private:
+  void jumpBy(const uint64_t (&poly)[4]);
+};
+
+#endif // RNG_H
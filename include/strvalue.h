@@ -0,0 +1,112 @@
+#ifndef STRVALUE_H
+#define STRVALUE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+
+//-----------------------------------------------------------------------------
+// String expression values
+//-----------------------------------------------------------------------------
+
+constexpr int STR_MAX_PIECES = 8;
+
+// Result of a string expression: a short rope of views into storage that
+// lives at least as long as the statement being executed (the statement
+// text for literals, string variables, StringTemps). LEFT$/MID$/RIGHT$
+// narrow the views and '+' appends pieces; nothing is copied until the
+// value is stored or printed with appendTo().
+struct StrValue {
+  std::string_view pieces[STR_MAX_PIECES];
+  int count = 0;
+  size_t length = 0;
+
+  StrValue() = default;
+  explicit StrValue(std::string_view s) { append(s); }
+
+  // Add a piece; false when the rope is full (the caller flattens).
+  bool append(std::string_view s) {
+    if (s.empty())
+      return true;
+    if (count == STR_MAX_PIECES)
+      return false;
+    pieces[count++] = s;
+    length += s.size();
+    return true;
+  }
+
+  void appendTo(std::string &out) const {
+    out.reserve(out.size() + length);
+    for (int i = 0; i < count; ++i)
+      out.append(pieces[i].data(), pieces[i].size());
+  }
+
+  // <0, 0 or >0 as this sorts before, equal to or after `other` (bytewise).
+  int compare(const StrValue &other) const {
+    int i = 0, j = 0;
+    size_t a = 0, b = 0; // offsets into pieces[i] / other.pieces[j]
+    while (i < count && j < other.count) {
+      size_t n = std::min(pieces[i].size() - a, other.pieces[j].size() - b);
+      int c = std::memcmp(pieces[i].data() + a, other.pieces[j].data() + b, n);
+      if (c != 0)
+        return c;
+      if ((a += n) == pieces[i].size()) {
+        ++i;
+        a = 0;
+      }
+      if ((b += n) == other.pieces[j].size()) {
+        ++j;
+        b = 0;
+      }
+    }
+    return length < other.length ? -1 : length > other.length ? 1 : 0;
+  }
+
+  // Characters [pos, pos + n), sharing this value's storage.
+  StrValue substr(size_t pos, size_t n) const {
+    StrValue r;
+    if (pos >= length)
+      return r;
+    n = std::min(n, length - pos);
+    for (int i = 0; i < count && n > 0; ++i) {
+      if (pos >= pieces[i].size()) {
+        pos -= pieces[i].size();
+        continue;
+      }
+      std::string_view part = pieces[i].substr(pos, n);
+      r.append(part);
+      n -= part.size();
+      pos = 0;
+    }
+    return r;
+  }
+};
+
+// Owned strings for results that view no existing storage (CHR$, STRING$,
+// flattened ropes). Slots keep their capacity between statements, and a
+// deque never moves earlier slots, so views into them stay valid.
+struct StringTemps {
+  std::deque<std::string> slots;
+  size_t used = 0;
+
+  std::string &next() {
+    if (used == slots.size())
+      slots.emplace_back();
+    std::string &s = slots[used++];
+    s.clear();
+    return s;
+  }
+};
+
+// Hands back the temps taken while it was alive.
+struct StringTempScope {
+  StringTemps &temps;
+  size_t mark;
+  explicit StringTempScope(StringTemps &t) : temps(t), mark(t.used) {}
+  ~StringTempScope() { temps.used = mark; }
+};
+
+#endif // STRVALUE_H
@@ -0,0 +1,22 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <cstddef>
+#include <functional>
+
+//-----------------------------------------------------------------------------
+// Shared worker pool for bulk MAT kernels
+//-----------------------------------------------------------------------------
+
+// Run body(begin, end) over consecutive chunks of [0, n), at least
+// minChunk elements each, on the process-wide worker pool. The calling
+// thread works through chunks too and returns once all are done. Small
+// ranges (one chunk) run inline. Bodies must not throw. Safe to call from
+// several sessions at once.
+void parallelFor(size_t n, size_t minChunk,
+                 const std::function<void(size_t, size_t)> &body);
+
+// Threads that share a parallelFor (workers plus the caller).
+size_t parallelWidth();
+
+#endif // THREADPOOL_H
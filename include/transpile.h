@@ -0,0 +1,36 @@
+#ifndef TRANSPILE_H
+#define TRANSPILE_H
+
+#include "program_structure.h"
+#include <ostream>
+
+//-----------------------------------------------------------------------------
+// TRANSPILE: ahead-of-time translation of the loaded program to C++
+//-----------------------------------------------------------------------------
+
+// What transpileProgram produces
+enum TranspileTarget {
+  TRANSPILE_PROGRAM, // standalone program with main(), source embedded
+  TRANSPILE_MODULE   // RUN NATIVE module: state reached through NativeHost
+};
+
+// Write one C++ translation unit for program.programSource to `out`.
+//   - every statement becomes a label (L<line>, then L<line>_2, ... for
+//     the further '\'-separated statements of a line); GOTO/GOSUB/RETURN/
+//     ON and the loop statements become gotos and switch tables
+//   - numeric variables become native doubles (one read before it is ever
+//     assigned is 0), numeric expressions native C++ (those the translator
+//     does not cover go through evalExpression)
+//   - MAT lines call executeMATops directly; other statements (PRINT,
+//     INPUT, string LET, files, DATA/READ, DEF ...) run through the
+//     interpreter's own handlers on the session's source, so output
+//     matches the interpreter exactly
+// A TRANSPILE_PROGRAM result links against the interpreter sources minus
+// basic_runtime_env.cpp; a TRANSPILE_MODULE needs only the C++ standard
+// library (see native.h). Throws "TRANSPILE ERROR: ..." for lines that
+// have no translation (a NEXT without a FOR to pair with, an ON without a
+// target list, ON ERROR).
+void transpileProgram(PROGRAM_STRUCTURE &program, std::ostream &out,
+                      TranspileTarget target = TRANSPILE_PROGRAM);
+
+#endif // TRANSPILE_H
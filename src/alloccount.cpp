@@ -0,0 +1,33 @@
+#include "arena.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Process-wide count of heap allocations, for checking that a steady-state
+// loop allocates nothing. Replacing the global operator new costs an atomic
+// add on every allocation, so it is only compiled in with
+// -DBASIC_COUNT_ALLOCATIONS.
+#ifdef BASIC_COUNT_ALLOCATIONS
+
+static std::atomic<size_t> heapCount{0};
+
+void *operator new(size_t bytes) {
+  heapCount.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(bytes ? bytes : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+size_t heapAllocations() {
+  return heapCount.load(std::memory_order_relaxed);
+}
+
+#else
+
+size_t heapAllocations() { return 0; }
+
+#endif
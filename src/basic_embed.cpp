@@ -0,0 +1,136 @@
+#include "basic_embed.h"
+#include "fileio.h"
+#include "interpreter.h"
+
+// Split "A$" into ("A", true) and "A" into ("A", false)
+static std::pair<std::string, bool> splitName(const std::string &name) {
+  if (!name.empty() && name.back() == '$')
+    return {name.substr(0, name.size() - 1), true};
+  return {name, false};
+}
+
+void BasicSession::load(const std::string &source) {
+  resetRunState(program_);
+  std::istringstream in(source);
+  BASIC_Program_loadStream(program_, in);
+  buildLoopTable(program_);
+  buildJumpTables(program_);
+  buildDataPool(program_);
+  program_.running = false;
+}
+
+void BasicSession::setVar(const std::string &name, double value) {
+  auto n = splitName(name);
+  if (n.second)
+    throw std::runtime_error("setVar: numeric value for string variable " +
+                             name);
+  VarInfo &slot = program_.numericVariables[n.first];
+  slot.numericValue = value;
+  slot.isString = false;
+}
+
+void BasicSession::setVar(const std::string &name, const std::string &value) {
+  auto n = splitName(name);
+  VarInfo &slot = program_.stringVariables[n.first];
+  slot.stringValue = value;
+  slot.isString = true;
+}
+
+double BasicSession::getVar(const std::string &name) const {
+  auto it = program_.numericVariables.find(splitName(name).first);
+  if (it == program_.numericVariables.end())
+    throw std::runtime_error("getVar: unknown variable " + name);
+  return it->second.numericValue;
+}
+
+std::string BasicSession::getString(const std::string &name) const {
+  auto it = program_.stringVariables.find(splitName(name).first);
+  if (it == program_.stringVariables.end())
+    throw std::runtime_error("getString: unknown variable " + name);
+  return it->second.stringValue;
+}
+
+MatrixView BasicSession::dimMatrix(const std::string &name, int rows,
+                                   int cols) {
+  if (rows <= 0 || cols <= 0)
+    throw std::runtime_error("dimMatrix: dimensions must be positive");
+  MatrixValue &mat = program_.matrices[name];
+  mat.isString = false;
+  mat.sparseValues.clear();
+  mat.configureStorage({rows, cols}, true);
+  return MatrixView{mat.data(), rows, cols};
+}
+
+MatrixView BasicSession::getMatrix(const std::string &name) {
+  auto it = program_.matrices.find(name);
+  if (it == program_.matrices.end())
+    throw std::runtime_error("getMatrix: unknown matrix " + name);
+  MatrixValue &mat = it->second;
+  if (mat.dimensions.size() != 2)
+    throw std::runtime_error("getMatrix: " + name + " is not 2D");
+  mat.makeDense();
+  return MatrixView{mat.data(), mat.dimensions[0], mat.dimensions[1]};
+}
+
+BasicRunStatus BasicSession::fail(const std::exception &e) {
+  failRun(program_, e.what());
+  basicFlush(program_);
+  return BASIC_ERROR;
+}
+
+BasicRunStatus BasicSession::run(size_t maxSteps) {
+  if (!program_.running) {
+    try {
+      startInterpreter(program_);
+    } catch (const std::exception &e) {
+      return fail(e);
+    }
+  }
+  program_.error = RunError();
+  switch (continueInterpreter(program_, maxSteps)) {
+  case RUN_YIELDED:
+    return BASIC_YIELDED;
+  case RUN_ERROR:
+    return BASIC_ERROR;
+  default:
+    return BASIC_DONE;
+  }
+}
+
+BasicRunStatus BasicSession::callGosub(int line) {
+  program_.error = RunError();
+  bool wasRunning = program_.running;
+  int savedLine = program_.currentLine;
+  int savedStatement = program_.currentStatement;
+  size_t depth = program_.frames.size();
+
+  try {
+    moveToLine(program_, line);
+    program_.frames.push(
+        {FRAME_GOSUB, savedLine, savedStatement, -1, nullptr, 0, 0});
+    program_.running = true;
+    while (program_.running && program_.frames.size() > depth)
+      stepInterpreter(program_);
+  } catch (const std::exception &e) {
+    program_.frames.truncate(depth);
+    return fail(e);
+  }
+
+  bool ended = !program_.running && program_.frames.size() > depth;
+  program_.frames.truncate(depth);
+  program_.currentLine = savedLine;
+  program_.currentStatement = savedStatement;
+  program_.nextLineNumberSet = false;
+  program_.nextStatementSet = false;
+  program_.running = wasRunning && !ended;
+  basicFlush(program_);
+  return BASIC_DONE;
+}
+
+void BasicSession::onPrint(std::function<void(const std::string &)> hook) {
+  program_.console.hook = std::move(hook);
+}
+
+void BasicSession::onInput(std::function<bool(std::string &)> hook) {
+  program_.inputHook = std::move(hook);
+}
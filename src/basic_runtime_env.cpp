@@ -1,19 +1,32 @@
 #include "fileio.h"
 #include "interpreter.h"
+#include "native.h"
 #include "renumber.h"
 #include "syntax.h"
+#include "transpile.h"
 
 #include "program_structure.h"
 
-extern void handleRENUMBER(int newStart, int delta, int oldStart);
-extern void executeOPEN(const std::string &line);
-extern void runInterpreter(PROGRAM_STRUCTURE &program);
+extern void handleRENUMBER(PROGRAM_STRUCTURE &program, int newStart, int delta,
+                           int oldStart);
+extern void executeOPEN(PROGRAM_STRUCTURE &program, const std::string &line);
 extern void BASIC_Program_load(PROGRAM_STRUCTURE &program);
 
-extern PROGRAM_STRUCTURE program;
-// PROGRAM_STRUCTURE program;
+// "Runtime error: <message> (line L[, column C])"; the column only for a
+// statement that does not start its line
+static void reportError(const RunError &error) {
+  std::cerr << "Runtime error: " << error.message;
+  if (error.line != 0) {
+    std::cerr << " (line " << error.line;
+    if (error.column > 1)
+      std::cerr << ", column " << error.column;
+    std::cerr << ")";
+  }
+  std::cerr << std::endl;
+}
+
 // List lines between start and end
-void list(int start, int end = INT_MAX) {
+void list(PROGRAM_STRUCTURE &program, int start, int end = INT_MAX) {
   for (std::map<int, std::string>::const_iterator it =
            program.programSource.begin();
        it != program.programSource.end(); ++it) {
@@ -24,7 +37,7 @@ void list(int start, int end = INT_MAX) {
   }
 }
 
-void interactiveLoop() {
+void interactiveLoop(PROGRAM_STRUCTURE &program) {
   std::string input;
   while (true) {
     std::cout << "READY. ";
@@ -55,7 +68,7 @@ void interactiveLoop() {
           }
         }
       }
-      handleRENUMBER(newStart, delta, oldStart);
+      handleRENUMBER(program, newStart, delta, oldStart);
     }
 
     else if (command == "SAVE") {
@@ -78,6 +91,7 @@ void interactiveLoop() {
       }
     } else if (command == "NEW") {
       program.programSource.clear();
+      resetRunState(program);
       std::cout << "Memory cleared." << std::endl;
     } else if (command == "LIST") {
       int start = 0, end = INT_MAX;
@@ -89,21 +103,73 @@ void interactiveLoop() {
           end = INT_MAX;
         }
       }
-      list(start, end);
+      list(program, start, end);
     } else if (command == "RUN") {
+      // RUN [NATIVE] [file.bas]
       std::string filename;
+      bool native = false;
       if (iss >> filename) {
+        std::string word = filename;
+        std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+        if (word == "NATIVE") {
+          native = true;
+          filename.clear();
+          iss >> filename;
+        }
+      }
+      if (!filename.empty()) {
         program.programSource.clear();
         program.filename = filename;
         BASIC_Program_load(program);
       }
-      try {
-        runInterpreter(program);
-      } catch (const std::runtime_error &e) {
-        std::cerr << "Runtime error: " << e.what() << std::endl;
+      resetRunState(program);
+      RunStatus status;
+      if (native) {
+        try {
+          status = runNative(program);
+        } catch (const std::runtime_error &e) {
+          // Nothing has run when the module cannot be built
+          std::cerr << e.what() << "; running interpreted" << std::endl;
+          status = runInterpreter(program);
+        }
+      } else {
+        status = runInterpreter(program);
       }
+      if (status == RUN_ERROR)
+        reportError(program.error);
     } else if (command == "SYNTAX") {
       checkSyntax(program.programSource);
+    } else if (command == "TRANSPILE") {
+      // TRANSPILE [file.bas] out.cpp
+      std::string first, second;
+      iss >> first >> second;
+      if (!second.empty()) {
+        program.programSource.clear();
+        program.filename = first;
+        BASIC_Program_load(program);
+        first = second;
+      }
+      if (first.empty()) {
+        std::cerr << "ERROR: TRANSPILE needs an output file" << std::endl;
+        continue;
+      }
+      // Into a string first, so a TRANSPILE ERROR leaves any existing
+      // file as it was
+      std::ostringstream code;
+      resetRunState(program);
+      try {
+        transpileProgram(program, code);
+      } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        continue;
+      }
+      std::ofstream outfile(first);
+      if (!(outfile << code.str())) {
+        std::cerr << "ERROR: Cannot open file for writing: " << first
+                  << std::endl;
+        continue;
+      }
+      std::cout << "Wrote " << first << std::endl;
     } else {
       std::cout << "Unrecognized command: " << command << std::endl;
     }
@@ -111,10 +177,11 @@ void interactiveLoop() {
 }
 
 int main(int argc, char *argv[]) {
+  PROGRAM_STRUCTURE program;
   if (argc > 1) {
     program.filename = argv[1];
     BASIC_Program_load(program);
   }
-  interactiveLoop();
+  interactiveLoop(program);
   return 0;
 }
@@ -0,0 +1,346 @@
+#include "interpreter.h"
+#include "program_structure.h"
+
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <regex>
+#include <stdexcept>
+#include <string>
+
+// Longest numeric field parsed in place; shorter look-ahead forces a refill.
+static const size_t NUMBER_LOOKAHEAD = 64;
+
+FileHandle &openChannel(PROGRAM_STRUCTURE &program, int channel) {
+  if (channel <= 0 || channel >= static_cast<int>(program.channels.size()) ||
+      !program.channels[channel].isOpen())
+    throw std::runtime_error("RUNTIME ERROR: Channel " +
+                             std::to_string(channel) + " not open");
+  return program.channels[channel];
+}
+
+static void closeChannel(FileHandle &fh) {
+  fh.out.flush();
+  fh = FileHandle();
+}
+
+void closeAllChannels(PROGRAM_STRUCTURE &program) {
+  for (FileHandle &fh : program.channels)
+    if (fh.isOpen())
+      closeChannel(fh);
+}
+
+// Make at least `want` unread bytes available, unless the file ends first.
+// The unread tail is moved to the front of the buffer before reading more.
+static size_t fill(FileHandle &fh, size_t want) {
+  while (fh.readEnd - fh.readPos < want && !fh.atEof) {
+    if (fh.readPos > 0) {
+      size_t avail = fh.readEnd - fh.readPos;
+      std::memmove(fh.readBuf.data(), fh.readBuf.data() + fh.readPos, avail);
+      fh.bufferOffset += static_cast<int64_t>(fh.readPos);
+      fh.readPos = 0;
+      fh.readEnd = avail;
+    }
+    size_t n = std::fread(fh.readBuf.data() + fh.readEnd, 1,
+                          fh.readBuf.size() - fh.readEnd, fh.file.get());
+    if (n == 0)
+      fh.atEof = true;
+    fh.readEnd += n;
+  }
+  return fh.readEnd - fh.readPos;
+}
+
+// Skip blanks and line breaks before a field. Returns false at end of file.
+static bool skipToField(FileHandle &fh) {
+  for (;;) {
+    while (fh.readPos < fh.readEnd) {
+      char c = fh.readBuf[fh.readPos];
+      if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+        return true;
+      ++fh.readPos;
+    }
+    if (fill(fh, 1) == 0)
+      return false;
+  }
+}
+
+// Consume blanks and the ',' or line break that ends a field.
+static void endField(FileHandle &fh) {
+  while (fill(fh, 1) > 0) {
+    char c = fh.readBuf[fh.readPos];
+    if (c == ' ' || c == '\t' || c == '\r') {
+      ++fh.readPos;
+      continue;
+    }
+    if (c == ',' || c == '\n')
+      ++fh.readPos;
+    return;
+  }
+}
+
+static FileHandle &inputChannel(PROGRAM_STRUCTURE &program, int channel) {
+  FileHandle &fh = openChannel(program, channel);
+  if (fh.mode != CHANNEL_INPUT)
+    throw std::runtime_error("RUNTIME ERROR: Channel " +
+                             std::to_string(channel) +
+                             " is not open for INPUT");
+  return fh;
+}
+
+bool readNumberField(FileHandle &fh, double &value) {
+  if (!skipToField(fh))
+    return false;
+  fill(fh, NUMBER_LOOKAHEAD);
+  const char *first = fh.readBuf.data() + fh.readPos;
+  const char *last = fh.readBuf.data() + fh.readEnd;
+  if (*first == '+')
+    ++first;
+  auto res = std::from_chars(first, last, value);
+  if (res.ec != std::errc()) {
+    const char *stop = first;
+    while (stop < last && *stop != ',' && *stop != '\n')
+      ++stop;
+    throw std::runtime_error("RUNTIME ERROR: INPUT# expected a number, got '" +
+                             std::string(first, stop) + "'");
+  }
+  fh.readPos = static_cast<size_t>(res.ptr - fh.readBuf.data());
+  endField(fh);
+  return true;
+}
+
+bool readStringField(FileHandle &fh, std::string &value) {
+  value.clear();
+  if (!skipToField(fh))
+    return false;
+  if (fh.readBuf[fh.readPos] == '"') {
+    // Quoted: everything up to the closing quote, commas included
+    ++fh.readPos;
+    while (fill(fh, 1) > 0) {
+      const char *start = fh.readBuf.data() + fh.readPos;
+      const char *quote = static_cast<const char *>(
+          std::memchr(start, '"', fh.readEnd - fh.readPos));
+      if (quote) {
+        value.append(start, quote);
+        fh.readPos += static_cast<size_t>(quote - start) + 1;
+        break;
+      }
+      value.append(start, fh.readEnd - fh.readPos);
+      fh.readPos = fh.readEnd;
+    }
+  } else {
+    while (fill(fh, 1) > 0) {
+      size_t p = fh.readPos;
+      while (p < fh.readEnd && fh.readBuf[p] != ',' && fh.readBuf[p] != '\n')
+        ++p;
+      value.append(fh.readBuf.data() + fh.readPos, p - fh.readPos);
+      fh.readPos = p;
+      if (p < fh.readEnd)
+        break;
+    }
+    size_t keep = value.find_last_not_of(" \t\r");
+    value.erase(keep == std::string::npos ? 0 : keep + 1);
+  }
+  endField(fh);
+  return true;
+}
+
+void readChannelBytes(FileHandle &fh, void *dst, size_t n) {
+  char *out = static_cast<char *>(dst);
+  size_t take = std::min(n, fh.readEnd - fh.readPos);
+  std::memcpy(out, fh.readBuf.data() + fh.readPos, take);
+  fh.readPos += take;
+  out += take;
+  n -= take;
+  if (n == 0)
+    return;
+  if (n < fh.readBuf.size() / 2) {
+    if (fill(fh, n) < n)
+      throw std::runtime_error("RUNTIME ERROR: Unexpected end of file on " +
+                               fh.filename);
+    std::memcpy(out, fh.readBuf.data() + fh.readPos, n);
+    fh.readPos += n;
+    return;
+  }
+  // Large block: straight from the file into dst
+  fh.bufferOffset += static_cast<int64_t>(fh.readEnd);
+  fh.readPos = fh.readEnd = 0;
+  size_t got = std::fread(out, 1, n, fh.file.get());
+  fh.bufferOffset += static_cast<int64_t>(got);
+  if (got < n) {
+    fh.atEof = true;
+    throw std::runtime_error("RUNTIME ERROR: Unexpected end of file on " +
+                             fh.filename);
+  }
+}
+
+void writeChannelBytes(FileHandle &fh, const void *src, size_t n) {
+  fh.out.flush();
+  if (std::fwrite(src, 1, n, fh.file.get()) != n)
+    throw std::runtime_error("RUNTIME ERROR: Write failed on '" +
+                             fh.filename + "'");
+}
+
+int64_t channelTell(const FileHandle &fh) {
+  return fh.bufferOffset + static_cast<int64_t>(fh.readPos);
+}
+
+void channelSkip(FileHandle &fh, int64_t bytes) {
+  if (bytes <= static_cast<int64_t>(fh.readEnd - fh.readPos)) {
+    fh.readPos += static_cast<size_t>(bytes);
+    return;
+  }
+  int64_t target = channelTell(fh) + bytes;
+  if (fseeko(fh.file.get(), static_cast<off_t>(target), SEEK_SET) != 0)
+    throw std::runtime_error("RUNTIME ERROR: Seek failed on " + fh.filename);
+  fh.bufferOffset = target;
+  fh.readPos = fh.readEnd = 0;
+  fh.atEof = false;
+}
+
+bool channelEOF(PROGRAM_STRUCTURE &program, int channel) {
+  return !skipToField(inputChannel(program, channel));
+}
+
+int64_t channelPosition(PROGRAM_STRUCTURE &program, int channel) {
+  FileHandle &fh = openChannel(program, channel);
+  if (fh.mode == CHANNEL_INPUT)
+    return channelTell(fh);
+  return channelLength(program, channel);
+}
+
+int64_t channelLength(PROGRAM_STRUCTURE &program, int channel) {
+  FileHandle &fh = openChannel(program, channel);
+  std::error_code ec;
+  auto size = std::filesystem::file_size(fh.filename, ec);
+  if (ec)
+    throw std::runtime_error("RUNTIME ERROR: Cannot size " + fh.filename);
+  return static_cast<int64_t>(size) +
+         static_cast<int64_t>(fh.out.pending.size());
+}
+
+// Channel number or file name operand of OPEN: #3, 3, "name", name, F$
+static std::string openOperand(PROGRAM_STRUCTURE &program,
+                               const std::string &tok, bool &isChannel) {
+  std::string t = trim(tok);
+  if (!t.empty() && t[0] == '#')
+    t = trim(t.substr(1));
+  isChannel = !t.empty() &&
+              t.find_first_not_of("0123456789") == std::string::npos;
+  if (isChannel)
+    return t;
+  if (t.size() >= 2 && t.front() == '"' && t.back() == '"')
+    return t.substr(1, t.size() - 2);
+  if (!t.empty() && t.back() == '$')
+    return evalStringExpression(program, t);
+  return t;
+}
+
+// OPEN "file" FOR [BINARY] INPUT|OUTPUT|APPEND AS #n
+// The older "OPEN #n FOR ... AS file" order is accepted as well.
+void executeOPEN(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(
+      R"RX(^\s*OPEN\s+(#?\s*"[^"]*"|\S+)\s+FOR\s+(?:(BINARY)\s+)?(INPUT|OUTPUT|APPEND)\s+AS\s+(#?\s*"[^"]*"|\S+)\s*$)RX",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid OPEN: " + line);
+
+  bool firstIsChannel, lastIsChannel;
+  std::string first = openOperand(program, m[1].str(), firstIsChannel);
+  std::string last = openOperand(program, m[4].str(), lastIsChannel);
+  if (firstIsChannel == lastIsChannel)
+    throw std::runtime_error("SYNTAX ERROR: OPEN needs a file and a channel: " +
+                             line);
+  int channel = std::stoi(lastIsChannel ? last : first);
+  const std::string &filename = lastIsChannel ? first : last;
+  if (channel <= 0 || channel >= MAX_CHANNELS)
+    throw std::runtime_error("RUNTIME ERROR: Bad channel number " +
+                             std::to_string(channel));
+
+  if (program.channels.empty())
+    program.channels.resize(MAX_CHANNELS);
+  FileHandle &fh = program.channels[channel];
+  if (fh.isOpen())
+    throw std::runtime_error("RUNTIME ERROR: Channel " +
+                             std::to_string(channel) + " already open");
+
+  char mode = static_cast<char>(std::toupper(m[3].str()[0]));
+  std::FILE *f = std::fopen(filename.c_str(), mode == 'I'   ? "rb"
+                                              : mode == 'O' ? "wb"
+                                                            : "ab");
+  if (!f)
+    throw std::runtime_error("RUNTIME ERROR: Cannot open '" + filename + "'");
+  std::setvbuf(f, nullptr, _IONBF, 0); // our buffers replace stdio's
+
+  fh.file.reset(f);
+  fh.filename = filename;
+  fh.binary = m[2].matched;
+  if (mode == 'I') {
+    fh.mode = CHANNEL_INPUT;
+    fh.readBuf.resize(CHANNEL_BUFFER_SIZE);
+  } else {
+    fh.mode = CHANNEL_OUTPUT;
+    fh.out.capacity = CHANNEL_BUFFER_SIZE;
+    fh.out.hook = [f, filename](const std::string &text) {
+      if (std::fwrite(text.data(), 1, text.size(), f) != text.size())
+        throw std::runtime_error("RUNTIME ERROR: Write failed on '" +
+                                 filename + "'");
+    };
+  }
+}
+
+// CLOSE [#n {, #n}]  -- without channels, closes every open channel
+void executeCLOSE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(
+      R"(^\s*CLOSE\s*((?:#?\s*\d+\s*)(?:,\s*#?\s*\d+\s*)*)?$)",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid CLOSE: " + line);
+  if (!m[1].matched) {
+    closeAllChannels(program);
+    return;
+  }
+  std::string list = m[1].str();
+  for (size_t pos = 0; (pos = list.find_first_of("0123456789", pos)) !=
+                       std::string::npos;) {
+    size_t end = list.find_first_not_of("0123456789", pos);
+    closeChannel(openChannel(program, std::stoi(list.substr(pos, end - pos))));
+    pos = end;
+  }
+}
+
+// INPUT #n, var {, var}
+// Fields are separated by commas or line breaks; strings may be quoted.
+void executeINPUTFILE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(
+      R"(^\s*INPUT\s*#\s*(\d+)\s*[,;]\s*([A-Z][A-Z0-9_]{0,31}\$?(?:\s*,\s*[A-Z][A-Z0-9_]{0,31}\$?)*)\s*$)",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid INPUT#: " + line);
+
+  FileHandle &fh = inputChannel(program, std::stoi(m[1].str()));
+  const std::string list = m[2].str();
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t comma = list.find(',', pos);
+    std::string name = trim(list.substr(pos, comma - pos));
+    pos = comma == std::string::npos ? list.size() : comma + 1;
+
+    bool ok;
+    if (name.back() == '$') {
+      name.pop_back();
+      VarInfo &slot = program.stringVariables[name];
+      ok = readStringField(fh, slot.stringValue);
+      slot.isString = true;
+    } else {
+      VarInfo &slot = program.numericVariables[name];
+      ok = readNumberField(fh, slot.numericValue);
+      slot.isString = false;
+    }
+    if (!ok)
+      throw std::runtime_error("RUNTIME ERROR: INPUT# past end of file on " +
+                               fh.filename);
+  }
+}
@@ -0,0 +1,157 @@
+#include "interpreter.h"
+#include "program_structure.h"
+
+#include <charconv>
+#include <cstring>
+#include <regex>
+#include <stdexcept>
+#include <string>
+
+// Item text of a DATA statement, or nullptr when `code` is not DATA.
+static const char *dataList(const std::string &code) {
+  size_t pos = code.find_first_not_of(" \t");
+  if (pos == std::string::npos || code.size() - pos < 4)
+    return nullptr;
+  for (size_t i = 0; i < 4; ++i)
+    if (std::toupper(static_cast<unsigned char>(code[pos + i])) != "DATA"[i])
+      return nullptr;
+  pos += 4;
+  if (pos < code.size() && std::isalnum(static_cast<unsigned char>(code[pos])))
+    return nullptr;
+  return code.c_str() + pos;
+}
+
+static void addString(DataPool &pool, const char *first, const char *last) {
+  pool.arena.append(first, last);
+  pool.stringOffsets.push_back(static_cast<uint32_t>(pool.arena.size()));
+  pool.numbers.push_back(0.0);
+  pool.stringsBefore.push_back(pool.stringsBefore.back() + 1);
+}
+
+static void addNumber(DataPool &pool, double value) {
+  pool.numbers.push_back(value);
+  pool.stringsBefore.push_back(pool.stringsBefore.back());
+}
+
+// Parse one DATA list: comma separated numbers, "quoted strings" (commas
+// allowed inside) and bare words, which are kept as strings.
+static void parseDataList(DataPool &pool, const char *p) {
+  for (;;) {
+    while (*p == ' ' || *p == '\t')
+      ++p;
+    if (*p == '\0')
+      return;
+    const char *end;
+    if (*p == '"') {
+      const char *close = std::strchr(p + 1, '"');
+      if (!close)
+        throw std::runtime_error("SYNTAX ERROR: Unterminated string in DATA");
+      addString(pool, p + 1, close);
+      end = close + 1;
+      while (*end == ' ' || *end == '\t')
+        ++end;
+    } else {
+      end = p;
+      while (*end != ',' && *end != '\0')
+        ++end;
+      const char *last = end;
+      while (last > p && (last[-1] == ' ' || last[-1] == '\t'))
+        --last;
+      double value;
+      auto res = std::from_chars(*p == '+' ? p + 1 : p, last, value);
+      if (res.ec == std::errc() && res.ptr == last)
+        addNumber(pool, value);
+      else
+        addString(pool, p, last);
+    }
+    if (*end == '\0')
+      return;
+    if (*end != ',')
+      throw std::runtime_error("SYNTAX ERROR: Expected ',' in DATA");
+    p = end + 1;
+  }
+}
+
+void buildDataPool(PROGRAM_STRUCTURE &program) {
+  DataPool pool;
+  pool.stringsBefore.push_back(0);
+  pool.stringOffsets.push_back(0);
+  pool.lineStart.reserve(program.programSource.size());
+  for (const ProgramStatement &s : program.statements) {
+    // RESTORE n starts at the first statement of line n
+    pool.lineStart.emplace(s.line, pool.size());
+    if (const char *list = dataList(s.code))
+      parseDataList(pool, list);
+  }
+  program.data = std::move(pool);
+  program.dataPointer = 0;
+}
+
+static void needData(PROGRAM_STRUCTURE &program, size_t n) {
+  if (program.data.size() - program.dataPointer < n)
+    throw std::runtime_error("RUNTIME ERROR: Out of DATA");
+}
+
+void readDataNumbers(PROGRAM_STRUCTURE &program, double *dst, size_t n) {
+  needData(program, n);
+  const DataPool &pool = program.data;
+  if (!pool.allNumeric(program.dataPointer, n))
+    throw std::runtime_error("RUNTIME ERROR: READ of string DATA into a "
+                             "numeric variable");
+  std::memcpy(dst, pool.numbers.data() + program.dataPointer,
+              n * sizeof(double));
+  program.dataPointer += n;
+}
+
+// DATA is collected before the run starts; executing it does nothing.
+void executeDATA(PROGRAM_STRUCTURE & /*program*/, const std::string & /*line*/) {
+}
+
+// READ var {, var}
+void executeREAD(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(
+      R"(^\s*READ\s+([A-Z][A-Z0-9_]{0,31}\$?(?:\s*,\s*[A-Z][A-Z0-9_]{0,31}\$?)*)\s*$)",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid READ: " + line);
+
+  const std::string list = m[1].str();
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t comma = list.find(',', pos);
+    std::string name = trim(list.substr(pos, comma - pos));
+    pos = comma == std::string::npos ? list.size() : comma + 1;
+
+    if (name.back() == '$') {
+      needData(program, 1);
+      size_t item = program.dataPointer++;
+      name.pop_back();
+      VarInfo &slot = program.stringVariables[name];
+      slot.stringValue = program.data.isString(item)
+                             ? program.data.text(item)
+                             : formatNumber(program.data.numbers[item]);
+      slot.isString = true;
+    } else {
+      VarInfo &slot = program.numericVariables[name];
+      readDataNumbers(program, &slot.numericValue, 1);
+      slot.isString = false;
+    }
+  }
+}
+
+// RESTORE [line]  -- next READ takes the first item at or after `line`
+void executeRESTORE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*RESTORE\s*(\d*)\s*$)", std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid RESTORE: " + line);
+  if (m[1].length() == 0) {
+    program.dataPointer = 0;
+    return;
+  }
+  auto it = program.data.lineStart.find(std::stoi(m[1].str()));
+  if (it == program.data.lineStart.end())
+    throw std::runtime_error("RUNTIME ERROR: Undefined line " + m[1].str());
+  program.dataPointer = it->second;
+}
@@ -0,0 +1,502 @@
+#include "dispatch.h"
+#include "exprvm.h"
+#include "interpreter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__)
+#define BASIC_THREADED_DISPATCH 1 // labels as values
+#endif
+
+namespace {
+
+// What a decoded statement runs. The order matches the label table in
+// runDecoded.
+enum LineOp : unsigned char {
+  OP_STATEMENT,    // executeStatement on the source text
+  OP_GOTO,         // GOTO n
+  OP_GOSUB,        // GOSUB n
+  OP_RETURN,       // RETURN
+  OP_NEXT,         // NEXT [v, ...]
+  OP_LET_ADD,      // LET x = x +/- c
+  OP_LET_ADD_NEXT, // LET x = x +/- c, then the NEXT on the following line
+  OP_IF_JUMP,      // IF a op b THEN n
+  OP_LET_EXPR,     // LET x = <numeric expression>
+  OP_IF_EXPR,      // IF <numeric expression> THEN n
+  OP_ON            // ON <numeric expression> GOTO|GOSUB n1, n2, ...
+};
+
+enum Relation : unsigned char { REL_EQ, REL_NE, REL_LT, REL_GT, REL_LE, REL_GE };
+
+// A number, or a variable whose slot is found on first use (slots keep
+// their address for the rest of the run).
+struct Operand {
+  std::string name; // empty for a number
+  double value = 0;
+  VarInfo *slot = nullptr;
+};
+
+struct DecodedLine {
+  int line = 0;
+  int statement = 0;  // index in program.statements
+  size_t lineEnd = 0; // index of the first statement of the next line
+  LineOp op = OP_STATEMENT;
+  StatementType kind = ST_UNKNOWN;
+  const std::string *code = nullptr;
+  size_t target = 0;  // GOTO/GOSUB/IF: first statement of the target line
+  Operand a, b;       // LET: x and c; IF: the two sides
+  Relation rel = REL_EQ;
+  bool subtract = false;
+  std::vector<std::string> names; // NEXT
+  std::string text;               // LET/IF_EXPR/ON: the expression
+  ExprCode expr;                  // and its code, once compiled
+  bool compiled = false;
+  const JumpTable *table = nullptr; // ON
+};
+
+const char *const NUMBER = R"((?:\d+(?:\.\d*)?|\.\d+)(?:[eE][+-]?\d+)?)";
+const char *const NAME = R"([A-Z][A-Z0-9_]{0,31})";
+
+Operand operand(const std::string &text) {
+  Operand o;
+  if (std::isalpha(static_cast<unsigned char>(text[0])))
+    o.name = text;
+  else
+    std::from_chars(text.data(), text.data() + text.size(), o.value);
+  return o;
+}
+
+// Keywords the expression parser reads as operators, not variables
+bool isOperatorWord(const std::string &name) {
+  std::string up = name;
+  for (char &c : up)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  return up == "AND" || up == "OR" || up == "NOT";
+}
+
+// Index of the first statement of `line` in the statements' line numbers,
+// or lines.size()
+size_t indexOf(const std::vector<int> &lines, int line) {
+  auto it = std::lower_bound(lines.begin(), lines.end(), line);
+  return it != lines.end() && *it == line ? it - lines.begin() : lines.size();
+}
+
+// Point `d` at a GOTO/GOSUB/IF target; false when the line does not exist
+// (the generic handler then reports it when the line runs).
+bool setTarget(DecodedLine &d, const std::vector<int> &lines,
+               const std::string &text) {
+  d.target = indexOf(lines, std::atoi(text.c_str()));
+  return d.target != lines.size();
+}
+
+void decodeLine(PROGRAM_STRUCTURE &program, DecodedLine &d,
+                const std::vector<int> &lines) {
+  static const std::regex gotoRe(R"(^\s*GO\s*TO\s+(\d+)\s*$)",
+                                 std::regex::icase);
+  static const std::regex gosubRe(R"(^\s*GOSUB\s+(\d+)\s*$)",
+                                  std::regex::icase);
+  static const std::regex nextRe(
+      R"(^\s*NEXT\s*((?:[A-Z][A-Z0-9_]{0,31})(?:\s*,\s*[A-Z][A-Z0-9_]{0,31})*)?\s*$)",
+      std::regex::icase);
+  static const std::regex letAddRe(std::string(R"(^\s*LET\s+()") + NAME +
+                                       R"()\s*=\s*()" + NAME +
+                                       R"()\s*([+-])\s*()" + NUMBER +
+                                       R"()\s*$)",
+                                   std::regex::icase);
+  // As executeLET and executeIF split their lines
+  static const std::regex letRe(
+      R"(^\s*LET\s+([A-Z][A-Z0-9_]{0,31}\$?)\s*=\s*(.+)$)", std::regex::icase);
+  static const std::regex ifThenRe(R"(^\s*IF\s+(.+?)\s+THEN\s+(.+)$)",
+                                   std::regex::icase);
+  static const std::regex ifRe(
+      std::string(R"(^\s*IF\s+()") + NAME + "|" + NUMBER +
+          R"()\s*(<>|<=|>=|<|>|=)\s*()" + NAME + "|" + NUMBER +
+          R"()\s+THEN\s+(\d+)$)",
+      std::regex::icase);
+
+  const std::string &code = *d.code;
+  std::smatch m;
+  switch (d.kind) {
+  case ST_GOTO:
+    if (std::regex_match(code, m, gotoRe) && setTarget(d, lines, m[1]))
+      d.op = OP_GOTO;
+    break;
+  case ST_GOSUB:
+    if (std::regex_match(code, m, gosubRe) && setTarget(d, lines, m[1]))
+      d.op = OP_GOSUB;
+    break;
+  case ST_RETURN:
+    d.op = OP_RETURN;
+    break;
+  case ST_NEXT:
+    if (std::regex_match(code, m, nextRe)) {
+      std::stringstream ss(m[1].str());
+      std::string tok;
+      while (std::getline(ss, tok, ','))
+        d.names.push_back(trim(tok));
+      if (d.names.empty())
+        d.names.push_back("");
+      d.op = OP_NEXT;
+    }
+    break;
+  case ST_LET:
+    if (std::regex_match(code, m, letAddRe) && m[1] == m[2] &&
+        !isOperatorWord(m[1])) {
+      d.a = operand(m[1]);
+      d.b = operand(m[4]);
+      d.subtract = m[3] == "-";
+      d.op = OP_LET_ADD;
+    } else if (std::regex_match(code, m, letRe) &&
+               m[1].str().back() != '$') {
+      d.a = operand(m[1]);
+      d.text = m[2];
+      d.op = OP_LET_EXPR;
+    }
+    break;
+  case ST_IF:
+    if (std::regex_match(code, m, ifRe) && !isOperatorWord(m[1]) &&
+        !isOperatorWord(m[3]) && setTarget(d, lines, m[4])) {
+      static const char *const RELATIONS[] = {"=", "<>", "<", ">", "<=", ">="};
+      d.a = operand(m[1]);
+      d.b = operand(m[3]);
+      d.rel = static_cast<Relation>(
+          std::find(std::begin(RELATIONS), std::end(RELATIONS), m[2].str()) -
+          std::begin(RELATIONS));
+      d.op = OP_IF_JUMP;
+    } else if (std::regex_match(code, m, ifThenRe) &&
+               std::all_of(m[2].first, m[2].second,
+                           [](unsigned char c) { return std::isdigit(c); }) &&
+               setTarget(d, lines, m[2])) {
+      d.text = m[1];
+      d.op = OP_IF_EXPR;
+    }
+    break;
+  case ST_ON: {
+    auto table = program.jumpTables.find(d.statement);
+    if (table != program.jumpTables.end()) {
+      d.table = &table->second;
+      d.text = d.table->selector;
+      d.op = OP_ON;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+std::vector<DecodedLine> decode(PROGRAM_STRUCTURE &program,
+                                std::vector<int> &lines) {
+  const std::vector<ProgramStatement> &st = program.statements;
+  lines.clear();
+  for (const ProgramStatement &s : st)
+    lines.push_back(s.line);
+  std::vector<DecodedLine> code(st.size());
+  size_t i;
+  for (i = 0; i < st.size(); ++i) {
+    DecodedLine &d = code[i];
+    d.line = st[i].line;
+    d.statement = static_cast<int>(i);
+    d.lineEnd = std::upper_bound(lines.begin(), lines.end(), d.line) -
+                lines.begin();
+    d.code = &st[i].code;
+    d.kind = classifyStatement(st[i].code);
+    decodeLine(program, d, lines);
+  }
+  for (i = 0; i + 1 < code.size(); ++i)
+    if (code[i].op == OP_LET_ADD && code[i + 1].op == OP_NEXT)
+      code[i].op = OP_LET_ADD_NEXT;
+  return code;
+}
+
+// The operand's value; false when the variable is not (yet) numeric.
+inline bool load(PROGRAM_STRUCTURE &program, Operand &o, double &v) {
+  if (o.name.empty()) {
+    v = o.value;
+    return true;
+  }
+  if (!o.slot) {
+    auto it = program.numericVariables.find(o.name);
+    if (it == program.numericVariables.end())
+      return false;
+    o.slot = &it->second;
+  }
+  v = o.slot->numericValue;
+  return true;
+}
+
+inline bool holds(Relation rel, double x, double y) {
+  switch (rel) {
+  case REL_EQ:
+    return x == y;
+  case REL_NE:
+    return x != y;
+  case REL_LT:
+    return x < y;
+  case REL_GT:
+    return x > y;
+  case REL_LE:
+    return x <= y;
+  default:
+    return x >= y;
+  }
+}
+
+// Compile a LET/IF_EXPR/ON line's expression on its first run. False runs
+// the line through its handler instead: this time while a variable it
+// needs is still undefined, for good once the expression turns out to be
+// one the compiler leaves to evalExpression.
+bool compileLine(PROGRAM_STRUCTURE &program, DecodedLine &d) {
+  double *into = nullptr;
+  if (d.op == OP_LET_EXPR) {
+    auto it = program.numericVariables.find(d.a.name);
+    if (it == program.numericVariables.end())
+      return false;
+    into = &it->second.numericValue;
+  }
+  ExprCompileStatus status = compileExpression(program, d.text, d.expr, into);
+  if (status == EXPR_UNSUPPORTED)
+    d.op = OP_STATEMENT;
+  d.compiled = status == EXPR_COMPILED;
+  return d.compiled;
+}
+
+inline void enter(PROGRAM_STRUCTURE &program, const DecodedLine &d) {
+  program.currentLine = d.line;
+  program.currentStatement = d.statement;
+}
+
+// Index of the statement a jump scheduled by a handler goes to, or
+// lines.size() when its line does not exist
+size_t scheduledIndex(PROGRAM_STRUCTURE &program,
+                      const std::vector<int> &lines) {
+  if (program.nextStatementSet) {
+    program.nextStatementSet = false;
+    return program.nextStatement;
+  }
+  program.nextLineNumberSet = false;
+  return indexOf(lines, static_cast<int>(program.nextLineNumber));
+}
+
+std::string undefinedLine(size_t line) {
+  return "RUNTIME ERROR: Undefined line " + std::to_string(line);
+}
+
+// Run the decoded ops from program.currentStatement. Errors raised by
+// handlers are thrown; the dispatcher's own go to the ON ERROR handler
+// here or end the run.
+RunStatus runOps(PROGRAM_STRUCTURE &program, std::vector<DecodedLine> &code,
+                 const std::vector<int> &lines) {
+  size_t pc = program.currentStatement;
+  if (pc >= code.size())
+    return failRun(program, undefinedLine(program.currentLine));
+  DecodedLine *d;
+  double x, y;
+
+  // An error of the dispatcher itself: on to the handler, or stop with it.
+#define RAISE(message)                                                         \
+  do {                                                                         \
+    std::string raised = (message);                                            \
+    if (!trapError(program, raised))                                           \
+      return failRun(program, raised);                                         \
+    pc = program.currentStatement;                                             \
+    DISPATCH();                                                                \
+  } while (0)
+
+  // After a handler: follow its jump, stop, or go on to the next statement.
+#define ADVANCE()                                                              \
+  do {                                                                         \
+    if (!program.running)                                                      \
+      return RUN_HALTED;                                                       \
+    if (program.nextStatementSet || program.nextLineNumberSet) {               \
+      pc = scheduledIndex(program, lines);                                     \
+      if (pc == code.size())                                                   \
+        RAISE(undefinedLine(program.nextLineNumber));                          \
+      DISPATCH();                                                              \
+    }                                                                          \
+    FALL_THROUGH();                                                            \
+  } while (0)
+#define FALL_THROUGH()                                                         \
+  do {                                                                         \
+    if (++pc == code.size()) {                                                 \
+      program.running = false;                                                 \
+      return RUN_HALTED;                                                       \
+    }                                                                          \
+    DISPATCH();                                                                \
+  } while (0)
+
+#ifdef BASIC_THREADED_DISPATCH
+  static void *const ops[] = {&&L_OP_STATEMENT, &&L_OP_GOTO,
+                              &&L_OP_GOSUB,     &&L_OP_RETURN,
+                              &&L_OP_NEXT,      &&L_OP_LET_ADD,
+                              &&L_OP_LET_ADD_NEXT, &&L_OP_IF_JUMP,
+                              &&L_OP_LET_EXPR,  &&L_OP_IF_EXPR,
+                              &&L_OP_ON};
+#define OP(name) L_##name
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    d = &code[pc];                                                             \
+    goto *ops[d->op];                                                          \
+  } while (0)
+  DISPATCH();
+#else
+#define OP(name) case name
+#define DISPATCH() goto dispatch
+dispatch:
+  d = &code[pc];
+  switch (d->op) {
+#endif
+
+  OP(OP_STATEMENT):
+  generic:
+    enter(program, *d);
+    if (program.trace)
+      basicWrite(program,
+                 "[" + std::to_string(d->line) + "] " + *d->code + "\n");
+    executeStatement(program, d->kind, *d->code);
+    ADVANCE();
+
+  OP(OP_GOTO):
+    if (program.trace)
+      goto generic;
+    enter(program, *d);
+    unwindLoops(program, static_cast<int>(d->target));
+    pc = d->target;
+    DISPATCH();
+
+  OP(OP_GOSUB):
+    if (program.trace)
+      goto generic;
+    enter(program, *d);
+    program.frames.push(
+        {FRAME_GOSUB, d->line, d->statement, -1, nullptr, 0, 0});
+    pc = d->target;
+    DISPATCH();
+
+  OP(OP_RETURN): {
+    if (program.trace)
+      goto generic;
+    enter(program, *d);
+    FrameStack &frames = program.frames;
+    while (!frames.empty() && frames.top().kind != FRAME_GOSUB)
+      frames.pop();
+    if (frames.empty())
+      RAISE("RUNTIME ERROR: RETURN without GOSUB");
+    pc = frames.top().statement + 1;
+    frames.pop();
+    if (pc == code.size()) {
+      program.running = false;
+      return RUN_HALTED;
+    }
+    DISPATCH();
+  }
+
+  OP(OP_NEXT):
+    if (program.trace)
+      goto generic;
+    enter(program, *d);
+    stepNEXT(program, d->names);
+    ADVANCE();
+
+  OP(OP_LET_ADD):
+    if (program.trace || !load(program, d->a, x))
+      goto generic;
+    enter(program, *d);
+    d->a.slot->numericValue = d->subtract ? x - d->b.value : x + d->b.value;
+    FALL_THROUGH();
+
+  OP(OP_LET_ADD_NEXT):
+    if (program.trace || !load(program, d->a, x))
+      goto generic;
+    d->a.slot->numericValue = d->subtract ? x - d->b.value : x + d->b.value;
+    d = &code[++pc];
+    enter(program, *d);
+    stepNEXT(program, d->names);
+    ADVANCE();
+
+  OP(OP_IF_JUMP):
+    if (program.trace || !load(program, d->a, x) || !load(program, d->b, y))
+      goto generic;
+    enter(program, *d);
+    if (holds(d->rel, x, y)) {
+      unwindLoops(program, static_cast<int>(d->target));
+      pc = d->target;
+      DISPATCH();
+    }
+    pc = d->lineEnd - 1; // a false IF skips the rest of its line
+    FALL_THROUGH();
+
+  OP(OP_LET_EXPR):
+    if (program.trace || (!d->compiled && !compileLine(program, *d)))
+      goto generic;
+    enter(program, *d);
+    runExpression(program, d->expr);
+    FALL_THROUGH();
+
+  OP(OP_IF_EXPR):
+    if (program.trace || (!d->compiled && !compileLine(program, *d)))
+      goto generic;
+    enter(program, *d);
+    if (runExpression(program, d->expr) != 0.0) {
+      unwindLoops(program, static_cast<int>(d->target));
+      pc = d->target;
+      DISPATCH();
+    }
+    pc = d->lineEnd - 1;
+    FALL_THROUGH();
+
+  OP(OP_ON): {
+    if (program.trace || (!d->compiled && !compileLine(program, *d)))
+      goto generic;
+    enter(program, *d);
+    const JumpTable &table = *d->table;
+    size_t n = table.targets.size();
+    size_t i = jumpIndex(runExpression(program, d->expr), n);
+    if (i == n)
+      FALL_THROUGH();
+    if (table.targets[i] < 0)
+      RAISE(undefinedLine(table.lines[i]));
+    if (table.gosub)
+      program.frames.push(
+          {FRAME_GOSUB, d->line, d->statement, -1, nullptr, 0, 0});
+    else
+      unwindLoops(program, table.targets[i]);
+    pc = table.targets[i];
+    DISPATCH();
+  }
+
+#ifndef BASIC_THREADED_DISPATCH
+  }
+#endif
+#undef OP
+#undef DISPATCH
+#undef FALL_THROUGH
+#undef ADVANCE
+#undef RAISE
+}
+
+} // namespace
+
+RunStatus runDecoded(PROGRAM_STRUCTURE &program) {
+  if (!program.running)
+    return RUN_HALTED;
+  std::vector<int> lines;
+  std::vector<DecodedLine> code = decode(program, lines);
+  for (;;) {
+    try {
+      return runOps(program, code, lines);
+    } catch (const std::runtime_error &e) {
+      // ON ERROR GOTO: straight back in at the handler's op. Only the
+      // interpreter's runtime errors; bad_alloc, logic_error, ... end the run
+      // without it.
+      if (!trapError(program, e.what()))
+        throw;
+    }
+  }
+}
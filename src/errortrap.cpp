@@ -0,0 +1,105 @@
+#include "interpreter.h"
+#include "program_structure.h"
+
+#include <cctype>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// ERR codes, after the classic Microsoft BASIC numbers; anything not
+// listed is 5 (illegal function call).
+static const struct {
+  const char *text;
+  int code;
+} ERROR_CODES[] = {
+    {"NEXT without FOR", 1},      {"SYNTAX ERROR", 2},
+    {"RETURN without GOSUB", 3},  {"Out of DATA", 4},
+    {"Stack overflow", 7},        {"Undefined line", 8},
+    {"Division by zero", 11},     {"Type mismatch", 13},
+    {"RESUME without error", 20}, {"Bad channel number", 52},
+    {"Cannot open", 53},          {"past end", 62},
+};
+
+static int errorCode(const std::string &message) {
+  for (const auto &e : ERROR_CODES)
+    if (message.find(e.text) != std::string::npos)
+      return e.code;
+  return 5;
+}
+
+// ON ERROR GOTO <line>; line 0 turns trapping off.
+void executeONERROR(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*ON\s+ERROR\s+GO\s*TO\s+(\d+)\s*$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid ON ERROR: " + line);
+  int target = std::stoi(m[1]);
+  if (target == 0) {
+    program.errorHandler = -1;
+    return;
+  }
+  int handler = statementIndex(program, target);
+  if (handler < 0)
+    throw std::runtime_error("RUNTIME ERROR: Undefined line " + m[1].str());
+  program.errorHandler = handler;
+}
+
+// RESUME retries the statement that failed, RESUME NEXT continues after
+// it and RESUME <line> continues at that line.
+void executeRESUME(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*RESUME(?:\s+(NEXT|\d+))?\s*$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid RESUME: " + line);
+  if (!program.inErrorHandler)
+    throw std::runtime_error("RUNTIME ERROR: RESUME without error");
+
+  std::string where = m[1].str();
+  int target = program.errorStatement;
+  if (!where.empty() && std::isalpha(static_cast<unsigned char>(where[0]))) {
+    program.inErrorHandler = false;
+    jumpAfter(program, target); // NEXT
+    return;
+  }
+  if (!where.empty() && std::stoi(where) != 0) {
+    target = statementIndex(program, std::stoi(where));
+    if (target < 0)
+      throw std::runtime_error("RUNTIME ERROR: Undefined line " + where);
+    unwindLoops(program, target);
+  }
+  program.inErrorHandler = false;
+  program.nextStatement = target;
+  program.nextStatementSet = true;
+}
+
+bool trapError(PROGRAM_STRUCTURE &program, const std::string &message) {
+  if (program.errorHandler < 0 || program.inErrorHandler)
+    return false;
+  program.errCode = errorCode(message);
+  program.errLine = program.currentLine;
+  program.errorStatement = program.currentStatement;
+  program.inErrorHandler = true;
+  program.nextStatementSet = false;
+  program.nextLineNumberSet = false;
+  program.running = true;
+  program.currentStatement = program.errorHandler;
+  program.currentLine = program.statements[program.errorHandler].line;
+  return true;
+}
+
+const double *errorVariable(const PROGRAM_STRUCTURE &program,
+                            std::string_view name) {
+  if (name.size() != 3)
+    return nullptr;
+  std::string up;
+  for (char c : name)
+    up += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  if (up == "ERR")
+    return &program.errCode;
+  if (up == "ERL")
+    return &program.errLine;
+  return nullptr;
+}
@@ -1,27 +1,274 @@
+#include "exprvm.h"
+#include "interpreter.h"
+#include "matrixops.h"
 #include "program_structure.h"
 #include <cctype>
+#include <charconv>
 #include <cmath>
 #include <cstdlib>
-#include <functional>
+#include <cstring>
 #include <stdexcept>
 #include <string>
-#include <vector>
-extern PROGRAM_STRUCTURE program;
+#include <string_view>
 
-// Evaluates a BASIC expression and returns its value as double.
-// Supports variables, numeric literals (with optional exponent), parentheses,
-// +, -, *, /, and built-in math functions.
-double evalExpression(const std::string &expr) {
+// Built-in numeric functions and how many arguments each takes (at most
+// MAX_FUNCTION_ARGS); RND's one argument may be left out and is ignored.
+enum Function {
+  FN_SIN,
+  FN_COS,
+  FN_TAN,
+  FN_ATN,
+  FN_ASN,
+  FN_ACS,
+  FN_COT,
+  FN_SEC,
+  FN_CSC,
+  FN_SQR,
+  FN_ABS,
+  FN_SGN,
+  FN_EXP,
+  FN_LOG10,
+  FN_LOGX,
+  FN_CLOG,
+  FN_INT,
+  FN_ROUND,
+  FN_FLOOR,
+  FN_CEIL,
+  FN_POW,
+  FN_RND,
+  FN_DEG2RAD,
+  FN_RAD2DEG,
+  FN_EOF,
+  FN_LOC,
+  FN_LOF
+};
+
+static const struct {
+  const char *name;
+  Function fn;
+  int minArgs, maxArgs;
+} FUNCTIONS[] = {
+    {"SIN", FN_SIN, 1, 1},         {"COS", FN_COS, 1, 1},
+    {"TAN", FN_TAN, 1, 1},         {"ATN", FN_ATN, 1, 1},
+    {"ASN", FN_ASN, 1, 1},         {"ACS", FN_ACS, 1, 1},
+    {"COT", FN_COT, 1, 1},         {"SEC", FN_SEC, 1, 1},
+    {"CSC", FN_CSC, 1, 1},         {"SQR", FN_SQR, 1, 1},
+    {"ABS", FN_ABS, 1, 1},         {"SGN", FN_SGN, 1, 1},
+    {"EXP", FN_EXP, 1, 1},         {"LOG10", FN_LOG10, 1, 1},
+    {"LOGX", FN_LOGX, 2, 2},       {"CLOG", FN_CLOG, 1, 1},
+    {"INT", FN_INT, 1, 1},         {"ROUND", FN_ROUND, 1, 1},
+    {"FLOOR", FN_FLOOR, 1, 1},     {"CEIL", FN_CEIL, 1, 1},
+    {"POW", FN_POW, 2, 2},         {"RND", FN_RND, 0, 1},
+    {"DEG2RAD", FN_DEG2RAD, 1, 1}, {"RAD2DEG", FN_RAD2DEG, 1, 1},
+    {"EOF", FN_EOF, 1, 1},         {"LOC", FN_LOC, 1, 1},
+    {"LOF", FN_LOF, 1, 1},
+};
+
+// Recursive-descent parser over one expression. Plain member functions and
+// fixed-size argument lists keep evaluation free of heap allocations.
+// Inside a DEF FN body `scope` is the function and `locals` its arguments.
+struct ExprParser {
+  PROGRAM_STRUCTURE &program;
+  const std::string &expr;
   size_t pos = 0;
-  auto skipWS = [&]() {
+  const UserFunction *scope = nullptr;
+  const double *locals = nullptr;
+
+  void skipWS() {
     while (pos < expr.size() && std::isspace(expr[pos]))
       ++pos;
-  };
+  }
 
-  std::function<double()> parseExpr, parseTerm, parseFactor, parsePrimary;
+  // Case-insensitive keyword at pos, not followed by an identifier char
+  bool keyword(const char *kw) {
+    size_t n = std::char_traits<char>::length(kw);
+    if (pos + n > expr.size())
+      return false;
+    for (size_t i = 0; i < n; ++i)
+      if (std::toupper(static_cast<unsigned char>(expr[pos + i])) != kw[i])
+        return false;
+    if (pos + n < expr.size() &&
+        (std::isalnum(static_cast<unsigned char>(expr[pos + n])) ||
+         expr[pos + n] == '_'))
+      return false;
+    pos += n;
+    skipWS();
+    return true;
+  }
+
+  // [NOT] <relation>
+  double logicalOperand() {
+    skipWS();
+    if (keyword("NOT"))
+      return parseRelation() == 0.0 ? -1.0 : 0.0;
+    return parseRelation();
+  }
+
+  // <logical> ::= [NOT] <relation> { (AND|OR) [NOT] <relation> }
+  double parseLogical() {
+    double value = logicalOperand();
+    for (;;) {
+      skipWS();
+      if (keyword("AND")) {
+        double rhs = logicalOperand();
+        value = (value != 0.0 && rhs != 0.0) ? -1.0 : 0.0;
+      } else if (keyword("OR")) {
+        double rhs = logicalOperand();
+        value = (value != 0.0 || rhs != 0.0) ? -1.0 : 0.0;
+      } else {
+        return value;
+      }
+    }
+  }
+
+  // True when a string operand ("text", NAME$, NAME$(...)) starts at pos
+  bool stringAhead() const {
+    if (pos >= expr.size())
+      return false;
+    if (expr[pos] == '"')
+      return true;
+    size_t p = pos;
+    while (p < expr.size() && (std::isalnum(expr[p]) || expr[p] == '_'))
+      ++p;
+    return p > pos && p < expr.size() && expr[p] == '$';
+  }
+
+  void expect(char c) {
+    skipWS();
+    if (pos >= expr.size() || expr[pos] != c)
+      throw std::runtime_error(std::string("Expected '") + c +
+                               "' in expression");
+    ++pos;
+  }
+
+  // Consume a relational operator: 1 '=', 2 '<>', 3 '<', 4 '>', 5 '<=',
+  // 6 '>=', or 0 (nothing consumed) when there is none.
+  int relationalOp() {
+    skipWS();
+    if (pos >= expr.size())
+      return 0;
+    char c = expr[pos];
+    char d = pos + 1 < expr.size() ? expr[pos + 1] : '\0';
+    int op;
+    if (c == '=')
+      op = 1;
+    else if (c == '<' && d == '>')
+      op = 2;
+    else if (c == '<' && d == '=')
+      op = 5;
+    else if (c == '>' && d == '=')
+      op = 6;
+    else if (c == '<')
+      op = 3;
+    else if (c == '>')
+      op = 4;
+    else
+      return 0;
+    pos += (op == 2 || op >= 5) ? 2 : 1;
+    skipWS();
+    return op;
+  }
+
+  // <relation> ::= <expression> [ (=|<>|<|>|<=|>=) <expression> ]
+  //              | <string> (=|<>|<|>|<=|>=) <string>
+  double parseRelation() {
+    skipWS();
+    if (stringAhead())
+      return parseStringRelation();
+    double lhs = parseExpr();
+    int op = relationalOp();
+    if (op == 0)
+      return lhs;
+    double rhs = parseExpr();
+    bool r = op == 1   ? lhs == rhs
+             : op == 2 ? lhs != rhs
+             : op == 3 ? lhs < rhs
+             : op == 4 ? lhs > rhs
+             : op == 5 ? lhs <= rhs
+                       : lhs >= rhs;
+    return r ? -1.0 : 0.0;
+  }
+
+  // Strings compare bytewise; a shorter prefix sorts first.
+  double parseStringRelation() {
+    StringTempScope scope(program.stringTemps);
+    StrValue lhs = evalStringValueAt(program, expr, pos);
+    int op = relationalOp();
+    if (op == 0)
+      throw std::runtime_error("Type mismatch: string used as a number");
+    skipWS();
+    if (!stringAhead())
+      throw std::runtime_error("Type mismatch: string compared with number");
+    StrValue rhs = evalStringValueAt(program, expr, pos);
+    int c = lhs.compare(rhs);
+    bool r = op == 1   ? c == 0
+             : op == 2 ? c != 0
+             : op == 3 ? c < 0
+             : op == 4 ? c > 0
+             : op == 5 ? c <= 0
+                       : c >= 0;
+    return r ? -1.0 : 0.0;
+  }
+
+  // One contiguous view of v (flattened into a temp when it is a rope).
+  std::string_view contiguous(const StrValue &v) {
+    if (v.count <= 1)
+      return v.count ? v.pieces[0] : std::string_view();
+    std::string &t = program.stringTemps.next();
+    v.appendTo(t);
+    return t;
+  }
+
+  // INSTR([start,] s$, t$): 1-based position of t$ in s$ at or after
+  // start, or 0. Single characters use memchr, longer needles memmem
+  // (glibc's two-way matcher), so scans stay linear. pos is past '('.
+  double parseInstr() {
+    StringTempScope scope(program.stringTemps);
+    size_t start = 0;
+    skipWS();
+    if (!stringAhead()) {
+      double s = parseExpr();
+      start = s > 1 ? static_cast<size_t>(s) - 1 : 0;
+      expect(',');
+      skipWS();
+    }
+    std::string_view hay = contiguous(evalStringValueAt(program, expr, pos));
+    expect(',');
+    skipWS();
+    std::string_view needle =
+        contiguous(evalStringValueAt(program, expr, pos));
+    expect(')');
+
+    if (start > hay.size() || needle.size() > hay.size() - start)
+      return 0.0;
+    if (needle.empty())
+      return static_cast<double>(start + 1);
+    const char *first = hay.data() + start;
+    size_t n = hay.size() - start;
+    const void *hit =
+        needle.size() == 1
+            ? std::memchr(first, needle[0], n)
+            : memmem(first, n, needle.data(), needle.size());
+    return hit ? static_cast<double>(static_cast<const char *>(hit) -
+                                     hay.data() + 1)
+               : 0.0;
+  }
+
+  // SUM(A), MEAN(A), MINVAL(A), ... over a whole matrix; pos is past '('.
+  double parseReduction(MatReduction op) {
+    skipWS();
+    size_t start = pos;
+    while (pos < expr.size() && (std::isalnum(expr[pos]) || expr[pos] == '_'))
+      ++pos;
+    if (pos == start)
+      throw std::runtime_error("Matrix name expected in expression");
+    std::string matrix = expr.substr(start, pos - start);
+    expect(')');
+    return matReduce(matrixNamed(program, matrix), op);
+  }
 
   // <expression> ::= <term> { (+|-) <term> }
-  parseExpr = [&]() -> double {
+  double parseExpr() {
     double value = parseTerm();
     skipWS();
     while (pos < expr.size()) {
@@ -38,10 +285,10 @@ double evalExpression(const std::string &expr) {
       skipWS();
     }
     return value;
-  };
+  }
 
   // <term> ::= <factor> { (*|/) <factor> }
-  parseTerm = [&]() -> double {
+  double parseTerm() {
     double value = parseFactor();
     skipWS();
     while (pos < expr.size()) {
@@ -61,11 +308,11 @@ double evalExpression(const std::string &expr) {
       skipWS();
     }
     return value;
-  };
+  }
 
-  // <factor> ::= [-] ( <number> | <identifier> | <identifier>(<args>) | '('
-  // <expression> ')' )
-  parseFactor = [&]() -> double {
+  // <factor> ::= [-] <power>
+  // <power>  ::= <atom> { ^ [-] <atom> }   (left to right, so -2^2 = -4)
+  double parseFactor() {
     skipWS();
     bool neg = false;
     if (pos < expr.size() && expr[pos] == '-') {
@@ -74,11 +321,31 @@ double evalExpression(const std::string &expr) {
       skipWS();
     }
 
+    double value = parseAtom();
+    skipWS();
+    while (pos < expr.size() && expr[pos] == '^') {
+      ++pos;
+      skipWS();
+      bool negExp = pos < expr.size() && expr[pos] == '-';
+      if (negExp)
+        ++pos;
+      double exponent = parseAtom();
+      value = std::pow(value, negExp ? -exponent : exponent);
+      skipWS();
+    }
+
+    return neg ? -value : value;
+  }
+
+  // <atom> ::= <number> | <identifier> | <identifier>(<args>) | '('
+  // <expression> ')'
+  double parseAtom() {
+    skipWS();
     double value = 0.0;
     if (pos < expr.size() && expr[pos] == '(') {
       ++pos;
       skipWS();
-      value = parseExpr();
+      value = parseLogical();
       skipWS();
       if (pos >= expr.size() || expr[pos] != ')')
         throw std::runtime_error("Missing closing parenthesis");
@@ -87,28 +354,19 @@ double evalExpression(const std::string &expr) {
     // Numeric literal with optional exponent
     else if (pos < expr.size() &&
              (std::isdigit(expr[pos]) || expr[pos] == '.')) {
-      size_t start = pos;
-      // Integral and fractional part
-      while (pos < expr.size() && (std::isdigit(expr[pos]) || expr[pos] == '.'))
-        ++pos;
-      // Exponent part
-      if (pos < expr.size() && (expr[pos] == 'e' || expr[pos] == 'E')) {
-        ++pos;
-        if (pos < expr.size() && (expr[pos] == '+' || expr[pos] == '-'))
-          ++pos;
-        while (pos < expr.size() && std::isdigit(expr[pos]))
-          ++pos;
-      }
-      value = std::stod(expr.substr(start, pos - start));
+      const char *first = expr.data() + pos;
+      auto res = std::from_chars(first, expr.data() + expr.size(), value);
+      if (res.ec != std::errc())
+        throw std::runtime_error("Invalid number in expression");
+      pos += static_cast<size_t>(res.ptr - first);
     } else {
       value = parsePrimary();
     }
-
-    return neg ? -value : value;
-  };
+    return value;
+  }
 
   // Parses identifiers, function calls, and variables
-  parsePrimary = [&]() -> double {
+  double parsePrimary() {
     skipWS();
     if (pos >= expr.size() || !std::isalpha(expr[pos]))
       throw std::runtime_error("Unexpected character in expression");
@@ -117,77 +375,45 @@ double evalExpression(const std::string &expr) {
     size_t start = pos;
     while (pos < expr.size() && (std::isalnum(expr[pos]) || expr[pos] == '_'))
       ++pos;
-    std::string id = expr.substr(start, pos - start);
-    std::string idUp = id;
-    for (char &c : idUp)
-      c = std::toupper(c);
+    std::string_view id(expr.data() + start, pos - start);
 
     skipWS();
+    // DEF FN call
+    std::string_view fnName;
+    if (userFunctionCall(expr, pos, id, fnName)) {
+      auto fn = program.userFunctions.find(fnName);
+      if (fn == program.userFunctions.end())
+        throw std::runtime_error("Undefined function FN" +
+                                 std::string(fnName));
+      double args[MAX_FUNCTION_ARGS] = {};
+      int nargs = parseArguments(id, args);
+      return callUserFunction(program, fn->second, args, nargs);
+    }
     // Function call
     if (pos < expr.size() && expr[pos] == '(') {
       ++pos;
-      skipWS();
-      std::vector<double> args;
-      if (pos < expr.size() && expr[pos] != ')') {
-        do {
-          args.push_back(parseExpr());
-          skipWS();
-        } while (pos < expr.size() && expr[pos] == ',' &&
-                 (++pos, skipWS(), true));
-      }
-      if (pos >= expr.size() || expr[pos] != ')')
-        throw std::runtime_error("Missing closing parenthesis in call to " +
-                                 id);
-      ++pos;
-      // Built-in math functions
-      if (idUp == "SIN")
-        return std::sin(args[0]);
-      if (idUp == "COS")
-        return std::cos(args[0]);
-      if (idUp == "TAN")
-        return std::tan(args[0]);
-      if (idUp == "ATN")
-        return std::atan(args[0]);
-      if (idUp == "ASN")
-        return std::asin(args[0]);
-      if (idUp == "ACS")
-        return std::acos(args[0]);
-      if (idUp == "COT")
-        return 1.0 / std::tan(args[0]);
-      if (idUp == "SEC")
-        return 1.0 / std::cos(args[0]);
-      if (idUp == "CSC")
-        return 1.0 / std::sin(args[0]);
-      if (idUp == "SQR")
-        return std::sqrt(args[0]);
-      if (idUp == "EXP")
-        return std::exp(args[0]);
-      if (idUp == "LOG10")
-        return std::log10(args[0]);
-      if (idUp == "LOGX")
-        return std::log(args[1]) / std::log(args[0]);
-      if (idUp == "CLOG")
-        return std::log(args[0]);
-      if (idUp == "INT")
-        return std::floor(args[0]);
-      if (idUp == "ROUND")
-        return std::floor(args[0] + 0.5);
-      if (idUp == "FLOOR")
-        return std::floor(args[0]);
-      if (idUp == "CEIL")
-        return std::ceil(args[0]);
-      if (idUp == "POW")
-        return std::pow(args[0], args[1]);
-      if (idUp == "RND")
-        return std::rand() / (double)RAND_MAX;
-      if (idUp == "DEG2RAD")
-        return args[0] * M_PI / 180.0;
-      if (idUp == "RAD2DEG")
-        return args[0] * 180.0 / M_PI;
-      throw std::runtime_error("Unknown function: " + id);
+      if (sameName(id, "INSTR"))
+        return parseInstr();
+      MatReduction op;
+      if (matReductionNamed(id, op))
+        return parseReduction(op);
+      for (const auto &f : FUNCTIONS)
+        if (sameName(id, f.name)) {
+          double args[MAX_FUNCTION_ARGS] = {};
+          int nargs = parseArguments(id, args);
+          if (nargs < f.minArgs || nargs > f.maxArgs)
+            throw std::runtime_error(
+                "Wrong number of arguments in call to " + std::string(id));
+          return callFunction(f.fn, args);
+        }
+      throw std::runtime_error("Unknown function: " + std::string(id));
     }
 
-    // Variable lookup
+    // Parameters, then variables
+    if (scope)
+      for (size_t i = 0; i < scope->params.size(); ++i)
+        if (scope->params[i] == id)
+          return locals[i];
     auto itNum = program.numericVariables.find(id);
     if (itNum != program.numericVariables.end()) {
       return itNum->second.numericValue;
@@ -196,13 +422,139 @@ double evalExpression(const std::string &expr) {
     if (itStr != program.stringVariables.end()) {
       return std::stod(itStr->second.stringValue);
     }
+    if (const double *err = errorVariable(program, id))
+      return *err;
+    // PI, unless the program has a variable of that name
+    if (sameName(id, "PI"))
+      return M_PI;
 
-    throw std::runtime_error("Unknown identifier: " + id);
-  };
+    throw std::runtime_error("Unknown identifier: " + std::string(id));
+  }
 
-  double result = parseExpr();
-  skipWS();
+  // Arguments of a call to `id` up to ')'; pos is past '('. Returns how
+  // many there were.
+  int parseArguments(std::string_view id, double *args) {
+    skipWS();
+    int nargs = 0;
+    if (pos < expr.size() && expr[pos] != ')') {
+      do {
+        if (nargs == MAX_FUNCTION_ARGS)
+          throw std::runtime_error("Too many arguments in call to " +
+                                   std::string(id));
+        args[nargs++] = parseExpr();
+        skipWS();
+      } while (pos < expr.size() && expr[pos] == ',' &&
+               (++pos, skipWS(), true));
+    }
+    if (pos >= expr.size() || expr[pos] != ')')
+      throw std::runtime_error("Missing closing parenthesis in call to " +
+                               std::string(id));
+    ++pos;
+    return nargs;
+  }
+
+  // Built-in numeric functions, on arguments already counted
+  double callFunction(Function fn, const double *args) {
+    switch (fn) {
+    case FN_SIN:
+      return std::sin(args[0]);
+    case FN_COS:
+      return std::cos(args[0]);
+    case FN_TAN:
+      return std::tan(args[0]);
+    case FN_ATN:
+      return std::atan(args[0]);
+    case FN_ASN:
+      return std::asin(args[0]);
+    case FN_ACS:
+      return std::acos(args[0]);
+    case FN_COT:
+      return 1.0 / std::tan(args[0]);
+    case FN_SEC:
+      return 1.0 / std::cos(args[0]);
+    case FN_CSC:
+      return 1.0 / std::sin(args[0]);
+    case FN_SQR:
+      return std::sqrt(args[0]);
+    case FN_ABS:
+      return std::fabs(args[0]);
+    case FN_SGN:
+      return args[0] > 0.0 ? 1.0 : args[0] < 0.0 ? -1.0 : 0.0;
+    case FN_EXP:
+      return std::exp(args[0]);
+    case FN_LOG10:
+      return std::log10(args[0]);
+    case FN_LOGX:
+      return std::log(args[1]) / std::log(args[0]);
+    case FN_CLOG:
+      return std::log(args[0]);
+    case FN_INT:
+      return std::floor(args[0]);
+    case FN_ROUND:
+      return std::floor(args[0] + 0.5);
+    case FN_FLOOR:
+      return std::floor(args[0]);
+    case FN_CEIL:
+      return std::ceil(args[0]);
+    case FN_POW:
+      return std::pow(args[0], args[1]);
+    case FN_RND:
+      return program.rng.nextDouble();
+    case FN_DEG2RAD:
+      return args[0] * M_PI / 180.0;
+    case FN_RAD2DEG:
+      return args[0] * 180.0 / M_PI;
+    // File channels: EOF is -1 (true) or 0, LOC/LOF are byte counts
+    case FN_EOF:
+      return channelEOF(program, static_cast<int>(args[0])) ? -1.0 : 0.0;
+    case FN_LOC:
+      return static_cast<double>(
+          channelPosition(program, static_cast<int>(args[0])));
+    case FN_LOF:
+      return static_cast<double>(
+          channelLength(program, static_cast<int>(args[0])));
+    }
+    return 0.0;
+  }
+};
+
+// Evaluates a BASIC expression and returns its value as double.
+// Supports variables, numeric literals (with optional exponent), parentheses,
+// +, -, *, /, ^, PI, built-in math functions, comparisons (=, <>, <, >, <=,
+// >=) and NOT/AND/OR. Conditions yield -1 for true and 0 for false.
+double evalExpression(PROGRAM_STRUCTURE &program, const std::string &expr) {
+  ExprParser parser{program, expr};
+  double result = parser.parseLogical();
+  parser.skipWS();
+  if (parser.pos != expr.size())
+    throw std::runtime_error("Unexpected trailing characters in expression");
+  return result;
+}
+
+double evalExpressionAt(PROGRAM_STRUCTURE &program, const std::string &expr,
+                        size_t &pos) {
+  ExprParser parser{program, expr, pos};
+  double result = parser.parseLogical();
+  parser.skipWS();
+  pos = parser.pos;
+  return result;
+}
+
+double evalExpressionFrom(PROGRAM_STRUCTURE &program, const std::string &expr,
+                          size_t pos) {
+  double result = evalExpressionAt(program, expr, pos);
   if (pos != expr.size())
     throw std::runtime_error("Unexpected trailing characters in expression");
   return result;
 }
+
+double evalFunctionBody(PROGRAM_STRUCTURE &program, const UserFunction &fn,
+                        const double *args) {
+  ExprParser parser{program, fn.expr, 0, &fn, args};
+  double result = parser.parseLogical();
+  parser.skipWS();
+  if (parser.pos != fn.expr.size())
+    throw std::runtime_error("Unexpected trailing characters in FN" +
+                             fn.name);
+  return result;
+}
@@ -1,15 +1,15 @@
 #include "program_structure.h"
 #include <algorithm>
 #include <cctype>
+#include <charconv>
 #include <ctime>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-extern PROGRAM_STRUCTURE program;
+#include <string_view>
 
 // Helper to trim whitespace
-/*
- * static std::string trim(const std::string &s) {
+std::string trim(const std::string &s) {
   const char *WS = " \t\r\n";
   size_t start = s.find_first_not_of(WS);
   if (start == std::string::npos)
@@ -17,130 +17,209 @@ extern PROGRAM_STRUCTURE program;
   size_t end = s.find_last_not_of(WS);
   return s.substr(start, end - start + 1);
 }
-*/
 
-// Forward-declare numeric eval for embedded numeric args
-double evalExpression(const std::string &expr);
+// One-character strings for CHR$, so it needs no temporary.
+static const struct CharTable {
+  char c[256];
+  CharTable() {
+    for (int i = 0; i < 256; ++i)
+      c[i] = static_cast<char>(i);
+  }
+} charTable;
+
+// Character count argument of LEFT$/RIGHT$/MID$/STRING$ (negative = 0).
+static size_t countArg(double n) {
+  return n > 0 ? static_cast<size_t>(n) : 0;
+}
 
-// Evaluates a string expression, supporting variables, literals, and string
-// functions.
-std::string evalStringExpression(const std::string &expr) {
+// Recursive-descent parser for string expressions. Literals are views of
+// the expression text and variables views of their value, so only
+// functions that make new text (CHR$ excepted) take a StringTemps slot.
+struct StrParser {
+  PROGRAM_STRUCTURE &program;
+  const std::string &expr;
   size_t pos = 0;
-  auto skipWS = [&]() {
+
+  void skipWS() {
     while (pos < expr.size() && std::isspace(expr[pos]))
       ++pos;
-  };
-  skipWS();
-  // String literal
-  if (pos < expr.size() && expr[pos] == '"') {
-    size_t start = ++pos;
-    while (pos < expr.size() && expr[pos] != '"')
-      ++pos;
-    if (pos >= expr.size())
-      throw std::runtime_error("Unterminated string literal");
-    std::string lit = expr.substr(start, pos - start);
+  }
+
+  void expect(char c) {
+    skipWS();
+    if (pos >= expr.size() || expr[pos] != c)
+      throw std::runtime_error(std::string("Expected '") + c +
+                               "' in string expression: " + expr);
     ++pos;
-    return lit;
   }
-  // Identifier or function
-  if (pos < expr.size() && std::isalpha(expr[pos])) {
+
+  double numArg() {
+    skipWS();
+    return evalExpressionAt(program, expr, pos);
+  }
+
+  // Replace a full rope by one owned piece.
+  void flatten(StrValue &v) {
+    std::string &t = program.stringTemps.next();
+    v.appendTo(t);
+    v = StrValue(t);
+  }
+
+  void concat(StrValue &a, const StrValue &b) {
+    for (int i = 0; i < b.count; ++i)
+      if (!a.append(b.pieces[i])) {
+        flatten(a);
+        a.append(b.pieces[i]);
+      }
+  }
+
+  // <concat> ::= <primary> { + <primary> }
+  StrValue parseConcat() {
+    StrValue value = parsePrimary();
+    for (;;) {
+      skipWS();
+      if (pos >= expr.size() || expr[pos] != '+')
+        return value;
+      ++pos;
+      concat(value, parsePrimary());
+    }
+  }
+
+  // <primary> ::= "literal" | NAME$ | NAME$(<args>) | '(' <concat> ')'
+  StrValue parsePrimary() {
+    skipWS();
+    if (pos < expr.size() && expr[pos] == '"') {
+      size_t start = ++pos;
+      while (pos < expr.size() && expr[pos] != '"')
+        ++pos;
+      if (pos >= expr.size())
+        throw std::runtime_error("Unterminated string literal");
+      return StrValue(std::string_view(expr).substr(start, pos++ - start));
+    }
+    if (pos < expr.size() && expr[pos] == '(') {
+      ++pos;
+      StrValue value = parseConcat();
+      expect(')');
+      return value;
+    }
+    if (pos >= expr.size() || !std::isalpha(expr[pos]))
+      throw std::runtime_error("Invalid string expression: " + expr);
+
     size_t start = pos;
-    while (pos < expr.size() &&
-           (std::isalnum(expr[pos]) || expr[pos] == '_' || expr[pos] == '$'))
+    while (pos < expr.size() && (std::isalnum(expr[pos]) || expr[pos] == '_'))
       ++pos;
-    std::string id = expr.substr(start, pos - start);
+    if (pos >= expr.size() || expr[pos] != '$')
+      throw std::runtime_error("Invalid string expression: " + expr);
+    std::string_view name(expr.data() + start, pos - start);
+    ++pos;
     skipWS();
-    // Function call?
     if (pos < expr.size() && expr[pos] == '(') {
       ++pos;
+      return callFunction(name);
+    }
+    // Variable: a view of its current value
+    auto it = program.stringVariables.find(name);
+    if (it != program.stringVariables.end())
+      return StrValue(it->second.stringValue);
+    return StrValue();
+  }
+
+  // String functions; pos is just past the '('.
+  StrValue callFunction(std::string_view name) {
+    std::string id(name);
+    for (char &c : id)
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+
+    if (id == "LEFT" || id == "RIGHT") {
+      StrValue s = parseConcat();
+      expect(',');
+      size_t n = std::min(countArg(numArg()), s.length);
+      expect(')');
+      return id == "LEFT" ? s.substr(0, n) : s.substr(s.length - n, n);
+    }
+    if (id == "MID") {
+      StrValue s = parseConcat();
+      expect(',');
+      double start = numArg();
+      size_t n = std::string::npos;
       skipWS();
-      // Parse arguments
-      std::vector<std::string> args;
-      size_t argStart = pos;
-      int depth = 0;
-      while (pos < expr.size()) {
-        if (expr[pos] == '(') {
-          depth++;
-        } else if (expr[pos] == ')') {
-          if (depth == 0)
-            break;
-          depth--;
-        } else if (expr[pos] == ',' && depth == 0) {
-          args.push_back(trim(expr.substr(argStart, pos - argStart)));
-          ++pos;
-          argStart = pos;
-          continue;
-        }
+      if (pos < expr.size() && expr[pos] == ',') {
         ++pos;
+        n = countArg(numArg());
       }
-      args.push_back(trim(expr.substr(argStart, pos - argStart)));
-      if (pos >= expr.size() || expr[pos] != ')')
-        throw std::runtime_error("Missing ')' in string function call");
-      ++pos;
-      // Execute string function
-      if (id == "LEFT$") {
-        std::string s = evalStringExpression(args[0]);
-        int n = static_cast<int>(evalExpression(args[1]));
-        return s.substr(0, n);
-      }
-      if (id == "RIGHT$") {
-        std::string s = evalStringExpression(args[0]);
-        int n = static_cast<int>(evalExpression(args[1]));
-        return s.substr(s.size() > n ? s.size() - n : 0);
-      }
-      if (id == "MID$") {
-        std::string s = evalStringExpression(args[0]);
-        int i = static_cast<int>(evalExpression(args[1])) - 1;
-        int n = static_cast<int>(evalExpression(args[2]));
-        if (i < 0)
-          i = 0;
-        if (i >= static_cast<int>(s.size()))
-          return "";
-        return s.substr(i, n);
-      }
-      if (id == "LEN$") {
-        std::string s = evalStringExpression(args[0]);
-        return std::to_string(s.size());
-      }
-      if (id == "CHR$") {
-        int code = static_cast<int>(evalExpression(args[0]));
-        return std::string(1, static_cast<char>(code));
-      }
-      if (id == "STRING$") {
-        int n = static_cast<int>(evalExpression(args[0]));
-        std::string fill =
-            args.size() > 1 ? evalStringExpression(args[1]) : " ";
-        char c = fill.empty() ? ' ' : fill[0];
-        return std::string(n, c);
+      expect(')');
+      size_t i = start > 1 ? static_cast<size_t>(start) - 1 : 0;
+      return s.substr(i, n);
+    }
+    if (id == "LEN") {
+      StrValue s = parseConcat();
+      expect(')');
+      std::string &t = program.stringTemps.next();
+      t = std::to_string(s.length);
+      return StrValue(t);
+    }
+    if (id == "CHR") {
+      int code = static_cast<int>(numArg());
+      expect(')');
+      return StrValue(std::string_view(&charTable.c[code & 0xFF], 1));
+    }
+    if (id == "STRING") {
+      size_t n = countArg(numArg());
+      char c = ' ';
+      skipWS();
+      if (pos < expr.size() && expr[pos] == ',') {
+        ++pos;
+        StrValue fill = parseConcat();
+        if (fill.length)
+          c = fill.pieces[0][0];
       }
-      if (id == "TIME$") {
-        std::time_t t = std::time(nullptr);
-        std::tm *tm = std::localtime(&t);
-        char buf[9];
+      expect(')');
+      std::string &t = program.stringTemps.next();
+      t.assign(n, c);
+      return StrValue(t);
+    }
+    if (id == "TIME" || id == "DATE") {
+      expect(')');
+      std::time_t now = std::time(nullptr);
+      std::tm *tm = std::localtime(&now);
+      char buf[36]; // room for three full-width ints and two separators
+      if (id == "TIME")
         std::snprintf(buf, sizeof(buf), "%02d:%02d:%02d", tm->tm_hour,
                       tm->tm_min, tm->tm_sec);
-        return std::string(buf);
-      }
-      if (id == "DATE$") {
-        std::time_t t = std::time(nullptr);
-        std::tm *tm = std::localtime(&t);
-        char buf[11];
+      else
         std::snprintf(buf, sizeof(buf), "%04d-%02d-%02d", tm->tm_year + 1900,
                       tm->tm_mon + 1, tm->tm_mday);
-        return std::string(buf);
-      }
-      throw std::runtime_error("Unknown string function: " + id);
-    }
-    // Variable
-    if (!id.empty() && id.back() == '$') {
-      std::string name = id.substr(0, id.size() - 1);
-      auto it = program.stringVariables.find(name);
-      if (it != program.stringVariables.end()) {
-        std::string tmpstr = it->second.stringValue;
-        return tmpstr;
-      }
-      return "";
+      std::string &t = program.stringTemps.next();
+      t = buf;
+      return StrValue(t);
     }
+    throw std::runtime_error("Unknown string function: " + id + "$");
   }
-  throw std::runtime_error("Invalid string expression: " + expr);
+};
+
+StrValue evalStringValueAt(PROGRAM_STRUCTURE &program, const std::string &expr,
+                           size_t &pos) {
+  StrParser parser{program, expr, pos};
+  StrValue value = parser.parseConcat();
+  parser.skipWS();
+  pos = parser.pos;
+  return value;
+}
+
+StrValue evalStringValue(PROGRAM_STRUCTURE &program, const std::string &expr) {
+  size_t pos = 0;
+  StrValue value = evalStringValueAt(program, expr, pos);
+  if (pos != expr.size())
+    throw std::runtime_error("Invalid string expression: " + expr);
+  return value;
+}
+
+// Evaluates a string expression, supporting variables, literals, '+' and
+// string functions, and returns it as one flat string.
+std::string evalStringExpression(PROGRAM_STRUCTURE &program,
+                                 const std::string &expr) {
+  StringTempScope scope(program.stringTemps);
+  std::string out;
+  evalStringValue(program, expr).appendTo(out);
+  return out;
 }
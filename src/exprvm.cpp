@@ -0,0 +1,687 @@
+#include "exprvm.h"
+#include "interpreter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// DEF FN bodies of at most this many instructions are inlined at compiled
+// call sites; larger ones are called.
+static const size_t INLINE_LIMIT = 8;
+
+static inline double truth(bool b) { return b ? -1.0 : 0.0; }
+
+// One instruction; shared by runExpression and constant folding.
+static inline void execute(PROGRAM_STRUCTURE &program, const ExprInstr &i) {
+  switch (i.op) {
+  case XOP_MOV:
+    *i.dst = *i.a;
+    break;
+  case XOP_NEG:
+    *i.dst = -*i.a;
+    break;
+  case XOP_ADD:
+    *i.dst = *i.a + *i.b;
+    break;
+  case XOP_SUB:
+    *i.dst = *i.a - *i.b;
+    break;
+  case XOP_MUL:
+    *i.dst = *i.a * *i.b;
+    break;
+  case XOP_DIV:
+    if (*i.b == 0.0)
+      throw std::runtime_error("Division by zero");
+    *i.dst = *i.a / *i.b;
+    break;
+  case XOP_EQ:
+    *i.dst = truth(*i.a == *i.b);
+    break;
+  case XOP_NE:
+    *i.dst = truth(*i.a != *i.b);
+    break;
+  case XOP_LT:
+    *i.dst = truth(*i.a < *i.b);
+    break;
+  case XOP_GT:
+    *i.dst = truth(*i.a > *i.b);
+    break;
+  case XOP_LE:
+    *i.dst = truth(*i.a <= *i.b);
+    break;
+  case XOP_GE:
+    *i.dst = truth(*i.a >= *i.b);
+    break;
+  case XOP_AND:
+    *i.dst = truth(*i.a != 0.0 && *i.b != 0.0);
+    break;
+  case XOP_OR:
+    *i.dst = truth(*i.a != 0.0 || *i.b != 0.0);
+    break;
+  case XOP_NOT:
+    *i.dst = truth(*i.a == 0.0);
+    break;
+  case XOP_CALL1:
+    *i.dst = i.fn1(*i.a);
+    break;
+  case XOP_CALL2:
+    *i.dst = i.fn2(*i.a, *i.b);
+    break;
+  case XOP_RND:
+    *i.dst = program.rng.nextDouble();
+    break;
+  case XOP_CALLFN:
+    *i.dst = callUserFunction(program, *i.user, i.user->slots,
+                              static_cast<int>(i.user->params.size()));
+    break;
+  }
+}
+
+double runExpression(PROGRAM_STRUCTURE &program, ExprCode &code) {
+  for (const ExprInstr &i : code.code)
+    execute(program, i);
+  return *code.result;
+}
+
+namespace {
+
+// Built-ins evalExpression computes from its arguments alone (RND, the
+// channel functions, INSTR and the reductions are handled elsewhere).
+struct Builtin {
+  const char *name;
+  double (*fn1)(double);
+  double (*fn2)(double, double);
+};
+
+const Builtin BUILTINS[] = {
+    {"SIN", [](double x) { return std::sin(x); }, nullptr},
+    {"COS", [](double x) { return std::cos(x); }, nullptr},
+    {"TAN", [](double x) { return std::tan(x); }, nullptr},
+    {"ATN", [](double x) { return std::atan(x); }, nullptr},
+    {"ASN", [](double x) { return std::asin(x); }, nullptr},
+    {"ACS", [](double x) { return std::acos(x); }, nullptr},
+    {"COT", [](double x) { return 1.0 / std::tan(x); }, nullptr},
+    {"SEC", [](double x) { return 1.0 / std::cos(x); }, nullptr},
+    {"CSC", [](double x) { return 1.0 / std::sin(x); }, nullptr},
+    {"SQR", [](double x) { return std::sqrt(x); }, nullptr},
+    {"ABS", [](double x) { return std::fabs(x); }, nullptr},
+    {"SGN", [](double x) { return x > 0.0 ? 1.0 : x < 0.0 ? -1.0 : 0.0; },
+     nullptr},
+    {"EXP", [](double x) { return std::exp(x); }, nullptr},
+    {"LOG10", [](double x) { return std::log10(x); }, nullptr},
+    {"CLOG", [](double x) { return std::log(x); }, nullptr},
+    {"INT", [](double x) { return std::floor(x); }, nullptr},
+    {"ROUND", [](double x) { return std::floor(x + 0.5); }, nullptr},
+    {"FLOOR", [](double x) { return std::floor(x); }, nullptr},
+    {"CEIL", [](double x) { return std::ceil(x); }, nullptr},
+    {"DEG2RAD", [](double x) { return x * M_PI / 180.0; }, nullptr},
+    {"RAD2DEG", [](double x) { return x * 180.0 / M_PI; }, nullptr},
+    {"LOGX", nullptr,
+     [](double base, double x) { return std::log(x) / std::log(base); }},
+    {"POW", nullptr, [](double x, double y) { return std::pow(x, y); }},
+};
+
+// The ^ operator
+double power(double x, double y) { return std::pow(x, y); }
+
+// Why compilation gave up; caught in compileExpression.
+struct NotYet {};
+struct Unsupported {};
+
+// Where a value lives while the code is being built; pointers are fixed
+// once the constant, temporary and local counts are known. Locals hold
+// the arguments of inlined calls and, unlike temporaries, stay live to
+// the end; slots are a called function's parameters.
+struct Ref {
+  enum Kind { VAR, CONST, TEMP, LOCAL, SLOT, INTO } kind = CONST;
+  size_t index = 0;             // CONST / TEMP / LOCAL
+  const double *var = nullptr;  // VAR
+  double *slot = nullptr;       // SLOT
+};
+
+struct PendingInstr {
+  ExprOp op;
+  Ref dst, a, b;
+  double (*fn1)(double) = nullptr;
+  double (*fn2)(double, double) = nullptr;
+  UserFunction *user = nullptr;
+};
+
+// Marks a function whose body is being compiled or inlined, so a body
+// that calls itself is left to evalExpression.
+struct Compiling {
+  UserFunction &fn;
+  explicit Compiling(UserFunction &f) : fn(f) { fn.compiling = true; }
+  ~Compiling() { fn.compiling = false; }
+};
+
+// Recursive descent over the same grammar as ExprParser; each rule
+// returns where its value ends up instead of the value itself. Inside a
+// DEF FN body `scope` is the function: its parameters are `bound` to the
+// caller's operands when inlined, else read from its slots.
+struct ExprCompiler {
+  PROGRAM_STRUCTURE &program;
+  std::string_view expr;
+  ExprCode &out;
+  size_t pos = 0;
+  std::vector<PendingInstr> pending = {};
+  size_t liveTemps = 0;
+  UserFunction *scope = nullptr;
+  const Ref *bound = nullptr;
+  bool pure = true; // reads no variable, RND or impure function
+
+  void skipWS() {
+    while (pos < expr.size() && std::isspace(expr[pos]))
+      ++pos;
+  }
+
+  bool keyword(const char *kw) {
+    size_t n = std::char_traits<char>::length(kw);
+    if (pos + n > expr.size())
+      return false;
+    for (size_t i = 0; i < n; ++i)
+      if (std::toupper(static_cast<unsigned char>(expr[pos + i])) != kw[i])
+        return false;
+    if (pos + n < expr.size() &&
+        (std::isalnum(static_cast<unsigned char>(expr[pos + n])) ||
+         expr[pos + n] == '_'))
+      return false;
+    pos += n;
+    skipWS();
+    return true;
+  }
+
+  Ref constant(double v) {
+    Ref r;
+    r.index = out.constants.size();
+    out.constants.push_back(v);
+    return r;
+  }
+
+  const double *pointer(const Ref &r) {
+    switch (r.kind) {
+    case Ref::VAR:
+      return r.var;
+    case Ref::CONST:
+      return &out.constants[r.index];
+    case Ref::LOCAL:
+      return &out.locals[r.index];
+    case Ref::SLOT:
+      return r.slot;
+    default:
+      return &out.temps[r.index];
+    }
+  }
+
+  // Append `op`, or fold it when every operand is a constant. Operand
+  // temporaries are always the most recent live ones, so they are
+  // released by count and the result reuses the first of them.
+  Ref emit(ExprOp op, Ref a, Ref b = Ref(),
+           double (*fn1)(double) = nullptr,
+           double (*fn2)(double, double) = nullptr,
+           UserFunction *user = nullptr) {
+    bool nullary = op == XOP_RND || op == XOP_CALLFN;
+    bool binary = !nullary && op != XOP_MOV && op != XOP_NEG &&
+                  op != XOP_NOT && op != XOP_CALL1;
+    if (!nullary && a.kind == Ref::CONST &&
+        (!binary || b.kind == Ref::CONST) &&
+        !(op == XOP_DIV && out.constants[b.index] == 0.0)) {
+      double x = out.constants[a.index];
+      double y = binary ? out.constants[b.index] : 0.0;
+      double v;
+      execute(program, ExprInstr{op, &v, &x, &y, fn1, fn2});
+      return constant(v);
+    }
+    liveTemps -= (!nullary && a.kind == Ref::TEMP) +
+                 (binary && b.kind == Ref::TEMP);
+    Ref dst;
+    dst.kind = Ref::TEMP;
+    dst.index = liveTemps++;
+    if (out.temps.size() < liveTemps)
+      out.temps.resize(liveTemps);
+    pending.push_back(PendingInstr{op, dst, a, b, fn1, fn2, user});
+    return dst;
+  }
+
+  Ref logicalOperand() {
+    skipWS();
+    if (keyword("NOT"))
+      return emit(XOP_NOT, parseRelation());
+    return parseRelation();
+  }
+
+  Ref parseLogical() {
+    Ref value = logicalOperand();
+    for (;;) {
+      skipWS();
+      if (keyword("AND"))
+        value = emit(XOP_AND, value, logicalOperand());
+      else if (keyword("OR"))
+        value = emit(XOP_OR, value, logicalOperand());
+      else
+        return value;
+    }
+  }
+
+  bool stringAhead() const {
+    if (pos >= expr.size())
+      return false;
+    if (expr[pos] == '"')
+      return true;
+    size_t p = pos;
+    while (p < expr.size() && (std::isalnum(expr[p]) || expr[p] == '_'))
+      ++p;
+    return p > pos && p < expr.size() && expr[p] == '$';
+  }
+
+  // Relational operator at pos, consumed, or XOP_MOV when there is none
+  ExprOp relationalOp() {
+    skipWS();
+    if (pos >= expr.size())
+      return XOP_MOV;
+    char c = expr[pos];
+    char d = pos + 1 < expr.size() ? expr[pos + 1] : '\0';
+    ExprOp op;
+    size_t width = 1;
+    if (c == '=')
+      op = XOP_EQ;
+    else if (c == '<' && d == '>')
+      op = XOP_NE, width = 2;
+    else if (c == '<' && d == '=')
+      op = XOP_LE, width = 2;
+    else if (c == '>' && d == '=')
+      op = XOP_GE, width = 2;
+    else if (c == '<')
+      op = XOP_LT;
+    else if (c == '>')
+      op = XOP_GT;
+    else
+      return XOP_MOV;
+    pos += width;
+    skipWS();
+    return op;
+  }
+
+  Ref parseRelation() {
+    skipWS();
+    if (stringAhead())
+      throw Unsupported();
+    Ref lhs = parseExpr();
+    ExprOp op = relationalOp();
+    if (op == XOP_MOV)
+      return lhs;
+    return emit(op, lhs, parseExpr());
+  }
+
+  Ref parseExpr() {
+    Ref value = parseTerm();
+    skipWS();
+    while (pos < expr.size() && (expr[pos] == '+' || expr[pos] == '-')) {
+      ExprOp op = expr[pos] == '+' ? XOP_ADD : XOP_SUB;
+      ++pos;
+      skipWS();
+      value = emit(op, value, parseTerm());
+      skipWS();
+    }
+    return value;
+  }
+
+  Ref parseTerm() {
+    Ref value = parseFactor();
+    skipWS();
+    while (pos < expr.size() && (expr[pos] == '*' || expr[pos] == '/')) {
+      ExprOp op = expr[pos] == '*' ? XOP_MUL : XOP_DIV;
+      ++pos;
+      skipWS();
+      value = emit(op, value, parseFactor());
+      skipWS();
+    }
+    return value;
+  }
+
+  // [-] atom { ^ [-] atom }, as ExprParser
+  Ref parseFactor() {
+    skipWS();
+    bool neg = false;
+    if (pos < expr.size() && expr[pos] == '-') {
+      neg = true;
+      ++pos;
+      skipWS();
+    }
+
+    Ref value = parseAtom();
+    skipWS();
+    while (pos < expr.size() && expr[pos] == '^') {
+      ++pos;
+      skipWS();
+      bool negExp = pos < expr.size() && expr[pos] == '-';
+      if (negExp)
+        ++pos;
+      Ref exponent = parseAtom();
+      if (negExp)
+        exponent = emit(XOP_NEG, exponent);
+      value = emit(XOP_CALL2, value, exponent, nullptr, power);
+      skipWS();
+    }
+    return neg ? emit(XOP_NEG, value) : value;
+  }
+
+  Ref parseAtom() {
+    skipWS();
+    Ref value;
+    if (pos < expr.size() && expr[pos] == '(') {
+      ++pos;
+      skipWS();
+      value = parseLogical();
+      skipWS();
+      if (pos >= expr.size() || expr[pos] != ')')
+        throw Unsupported();
+      ++pos;
+    } else if (pos < expr.size() &&
+               (std::isdigit(expr[pos]) || expr[pos] == '.')) {
+      double v;
+      const char *first = expr.data() + pos;
+      auto res = std::from_chars(first, expr.data() + expr.size(), v);
+      if (res.ec != std::errc())
+        throw Unsupported();
+      pos += static_cast<size_t>(res.ptr - first);
+      value = constant(v);
+    } else {
+      value = parsePrimary();
+    }
+    return value;
+  }
+
+  Ref parsePrimary() {
+    skipWS();
+    if (pos >= expr.size() || !std::isalpha(expr[pos]))
+      throw Unsupported();
+    size_t start = pos;
+    while (pos < expr.size() && (std::isalnum(expr[pos]) || expr[pos] == '_'))
+      ++pos;
+    std::string_view id(expr.data() + start, pos - start);
+
+    skipWS();
+    std::string_view fnName;
+    if (userFunctionCall(expr, pos, id, fnName))
+      return parseUserCall(fnName);
+    if (pos < expr.size() && expr[pos] == '(') {
+      ++pos;
+      return parseCall(id);
+    }
+
+    if (scope)
+      for (size_t i = 0; i < scope->params.size(); ++i)
+        if (scope->params[i] == id) {
+          if (bound)
+            return bound[i];
+          Ref r;
+          r.kind = Ref::SLOT;
+          r.slot = &scope->slots[i];
+          return r;
+        }
+    pure = false;
+    auto itNum = program.numericVariables.find(id);
+    if (itNum != program.numericVariables.end()) {
+      Ref r;
+      r.kind = Ref::VAR;
+      r.var = &itNum->second.numericValue;
+      return r;
+    }
+    // A string read as a number goes through stod; a missing name may
+    // still be assigned before the line runs again.
+    if (program.stringVariables.count(id))
+      throw Unsupported();
+    if (const double *err = errorVariable(program, id)) {
+      Ref r;
+      r.kind = Ref::VAR;
+      r.var = err;
+      return r;
+    }
+    // Like ERR/ERL, PI is only the constant while no variable has the name
+    if (sameName(id, "PI"))
+      return constant(M_PI);
+    throw NotYet();
+  }
+
+  // Arguments up to ')', compiled (and their temporaries held) in order;
+  // pos is past '('. Returns how many there were.
+  int parseArguments(Ref *args) {
+    skipWS();
+    int nargs = 0;
+    if (pos < expr.size() && expr[pos] != ')') {
+      do {
+        if (nargs == MAX_FUNCTION_ARGS)
+          throw Unsupported();
+        args[nargs++] = parseExpr();
+        skipWS();
+      } while (pos < expr.size() && expr[pos] == ',' &&
+               (++pos, skipWS(), true));
+    }
+    if (pos >= expr.size() || expr[pos] != ')')
+      throw Unsupported();
+    ++pos;
+    return nargs;
+  }
+
+  // Built-in call; pos is past '('. A call with the wrong number of
+  // arguments is left to ExprParser, which reports it.
+  Ref parseCall(std::string_view id) {
+    const Builtin *builtin = nullptr;
+    for (const Builtin &b : BUILTINS)
+      if (sameName(id, b.name))
+        builtin = &b;
+    bool rnd = sameName(id, "RND");
+    if (!builtin && !rnd)
+      throw Unsupported();
+
+    Ref args[MAX_FUNCTION_ARGS];
+    int nargs = parseArguments(args);
+    if (rnd ? nargs > 1 : nargs != (builtin->fn1 ? 1 : 2))
+      throw Unsupported();
+
+    if (rnd) { // its argument is evaluated only to be ignored
+      liveTemps -= nargs == 1 && args[0].kind == Ref::TEMP;
+      pure = false;
+      return emit(XOP_RND, Ref());
+    }
+    if (builtin->fn1)
+      return emit(XOP_CALL1, args[0], Ref(), builtin->fn1);
+    return emit(XOP_CALL2, args[0], args[1], nullptr, builtin->fn2);
+  }
+
+  // FN<name>(args); pos is past '('. The body is compiled first: small
+  // ones are then inlined, the rest called with the arguments moved into
+  // the function's slots once all of them are computed.
+  Ref parseUserCall(std::string_view name) {
+    auto it = program.userFunctions.find(name);
+    if (it == program.userFunctions.end())
+      throw NotYet(); // its DEF may not have run yet
+    UserFunction &fn = it->second;
+    if (fn.compiling)
+      throw Unsupported();
+    if (fn.status == EXPR_NOT_YET)
+      compileFunction(program, fn);
+    if (fn.status == EXPR_NOT_YET)
+      throw NotYet();
+    if (fn.status == EXPR_UNSUPPORTED)
+      throw Unsupported();
+
+    Ref args[MAX_FUNCTION_ARGS];
+    int nargs = parseArguments(args);
+    if (nargs != static_cast<int>(fn.params.size()))
+      throw Unsupported(); // evalExpression reports it
+    pure = pure && fn.pure;
+    if (fn.inlinable && !fn.cached && fn.body.code.size() <= INLINE_LIMIT)
+      return inlineCall(fn, args, nargs);
+
+    for (int i = 0; i < nargs; ++i) {
+      Ref slot;
+      slot.kind = Ref::SLOT;
+      slot.slot = &fn.slots[i];
+      pending.push_back(PendingInstr{XOP_MOV, slot, args[i], Ref()});
+      liveTemps -= args[i].kind == Ref::TEMP;
+    }
+    return emit(XOP_CALLFN, Ref(), Ref(), nullptr, nullptr, &fn);
+  }
+
+  // The body compiled here with its parameters bound to the arguments.
+  // Temporaries among them move to locals, as the body may read a
+  // parameter any number of times.
+  Ref inlineCall(UserFunction &fn, Ref *args, int nargs) {
+    for (int i = 0; i < nargs; ++i)
+      if (args[i].kind == Ref::TEMP) {
+        Ref local;
+        local.kind = Ref::LOCAL;
+        local.index = out.locals.size();
+        out.locals.push_back(0.0);
+        pending.push_back(PendingInstr{XOP_MOV, local, args[i], Ref()});
+        args[i] = local;
+        --liveTemps;
+      }
+
+    std::string_view callerExpr = expr;
+    size_t callerPos = pos;
+    UserFunction *callerScope = scope;
+    const Ref *callerBound = bound;
+    Compiling guard(fn);
+    expr = fn.expr;
+    pos = 0;
+    scope = &fn;
+    bound = args;
+    Ref value = parseLogical();
+    skipWS();
+    if (pos != expr.size())
+      throw Unsupported();
+    expr = callerExpr;
+    pos = callerPos;
+    scope = callerScope;
+    bound = callerBound;
+    return value;
+  }
+
+  // Fix every operand to its final address; the result goes to `into`
+  // when given.
+  void finish(Ref root, double *into) {
+    if (into) {
+      if (root.kind == Ref::TEMP)
+        pending.back().dst.kind = Ref::INTO;
+      else
+        pending.push_back(PendingInstr{XOP_MOV, Ref{Ref::INTO}, root, Ref()});
+    }
+    out.code.clear();
+    for (const PendingInstr &p : pending) {
+      double *dst = p.dst.kind == Ref::INTO ? into
+                    : p.dst.kind == Ref::SLOT ? p.dst.slot
+                    : p.dst.kind == Ref::LOCAL ? &out.locals[p.dst.index]
+                                               : &out.temps[p.dst.index];
+      out.code.push_back(ExprInstr{p.op, dst, pointer(p.a), pointer(p.b),
+                                   p.fn1, p.fn2, p.user});
+    }
+    out.result = into ? into : pointer(root);
+  }
+};
+
+// Parse the whole of the compiler's text and fix up its code.
+ExprCompileStatus compile(ExprCompiler &compiler, double *into) {
+  // The one constant unused operands point at
+  compiler.out.constants.push_back(0.0);
+  try {
+    Ref root = compiler.parseLogical();
+    compiler.skipWS();
+    if (compiler.pos != compiler.expr.size())
+      return EXPR_UNSUPPORTED;
+    compiler.finish(root, into);
+  } catch (const NotYet &) {
+    return EXPR_NOT_YET;
+  } catch (const Unsupported &) {
+    return EXPR_UNSUPPORTED;
+  }
+  return EXPR_COMPILED;
+}
+
+} // namespace
+
+ExprCompileStatus compileExpression(PROGRAM_STRUCTURE &program,
+                                    const std::string &expr, ExprCode &out,
+                                    double *into) {
+  out = ExprCode();
+  ExprCompiler compiler{program, expr, out};
+  return compile(compiler, into);
+}
+
+ExprCompileStatus compileFunction(PROGRAM_STRUCTURE &program,
+                                  UserFunction &fn) {
+  Compiling guard(fn);
+  fn.body = ExprCode();
+  ExprCompiler compiler{program, fn.expr, fn.body};
+  compiler.scope = &fn;
+  fn.status = compile(compiler, nullptr);
+  fn.pure = fn.status == EXPR_COMPILED && compiler.pure;
+  return fn.status;
+}
+
+double callUserFunction(PROGRAM_STRUCTURE &program, UserFunction &fn,
+                        const double *args, int nargs) {
+  if (nargs != static_cast<int>(fn.params.size()))
+    throw std::runtime_error("FN" + fn.name + " takes " +
+                             std::to_string(fn.params.size()) +
+                             " argument(s)");
+  if (fn.cached) {
+    auto hit = fn.memo.find(args[0]);
+    if (hit != fn.memo.end())
+      return hit->second;
+  }
+  if (fn.status == EXPR_NOT_YET)
+    compileFunction(program, fn);
+
+  double value;
+  if (fn.status == EXPR_COMPILED) {
+    if (args != fn.slots)
+      std::copy(args, args + nargs, fn.slots);
+    value = runExpression(program, fn.body);
+  } else {
+    if (fn.active)
+      throw std::runtime_error("RUNTIME ERROR: FN" + fn.name +
+                               " calls itself");
+    fn.active = true;
+    try {
+      value = evalFunctionBody(program, fn, args);
+    } catch (...) {
+      fn.active = false;
+      throw;
+    }
+    fn.active = false;
+  }
+  if (fn.cached && !std::isnan(args[0]))
+    fn.memo.emplace(args[0], value);
+  return value;
+}
+
+bool userFunctionCall(std::string_view expr, size_t &pos, std::string_view id,
+                      std::string_view &name) {
+  if (id.size() < 2 || std::toupper(static_cast<unsigned char>(id[0])) != 'F' ||
+      std::toupper(static_cast<unsigned char>(id[1])) != 'N')
+    return false;
+  size_t p = pos;
+  name = id.substr(2);
+  if (name.empty()) { // FN AREA(...)
+    size_t start = p;
+    while (p < expr.size() &&
+           (std::isalnum(static_cast<unsigned char>(expr[p])) || expr[p] == '_'))
+      ++p;
+    if (p == start || !std::isalpha(static_cast<unsigned char>(expr[start])))
+      return false;
+    name = expr.substr(start, p - start);
+    while (p < expr.size() && std::isspace(static_cast<unsigned char>(expr[p])))
+      ++p;
+  }
+  if (p >= expr.size() || expr[p] != '(')
+    return false;
+  pos = p + 1;
+  return true;
+}
@@ -8,8 +8,39 @@
 #include <string>
 */
 
+#include "interpreter.h"
 #include "program_structure.h"
 
+// Parse "<linenum> <statement>" lines from a stream into programSource and
+// split them into statements. Returns the number of lines read; used by
+// file LOAD and by embedders.
+size_t BASIC_Program_loadStream(PROGRAM_STRUCTURE &program, std::istream &in,
+                                bool verbose) {
+  program.programSource.clear();
+  std::string line;
+  size_t count = 0;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') // DOS line endings
+      line.pop_back();
+    std::istringstream iss(line);
+    int linenum;
+    if (!(iss >> linenum))
+      continue;
+    std::string remainder;
+    std::getline(iss, remainder);
+    remainder.erase(0, remainder.find_first_not_of(" 	"));
+    if (!remainder.empty()) {
+      program.programSource[linenum] = remainder;
+      ++count;
+      if (verbose && count % 100 == 0)
+        std::cout << "Loaded " << count << " lines so far...";
+    }
+  }
+  program.filesize_lines = program.programSource.size();
+  buildStatementTable(program);
+  return count;
+}
+
 // Load program from program.filename
 void BASIC_Program_load(PROGRAM_STRUCTURE &program) {
   const std::string &filename = program.filename;
@@ -19,7 +50,6 @@ void BASIC_Program_load(PROGRAM_STRUCTURE &program) {
     return;
   }
 
-  program.programSource.clear();
   char fullpath[PATH_MAX];
   if (realpath(filename.c_str(), fullpath)) {
     program.filepath = fullpath;
@@ -27,24 +57,9 @@ void BASIC_Program_load(PROGRAM_STRUCTURE &program) {
     program.filepath = filename;
   }
 
-  std::string line;
-  int count = 0;
-  while (std::getline(infile, line)) {
-    std::istringstream iss(line);
-    int linenum;
-    iss >> linenum;
-    std::string remainder;
-    std::getline(iss, remainder);
-    remainder.erase(0, remainder.find_first_not_of(" 	"));
-    if (!remainder.empty()) {
-      program.programSource[linenum] = remainder;
-      ++count;
-      if (count % 100 == 0)
-        std::cout << "Loaded " << count << " lines so far...";
-    }
-  }
+  BASIC_Program_loadStream(program, infile, true);
 
-  program.filesize_lines = program.programSource.size();
+  infile.clear();
   infile.seekg(0, std::ios::end);
   std::streampos pos2 = infile.tellg();
   program.filesize_bytes =
@@ -1,5 +1,9 @@
+#include "exprvm.h"
 #include "program_structure.h"
 
+extern void basicWrite(PROGRAM_STRUCTURE &program, const std::string &text);
+extern void basicFlush(PROGRAM_STRUCTURE &program);
+
 //=======================================================================================
 //   inline functsupport
 //
@@ -78,7 +82,9 @@ double evaluateFunction(const std::string &name,
     return std::pow(args[0].d, args[1].d);
   }
   if (name == "RND") {
-    return static_cast<double>(rand()) / RAND_MAX;
+    // No session here: one engine per thread instead of rand()'s global
+    thread_local RngEngine engine;
+    return engine.nextDouble();
   }
   if (name == "ASIN") {
     return std::asin(args[0].d);
@@ -186,31 +192,85 @@ std::string evaluateStringFunction(const std::string &name,
 
 
 
-// BEEP statement — emit a bell character
-void executeBEEP(const std::string & /*line*/) {
-  std::cout << '\a' << std::flush;
+// BEEP statement — emit a bell character (flushed so it sounds now)
+void executeBEEP(PROGRAM_STRUCTURE &program, const std::string & /*line*/) {
+  basicWrite(program, "\a");
+  basicFlush(program);
+}
+
+// How many DEF lines of the program define FN<name>
+static int definitionCount(const PROGRAM_STRUCTURE &program,
+                           const std::string &name) {
+  static const std::regex head(R"(^\s*DEF\s+FN\s*([A-Z][A-Z0-9_]{0,31}))",
+                               std::regex::icase);
+  int count = 0;
+  std::smatch m;
+  for (const ProgramStatement &s : program.statements)
+    if (std::regex_search(s.code, m, head) && m[1] == name)
+      ++count;
+  return count;
 }
 
-// DEF FN<name>(<param>) = <expression>
-void executeDEF(const std::string &line) {
+// DEF FN<name>(<param> [, <param> ...]) = <expression> [CACHED]
+// The body is compiled on first call (exprvm.cpp). A DEF run again with
+// the same text keeps the compiled body and its cache; CACHED needs a
+// pure function of one parameter.
+void executeDEF(PROGRAM_STRUCTURE &program, const std::string &line) {
   static const std::regex rgx(
-      R"(^\s*DEF\s+FN([A-Z][A-Z0-9_]{0,31})\s*\(\s*([A-Z][A-Z0-9_]{0,31})\s*\)\s*=\s*(.+)$)",
+      R"(^\s*DEF\s+FN\s*([A-Z][A-Z0-9_]{0,31})\s*\(\s*([A-Z][A-Z0-9_]{0,31}(?:\s*,\s*[A-Z][A-Z0-9_]{0,31})*)\s*\)\s*=\s*(.+?)(\s+CACHED)?\s*$)",
       std::regex::icase);
   std::smatch m;
   if (!std::regex_match(line, m, rgx)) {
     throw std::runtime_error("SYNTAX ERROR: Invalid DEF: " + line);
   }
 
-  std::string name = m[1].str();  // function name
-  std::string param = m[2].str(); // single parameter
-  std::string expr = m[3].str();  // body expression
-
-  // Store or overwrite
-  program.userFunctions[name] = UserFunction{param, expr};
+  UserFunction fn;
+  fn.name = m[1].str();
+  std::stringstream ss(m[2].str());
+  std::string param;
+  while (std::getline(ss, param, ',')) {
+    param = trim(param);
+    if (std::find(fn.params.begin(), fn.params.end(), param) !=
+        fn.params.end())
+      throw std::runtime_error("SYNTAX ERROR: Parameter " + param +
+                               " repeated in DEF FN" + fn.name);
+    fn.params.push_back(param);
+  }
+  if (fn.params.size() > MAX_FN_PARAMS)
+    throw std::runtime_error("SYNTAX ERROR: DEF FN" + fn.name +
+                             " has more than " +
+                             std::to_string(MAX_FN_PARAMS) + " parameters");
+  fn.expr = m[3].str();
+  fn.cached = m[4].matched;
+  if (fn.cached && fn.params.size() != 1)
+    throw std::runtime_error("SYNTAX ERROR: CACHED FN" + fn.name +
+                             " must take one parameter");
+
+  auto old = program.userFunctions.find(fn.name);
+  if (old != program.userFunctions.end()) {
+    const UserFunction &f = old->second;
+    if (f.params == fn.params && f.expr == fn.expr && f.cached == fn.cached)
+      return;
+    // Compiled callers move that many arguments into its slots
+    if (f.params.size() != fn.params.size())
+      throw std::runtime_error("RUNTIME ERROR: FN" + fn.name +
+                               " redefined with a different parameter count");
+  }
+  fn.inlinable = definitionCount(program, fn.name) == 1;
+  UserFunction &stored = program.userFunctions[fn.name];
+  stored = std::move(fn);
+  if (stored.cached &&
+      (compileFunction(program, stored) != EXPR_COMPILED || !stored.pure)) {
+    std::string name = stored.name;
+    program.userFunctions.erase(name);
+    throw std::runtime_error("SYNTAX ERROR: CACHED FN" + name +
+                             " may only use its parameter");
+  }
 }
 
-void executeEND(const std::string &line) {
-  throw std::runtime_error("RUNTIME ERROR: END of program");
+// END halts the run loop; it is normal termination, not an error.
+void executeEND(PROGRAM_STRUCTURE &program, const std::string & /*line*/) {
+  program.running = false;
 }
 
 // Assumes you have a helper to eval an arithmetic expression to an int:
@@ -1,5 +1,7 @@
+#include "dispatch.h"
 #include "interpreter.h"
 #include "program_structure.h"
+#include <charconv>
 /*
 #include <cctype>
 #include <cmath>
@@ -15,10 +17,6 @@
 #include <string>
 */
 
-extern PROGRAM_STRUCTURE program;
-
-extern int currentLine;
-
 //std::map<std::string, VarInfo> variables;
 
 //
@@ -28,64 +26,72 @@ extern int currentLine;
 //
 // void evaluateMATExpression(const std::string &target,
 //                           const std::string &expression);
-extern void executeBEEP(const std::string &);
+extern void executeBEEP(PROGRAM_STRUCTURE &program, const std::string &);
 //extern void dispatchStatement(const std::string &);
 // void executeCLOSE(const std::string &line);
 // void executeDEF(const std::string &);
 // void executeDIM(const std::string &line);
-extern void executeFOR(const std::string &line);
-extern void executeFORMAT(const std::string &);
-extern void executeGO(const std::string &line);
-extern void executeGOTO(const std::string &line);
-extern void executeGOSUB(const std::string &line);
-extern void executeNEXT(const std::string &line);
+extern void executeFOR(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeFORMAT(PROGRAM_STRUCTURE &program, const std::string &);
+extern void executeGO(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeGOTO(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeGOSUB(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeNEXT(PROGRAM_STRUCTURE &program, const std::string &line);
 // void executeIF(const std::string &);
-extern void executeLET(const std::string &line);
-extern void executeREAD(const std::string &line);
-extern void executeRESTORE(const std::string &line);
-void executeMATops(const std::string &line);
+extern void executeLET(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeREAD(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeRESTORE(PROGRAM_STRUCTURE &program, const std::string &line);
+void executeMATops(PROGRAM_STRUCTURE &program, const std::string &line);
 // void executeMATPRINT(const std::string &line);
 // void executeMATPRINTFILE(const std::string &line);
 // void executeMATREAD(const std::string &line);
-extern void executeON(const std::string &line);
-extern void executeWEND(const std::string &line);
-extern void executeUNTIL(const std::string &line);
-extern void executeREPEAT(const std::string &line);
-extern void executeWHILE(const std::string &);
+extern void executeONERROR(PROGRAM_STRUCTURE &program,
+                           const std::string &line);
+extern void executeRESUME(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeWEND(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeUNTIL(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeREPEAT(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeWHILE(PROGRAM_STRUCTURE &program, const std::string &);
 // void executeOPEN(const std::string &line);
 // void executeREM(const std::string &);
 // void executeREPEAT(const std::string &);
 // void executeRETURN(const std::string &);
-extern void executeSEED(const std::string &line);
-extern void executeSTOP(const std::string &);
-extern void executeDATA(const std::string &);
-extern void executeDEF(const std::string &);
-extern void executeDIM(const std::string &);
-extern void executeRETURN(const std::string &);
+extern void executeSEED(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeSTOP(PROGRAM_STRUCTURE &program, const std::string &);
+extern void executeDATA(PROGRAM_STRUCTURE &program, const std::string &);
+extern void executeDEF(PROGRAM_STRUCTURE &program, const std::string &);
+extern void executeDIM(PROGRAM_STRUCTURE &program, const std::string &);
+extern void executeRETURN(PROGRAM_STRUCTURE &program, const std::string &);
 
 // void executeUNTIL(const std::string &line);
-extern  void executeEND(const std::string &);
+extern  void executeEND(PROGRAM_STRUCTURE &program, const std::string &);
 // void executeWHILE(const std::string &line);
 
-extern void executeFORMAT(const std::string &line);
-extern void executePRINTFILE(const std::string &line);
-extern void executeINPUTops(const std::string &line);
-extern void executeOPEN(const std::string &line);
-extern void executeCLOSE(const std::string &line);
+extern void executeFORMAT(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executePRINTFILE(PROGRAM_STRUCTURE &program,
+                             const std::string &line);
+extern void executeINPUTops(PROGRAM_STRUCTURE &program,
+                            const std::string &line);
+extern void executeOPEN(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeCLOSE(PROGRAM_STRUCTURE &program, const std::string &line);
 extern double evaluateFunction(const std::string &name,
                                const std::vector<ArgsInfo> &args);
 extern std::string evaluateStringFunction(const std::string &name,
                                           const std::vector<ArgsInfo> &args);
-extern void executeINPUT(const std::string &line);
-extern void executeINPUTFILE(const std::string &line);
-extern void executePRINTexpr(const std::string &line);
-extern void executePRINTFILEUSING(const std::string &line);
+extern void executeINPUT(PROGRAM_STRUCTURE &program, const std::string &line);
+extern void executeINPUTFILE(PROGRAM_STRUCTURE &program,
+                             const std::string &line);
+extern void executePRINTexpr(PROGRAM_STRUCTURE &program,
+                             const std::string &line);
+extern void executePRINTFILEUSING(PROGRAM_STRUCTURE &program,
+                                  const std::string &line);
 // extern ArgsInfo makeArgsInfo(long long line, std::string idname, bool
 // boolstring = false, std::string str = "", double d = 0.0);
-extern void executeMATPRINT(const std::string &line,
-                            std::ostream &out = std::cout);
-extern void executeMATPRINTFILE(const std::string &line);
-extern void executeMAT(const std::string &line);
+extern void executeMATPRINT(PROGRAM_STRUCTURE &program,
+                            const std::string &line);
+extern void executeMATPRINTFILE(PROGRAM_STRUCTURE &program,
+                                const std::string &line);
+extern void executeMAT(PROGRAM_STRUCTURE &program, const std::string &line);
 
 
 //
@@ -94,222 +100,550 @@ extern void executeMAT(const std::string &line);
 //
 
 /**
- * dispatchStatement
+ * IF handler: single‐line IF…THEN
  *
- * Given a single BASIC statement (without its line number),
- * invoke the appropriate executeXXX handler.
+ * Syntax: IF <expression> THEN <statement>
+ *         IF <expression> THEN <line>
+ * Evaluates the expression; if non-zero, executes the trailing statement
+ * (a bare line number is a GOTO).
  */
-void dispatchStatement(const std::string &stmt) {
-  // Extract the first word (keyword)
-  std::istringstream iss(stmt);
-  std::string kw;
-  iss >> kw;
-  // Uppercase it
-  std::transform(kw.begin(), kw.end(), kw.begin(),
-                 [](unsigned char c) { return std::toupper(c); });
-
-  if (kw == "LET") {
-    executeLET(stmt);
-  }
-  //   else if (kw == "DEF") {
-  //        executeDEF(stmt);
-  //    }
-  //    else if (kw == "DIM") {
-  //        executeDIM(stmt);
-  //   }
-  //    else if (kw == "DATA") {
-  //        executeDATA(stmt);
-  //    }
-  else if (kw == "READ") {
-    executeREAD(stmt);
-  } else if (kw == "RESTORE") {
-    executeRESTORE(stmt);
-  } else if (kw == "PRINT") {
-    executePRINTexpr(stmt);
-  } else if (kw == "INPUT") {
-    executeINPUTops(stmt);
-  } else if (kw == "GOTO") {
-    executeGOTO(stmt);
-  } else if (kw == "GOSUB") {
-    executeGOSUB(stmt);
+size_t skipBlanks(const std::string &text, size_t pos) {
+  while (pos < text.size() &&
+         std::isspace(static_cast<unsigned char>(text[pos])))
+    ++pos;
+  return pos;
+}
+
+size_t matchWord(const std::string &text, size_t pos, const char *word) {
+  for (; *word; ++word, ++pos)
+    if (pos >= text.size() ||
+        std::toupper(static_cast<unsigned char>(text[pos])) != *word)
+      return std::string::npos;
+  return pos;
+}
+
+bool sameName(std::string_view id, const char *name) {
+  size_t i = 0;
+  for (; name[i]; ++i)
+    if (i >= id.size() ||
+        std::toupper(static_cast<unsigned char>(id[i])) != name[i])
+      return false;
+  return i == id.size();
+}
+
+// Line number after GOTO, GOSUB or THEN: white space, digits and optional
+// trailing white space from `pos` to the end of `text`; -1 otherwise.
+static int targetLine(const std::string &text, size_t pos) {
+  if (pos >= text.size() ||
+      !std::isspace(static_cast<unsigned char>(text[pos])))
+    return -1;
+  size_t digits = skipBlanks(text, pos), end = digits;
+  while (end < text.size() &&
+         std::isdigit(static_cast<unsigned char>(text[end])))
+    ++end;
+  if (end == digits || skipBlanks(text, end) != text.size())
+    return -1;
+  return std::atoi(text.c_str() + digits);
+}
+
+static void jumpToLine(PROGRAM_STRUCTURE &program, int target);
+
+// A false IF also skips the statements after it on its line.
+static void skipRestOfLine(PROGRAM_STRUCTURE &program) {
+  const std::vector<ProgramStatement> &st = program.statements;
+  int last = program.currentStatement;
+  while (last + 1 < static_cast<int>(st.size()) &&
+         st[last + 1].line == program.currentLine)
+    ++last;
+  if (last != program.currentStatement)
+    jumpAfter(program, last);
+}
+
+void executeIF(PROGRAM_STRUCTURE &program, const std::string &line) {
+  // IF <expr> THEN <stmt>: the condition ends at the first THEN with
+  // white space on both sides and something after it.
+  size_t cond = matchWord(line, skipBlanks(line, 0), "IF");
+  if (cond == std::string::npos || cond == line.size() ||
+      !std::isspace(static_cast<unsigned char>(line[cond])))
+    throw std::runtime_error("SYNTAX ERROR: Invalid IF syntax: " + line);
+  cond = skipBlanks(line, cond);
+  size_t condEnd = cond + 1, stmt = std::string::npos;
+  for (; condEnd < line.size(); ++condEnd) {
+    if (!std::isspace(static_cast<unsigned char>(line[condEnd])))
+      continue;
+    size_t then = matchWord(line, skipBlanks(line, condEnd), "THEN");
+    if (then != std::string::npos && then < line.size() &&
+        std::isspace(static_cast<unsigned char>(line[then])) &&
+        (stmt = skipBlanks(line, then)) < line.size())
+      break;
+    stmt = std::string::npos;
   }
-/*   else if (kw == "RETURN") {
-          executeRETURN(stmt);
-      }
-      else if (kw == "ON") {
-          executeON(stmt);
-      }
-      else if (kw == "IF") {
-          executeIF(stmt);
-      }
-      else if (kw == "FOR") {
-          executeFOR(stmt);
-      }
-      else if (kw == "NEXT") {
-          executeNEXT(stmt);
-      }
-      else if (kw == "WHILE") {
-          executeWHILE(stmt);
-      }
-      else if (kw == "WEND") {
-          executeWEND(stmt);
-      }
-      else if (kw == "REPEAT") {
-         executeREPEAT(stmt);
-      }
-      else if (kw == "UNTIL") {
-          executeUNTIL(stmt);
-      }
-*/
+  if (stmt == std::string::npos)
+    throw std::runtime_error("SYNTAX ERROR: Invalid IF syntax: " + line);
 
-  else if (kw == "MAT") {
-    executeMATops(stmt);
-  } else if (kw == "SEED") {
-    executeSEED(stmt);
-  } else if (kw == "STOP") {
-    executeSTOP(stmt);
-  } else if (kw == "END") {
-    executeEND(stmt);
+  // Condition and statement go through string temps, which keep their
+  // capacity from one pass to the next
+  StringTempScope scope(program.stringTemps);
+  std::string &expr = program.stringTemps.next();
+  expr.assign(line, cond, condEnd - cond);
+  if (evalExpression(program, expr) == 0.0) {
+    skipRestOfLine(program);
+    return;
   }
-/*      else if (kw == "FORMAT") {
-          executeFORMAT(stmt);
-      }
-*/
-  else {
-    throw std::runtime_error("SYNTAX ERROR: Unknown statement: " + kw + ":" +
-                             stmt);
+  int target = targetLine(line, stmt - 1);
+  if (target >= 0) {
+    jumpToLine(program, target);
+    return;
   }
+  // Run the embedded statement (GO TO 100, PRINT "Hi", RETURN, ...) as
+  // it would run on a line of its own
+  std::string &then = program.stringTemps.next();
+  then.assign(line, stmt, std::string::npos);
+  executeStatement(program, classifyStatement(then), then);
 }
 
-/**
- * IF handler: single‐line IF…THEN
- *
- * Syntax: IF <expression> THEN <statement>
- * Evaluates the expression; if non-zero, executes the trailing statement.
- */
-void executeIF(const std::string &line) {
-  static const std::regex rgx(R"(^\s*IF\s+(.+?)\s+THEN\s+(.+)$)",
-                              std::regex::icase);
-  std::smatch m;
-  if (!std::regex_match(line, m, rgx)) {
-    throw std::runtime_error("SYNTAX ERROR: Invalid IF syntax: " + line);
-  }
+// The variable `name` of `vars`, created on first assignment; looked up by
+// a view of the statement text.
+static VarInfo &
+assignedVariable(std::pmr::map<std::string, VarInfo, std::less<>> &vars,
+                 std::string_view name) {
+  auto it = vars.find(name);
+  if (it == vars.end())
+    it = vars.emplace(std::string(name), VarInfo()).first;
+  return it->second;
+}
 
-  std::string expr = m[1].str();
-  std::string stmt = m[2].str();
+// LET statement: LET <var> = <expr>
+// Scanned and evaluated in place, so assigning to an existing variable
+// does not allocate.
+void executeLET(PROGRAM_STRUCTURE &program, const std::string &line) {
+  size_t name = matchWord(line, skipBlanks(line, 0), "LET");
+  if (name != std::string::npos && name < line.size() &&
+      std::isspace(static_cast<unsigned char>(line[name])))
+    name = skipBlanks(line, name);
+  else
+    name = std::string::npos;
+  if (name >= line.size() ||
+      !std::isalpha(static_cast<unsigned char>(line[name])))
+    throw std::runtime_error("SYNTAX ERROR: Invalid LET syntax: " + line);
+  size_t end = name + 1;
+  while (end < line.size() && end - name < 32 &&
+         (std::isalnum(static_cast<unsigned char>(line[end])) ||
+          line[end] == '_'))
+    ++end;
+  std::string_view varName(line.data() + name, end - name);
+  bool isString = end < line.size() && line[end] == '$';
+  size_t pos = skipBlanks(line, end + isString);
+  if (pos >= line.size() || line[pos] != '=' ||
+      (pos = skipBlanks(line, pos + 1)) >= line.size())
+    throw std::runtime_error("SYNTAX ERROR: Invalid LET syntax: " + line);
 
-  // Evaluate the condition
-  double cond = evalExpression(expr);
-  if (cond != 0.0) {
-    // Dispatch the embedded statement (e.g. GOTO 100, PRINT "Hi", etc.)
-    dispatchStatement(stmt);
+  if (isString) {
+    // Flatten into a temp first: the value may view the variable itself
+    StringTempScope scope(program.stringTemps);
+    size_t expr = pos;
+    StrValue val = evalStringValueAt(program, line, pos);
+    if (pos != line.size())
+      throw std::runtime_error("Invalid string expression: " +
+                               line.substr(expr));
+    std::string &flat = program.stringTemps.next();
+    val.appendTo(flat);
+    VarInfo &slot = assignedVariable(program.stringVariables, varName);
+    slot.stringValue.swap(flat);
+    slot.isString = true;
+  } else {
+    // Evaluate as numeric expression
+    double val = evalExpressionFrom(program, line, pos);
+    VarInfo &slot = assignedVariable(program.numericVariables, varName);
+    slot.numericValue = val;
+    slot.isString = false;
   }
 }
 
-// LET statement: LET <var> = <expr>
-void executeLET(const std::string &line) {
+void executeREM(PROGRAM_STRUCTURE & /*program*/, const std::string &line) {
+  std::string mivic = line;
+}
+
+// SEED <unsigned-integer> [, <stream>]
+// Parentheses are optional. Stream k of a seed is the generator jumped
+// k * 2^128 draws ahead, for parallel runs that must not overlap.
+void executeSEED(PROGRAM_STRUCTURE &program, const std::string &line) {
   static const std::regex rgx(
-      R"(^\s*LET\s+([A-Z][A-Z0-9_]{0,31}\$?)\s*=\s*(.+)$)", std::regex::icase);
+      R"(^\s*SEED\s*\(?\s*(\d+)\s*(?:,\s*(\d+)\s*)?\)?\s*$)",
+      std::regex::icase);
   std::smatch m;
   if (!std::regex_match(line, m, rgx)) {
-    throw std::runtime_error("SYNTAX ERROR: Invalid LET syntax: " + line);
+    throw std::runtime_error("SYNTAX ERROR: Invalid SEED: " + line);
   }
+  uint64_t seed = std::stoull(m[1].str());
+  uint64_t stream = m[2].matched ? std::stoull(m[2].str()) : 0;
+  program.rng.seed(seed, stream);
+  program.seedValue = static_cast<int>(seed);
+}
+
+// STOP halts like END and says where
+void executeSTOP(PROGRAM_STRUCTURE &program, const std::string & /*line*/) {
+  basicWrite(program,
+             "STOP at line " + std::to_string(program.currentLine) + "\n");
+  program.running = false;
+}
 
-  std::string varName = m[1].str();
-  bool isString = false;
-  if (!varName.empty() && varName.back() == '$') {
-    isString = true;
-    varName.pop_back();
+// Helper to find a line in programSource or throw
+static std::map<int, std::string>::const_iterator
+findLine(PROGRAM_STRUCTURE &program, int ln) {
+  auto it = program.programSource.find(ln);
+  if (it == program.programSource.end())
+    throw std::runtime_error("RUNTIME ERROR: Undefined line " +
+                             std::to_string(ln));
+  return it;
+}
+
+// —————————————————————————————————————————————
+// GOTO <n>
+// —————————————————————————————————————————————
+static void jumpToLine(PROGRAM_STRUCTURE &program, int target) {
+  findLine(program, target);
+  unwindLoops(program, statementIndex(program, target));
+  program.nextLineNumber = target;
+  program.nextLineNumberSet = true;
+}
+
+void executeGOTO(PROGRAM_STRUCTURE &program, const std::string &line) {
+  size_t pos = matchWord(line, skipBlanks(line, 0), "GO");
+  if (pos != std::string::npos)
+    pos = matchWord(line, skipBlanks(line, pos), "TO");
+  int target = pos == std::string::npos ? -1 : targetLine(line, pos);
+  if (target < 0)
+    throw std::runtime_error("SYNTAX ERROR: Invalid GOTO: " + line);
+  jumpToLine(program, target);
+}
+
+// —————————————————————————————————————————————
+// GOSUB <n>
+// Pushes the GOSUB's own statement; RETURN resumes at the one after it.
+// —————————————————————————————————————————————
+void executeGOSUB(PROGRAM_STRUCTURE &program, const std::string &line) {
+  size_t pos = matchWord(line, skipBlanks(line, 0), "GOSUB");
+  int target = pos == std::string::npos ? -1 : targetLine(line, pos);
+  if (target < 0)
+    throw std::runtime_error("SYNTAX ERROR: Invalid GOSUB: " + line);
+  findLine(program, target);
+
+  program.frames.push({FRAME_GOSUB, program.currentLine,
+                       program.currentStatement, -1, nullptr, 0, 0});
+  program.nextLineNumber = target;
+  program.nextLineNumberSet = true;
+}
+
+// —————————————————————————————————————————————
+// ON <expr> GOTO|GOSUB <n1>, <n2>, ...
+// Parsed once into a jump table (buildJumpTables); a selector out of
+// range falls through to the next statement.
+// —————————————————————————————————————————————
+bool parseON(const std::string &code, JumpTable &table) {
+  static const std::regex rgx(
+      R"(^\s*ON\s+(.+?)\s+(GO\s*TO|GOSUB)\s+(\d+(?:\s*,\s*\d+)*)\s*$)",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(code, m, rgx))
+    return false;
+  table.selector = m[1].str();
+  table.gosub = std::toupper(static_cast<unsigned char>(m[2].str()[2])) == 'S';
+  table.lines.clear();
+  table.targets.clear();
+  const char *p = code.data() + m.position(3);
+  const char *end = p + m.length(3);
+  while (p < end) {
+    int line = 0;
+    p = std::from_chars(p, end, line).ptr;
+    table.lines.push_back(line);
+    while (p < end && !std::isdigit(static_cast<unsigned char>(*p)))
+      ++p; // blanks and the comma
   }
+  return true;
+}
 
-  std::string expr = m[2].str();
-  if (isString) {
-    // Evaluate as string expression
-    std::string val = evalStringExpression(expr);
-    VarInfo &slot = program.stringVariables[varName];
-    slot.stringValue = val;
-    slot.isString = true;
+static void compileJumpTable(const PROGRAM_STRUCTURE &program,
+                             JumpTable &table) {
+  for (int line : table.lines)
+    table.targets.push_back(statementIndex(program, line));
+}
+
+void buildJumpTables(PROGRAM_STRUCTURE &program) {
+  program.jumpTables.clear();
+  const std::vector<ProgramStatement> &st = program.statements;
+  JumpTable table;
+  for (int i = 0; i < static_cast<int>(st.size()); ++i)
+    if (classifyStatement(st[i].code) == ST_ON && parseON(st[i].code, table)) {
+      compileJumpTable(program, table);
+      program.jumpTables[i] = std::move(table);
+    }
+}
+
+void executeON(PROGRAM_STRUCTURE &program, const std::string &line) {
+  const JumpTable *table;
+  JumpTable uncached; // a line run outside the program
+  auto it = program.jumpTables.find(program.currentStatement);
+  if (it != program.jumpTables.end()) {
+    table = &it->second;
   } else {
-    // Evaluate as numeric expression
-    double val = evalExpression(expr);
-    VarInfo &slot = program.numericVariables[varName];
-    slot.numericValue = val;
-    slot.isString = false;
+    if (!parseON(line, uncached))
+      throw std::runtime_error("SYNTAX ERROR: Invalid ON: " + line);
+    compileJumpTable(program, uncached);
+    table = &uncached;
+  }
+
+  size_t n = table->targets.size();
+  size_t i = jumpIndex(evalExpression(program, table->selector), n);
+  if (i == n)
+    return;
+  int target = table->targets[i];
+  if (target < 0)
+    throw std::runtime_error("RUNTIME ERROR: Undefined line " +
+                             std::to_string(table->lines[i]));
+  if (table->gosub)
+    program.frames.push({FRAME_GOSUB, program.currentLine,
+                         program.currentStatement, -1, nullptr, 0, 0});
+  else
+    unwindLoops(program, target);
+  program.nextStatement = target;
+  program.nextStatementSet = true;
+}
+
+// —————————————————————————————————————————————
+// RETURN
+// Also drops loops left open inside the subroutine.
+// —————————————————————————————————————————————
+void executeRETURN(PROGRAM_STRUCTURE &program, const std::string & /*line*/) {
+  FrameStack &frames = program.frames;
+  while (!frames.empty() && frames.top().kind != FRAME_GOSUB)
+    frames.pop();
+  if (frames.empty())
+    throw std::runtime_error("RUNTIME ERROR: RETURN without GOSUB");
+  int gosub = frames.top().statement;
+  frames.pop();
+  jumpAfter(program, gosub);
+}
+
+// Continue at the statement after `statement`, or stop when it is the last.
+void jumpAfter(PROGRAM_STRUCTURE &program, int statement) {
+  if (statement + 1 >= static_cast<int>(program.statements.size())) {
+    program.running = false;
+    return;
   }
+  program.nextStatement = statement + 1;
+  program.nextStatementSet = true;
 }
+
+// True when expr starts with a string literal or a NAME$ variable/function.
+static bool isStringExpression(const std::string &expr) {
+  size_t pos = expr.find_first_not_of(" \t");
+  if (pos == std::string::npos)
+    return false;
+  if (expr[pos] == '"')
+    return true;
+  while (pos < expr.size() && (std::isalnum(expr[pos]) || expr[pos] == '_'))
+    ++pos;
+  return pos < expr.size() && expr[pos] == '$';
+}
+
+// Split a PRINT list on top-level ';' and ',' (outside quotes and parens).
+// Each item is returned with the separator that followed it (0 at the end).
+static std::vector<std::pair<std::string, char>>
+splitPrintItems(const std::string &list) {
+  std::vector<std::pair<std::string, char>> items;
+  std::string current;
+  int depth = 0;
+  bool inQuote = false;
+  for (char c : list) {
+    if (c == '"')
+      inQuote = !inQuote;
+    if (!inQuote) {
+      if (c == '(')
+        ++depth;
+      else if (c == ')')
+        --depth;
+      else if ((c == ';' || c == ',') && depth == 0) {
+        items.push_back({trim(current), c});
+        current.clear();
+        continue;
+      }
+    }
+    current += c;
+  }
+  if (!trim(current).empty())
+    items.push_back({trim(current), 0});
+  return items;
+}
+
 // FORMAT statement: defines a format string for PRINT USING
-// Syntax:  <line> := "format-spec"
+// Syntax:  <line> [<label>] := "format-spec"
 // e.g.    100 := "###,###.###   lllllllllll   cccccc    rrrrrrr"
-// Corrected executeFORMAT regex with proper raw string delimiter
-static const std::regex rgx(R"FMT(^\s*(\d+)\s*:=\s*"([^"]*)"\s*$)FMT",
-                            std::regex::icase);
+// PRINT USING refers to the label, or to the line number when there is none.
+static const std::regex formatRgx(R"FMT(^\s*(\d*)\s*:=\s*"([^"]*)"\s*$)FMT");
 
-// PRINT USING handler
-// Syntax: PRINT USING <formatLine> <var1>,<var2$>,...
-// Optional output stream overload
+// Compile the format line `code` (at source line `ln`) into the cache.
+static const CompiledFormat &compileFormatLine(PROGRAM_STRUCTURE &program,
+                                               int ln,
+                                               const std::string &code) {
+  std::smatch m;
+  if (!std::regex_match(code, m, formatRgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid format line: " + code);
+  int key = m[1].length() ? std::stoi(m[1].str()) : ln;
+  return program.printUsingFormats[key] = compileFormat(m[2].str());
+}
 
-void executeREM(const std::string &line) { std::string mivic = line; }
+// Executing a format line just (re)compiles it; it prints nothing.
+void executeFORMAT(PROGRAM_STRUCTURE &program, const std::string &line) {
+  compileFormatLine(program, program.currentLine, line);
+}
 
-// SEED <unsigned-integer>
-void executeSEED(const std::string &line) {
-  static const std::regex rgx(R"(^\s*SEED\s+(\d+)\s*$)", std::regex::icase);
+// Cached format for PRINT USING n: line n itself, else a line labelled n.
+static const CompiledFormat &usingFormat(PROGRAM_STRUCTURE &program, int n) {
+  auto cached = program.printUsingFormats.find(n);
+  if (cached != program.printUsingFormats.end())
+    return cached->second;
+  auto it = program.programSource.find(n);
+  if (it != program.programSource.end())
+    return compileFormatLine(program, n, it->second);
   std::smatch m;
-  if (!std::regex_match(line, m, rgx)) {
-    throw std::runtime_error("SYNTAX ERROR: Invalid SEED: " + line);
+  for (const auto &src : program.programSource)
+    if (std::regex_match(src.second, m, formatRgx) && m[1].length() &&
+        std::stoi(m[1].str()) == n)
+      return compileFormatLine(program, src.first, src.second);
+  throw std::runtime_error("RUNTIME ERROR: Format line " + std::to_string(n) +
+                           " not found");
+}
+
+// PRINT [#n[,]] USING <format>, expr {, expr}
+// Values fill the format's numeric/string fields in order; the output ends
+// with a newline unless the list ends with ';'.
+static void printUsing(PROGRAM_STRUCTURE &program, std::string &out,
+                       int format, const std::string &list) {
+  const CompiledFormat &fmt = usingFormat(program, format);
+  auto items = splitPrintItems(list);
+  if (items.size() < fmt.valueCount)
+    throw std::runtime_error("RUNTIME ERROR: PRINT USING needs " +
+                             std::to_string(fmt.valueCount) + " values");
+  size_t next = 0;
+  for (const FormatField &f : fmt.fields) {
+    if (f.type == FIELD_TEXT)
+      out += f.text;
+    else if (f.type == FIELD_NUMERIC)
+      renderNumericField(out, f, evalExpression(program, items[next++].first));
+    else
+      renderStringField(out, f,
+                        evalStringExpression(program, items[next++].first));
   }
-  unsigned int seed = static_cast<unsigned int>(std::stoul(m[1].str()));
-  std::srand(seed);
-  program.seedValue = seed;
+  if (items.empty() || items.back().second != ';')
+    out += '\n';
 }
 
-void executeSTOP(const std::string &line) {
-  throw std::runtime_error("RUNTIME ERROR: STOP encountered");
+// PRINT [#n,] [item {;|, item}] [;|,]
+// ';' joins items directly, ',' advances to the next 14-column print zone
+// of the output line (which may have been started by an earlier PRINT), and
+// a trailing separator suppresses the newline. Each number is followed by a
+// blank, so "PRINT -2.5; 3" gives "-2.5 3 ". PRINT #n writes to the
+// channel's buffer instead of the console.
+void executePRINTexpr(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(
+      R"(^\s*PRINT\b\s*(?:#\s*(\d+)\s*[,;]?)?\s*(?:USING\s+(\d+)\s*[,;]?)?(.*)$)",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid PRINT: " + line);
+
+  OutputBuffer &dest = m[1].matched
+                           ? channelOutput(program, std::stoi(m[1].str()))
+                           : program.console;
+  std::string out;
+  if (m[2].matched) {
+    printUsing(program, out, std::stoi(m[2].str()), m[3].str());
+  } else {
+    char lastSep = 0;
+    for (const auto &item : splitPrintItems(m[3].str())) {
+      if (!item.first.empty()) {
+        if (isStringExpression(item.first)) {
+          StringTempScope scope(program.stringTemps);
+          evalStringValue(program, item.first).appendTo(out);
+        } else {
+          appendNumber(out, evalExpression(program, item.first));
+          out += ' ';
+        }
+      }
+      lastSep = item.second;
+      if (lastSep == ',')
+        out.append(14 - dest.columnAfter(out) % 14, ' ');
+    }
+    if (lastSep == 0)
+      out += '\n';
+  }
+  if (m[1].matched)
+    dest.write(out);
+  else
+    basicWrite(program, out);
+}
+
+// INPUT ["prompt";] var {, var}
+// Reads comma-separated values, prompting with "??" until all are filled.
+void executeINPUTops(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(
+      R"RX(^\s*INPUT\s+(?:"([^"]*)"\s*[;,]\s*)?([A-Z][A-Z0-9_]{0,31}\$?(?:\s*,\s*[A-Z][A-Z0-9_]{0,31}\$?)*)\s*$)RX",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid INPUT: " + line);
+
+  std::vector<std::string> vars;
+  std::stringstream ss(m[2].str());
+  std::string tok;
+  while (std::getline(ss, tok, ','))
+    vars.push_back(trim(tok));
+
+  basicWrite(program, m[1].str() + "? ");
+  std::vector<std::string> values;
+  while (values.size() < vars.size()) {
+    std::string reply;
+    if (!basicReadLine(program, reply))
+      throw std::runtime_error("RUNTIME ERROR: INPUT past end of input");
+    std::stringstream rs(reply);
+    while (std::getline(rs, tok, ','))
+      values.push_back(trim(tok));
+    if (values.size() < vars.size())
+      basicWrite(program, "?? ");
+  }
+
+  for (size_t i = 0; i < vars.size(); ++i) {
+    std::string name = vars[i];
+    if (name.back() == '$') {
+      name.pop_back();
+      VarInfo &slot = program.stringVariables[name];
+      slot.stringValue = values[i];
+      slot.isString = true;
+    } else {
+      VarInfo &slot = program.numericVariables[name];
+      try {
+        slot.numericValue = std::stod(values[i]);
+      } catch (const std::exception &) {
+        throw std::runtime_error("RUNTIME ERROR: INPUT expects a number for " +
+                                 name + ": " + values[i]);
+      }
+      slot.isString = false;
+    }
+  }
 }
 // ========================= Dispatcher =========================
 
-enum StatementType {
-  ST_UNKNOWN,
-  ST_LET,
-  ST_PRINTexpr,
-  ST_INPUTops,
-  ST_GOTO,
-  ST_IF,
-  ST_FOR,
-  ST_NEXT,
-  ST_READ,
-  ST_DATA,
-  ST_RESTORE,
-  ST_DEF,
-  ST_DIM,
-  ST_REM,
-  ST_STOP,
-  ST_GOSUB,
-  ST_RETURN,
-  ST_END,
-  ST_ON,
-  ST_PRINTFILEUSING,
-  ST_MATops,
-  ST_FORMAT,
-  ST_BEEP,
-  ST_OPEN,
-  ST_CLOSE,
-  ST_PRINT,
-  ST_WHILE,
-  ST_WEND,
-  ST_REPEAT,
-  ST_UNTIL,
-  ST_SEED,
-  ST_MATREAD
-};
-
-StatementType identifyStatement(const std::string &keyword) {
+static StatementType identifyStatement(const std::string &keyword) {
   if (keyword == "LET")
     return ST_LET;
   if (keyword == "PRINT" || keyword == "PRINT#")
     return ST_PRINTexpr;
-  if (keyword == "INPUT" || keyword == "INPUT#")
+  if (keyword == "INPUT")
     return ST_INPUTops;
-  if (keyword == "GOTO")
+  if (keyword == "INPUT#")
+    return ST_INPUTFILE;
+  if (keyword == "GOTO" || keyword == "GO")
     return ST_GOTO;
   if (keyword == "IF")
     return ST_IF;
@@ -345,9 +679,9 @@ StatementType identifyStatement(const std::string &keyword) {
     return ST_FORMAT;
   if (keyword == "BEEP")
     return ST_BEEP;
-  if (keyword == "OPEN")
+  if (keyword == "OPEN" || keyword == "OPEN#")
     return ST_OPEN;
-  if (keyword == "CLOSE")
+  if (keyword == "CLOSE" || keyword == "CLOSE#")
     return ST_CLOSE;
   if (keyword == "WHILE")
     return ST_WHILE;
@@ -359,112 +693,376 @@ StatementType identifyStatement(const std::string &keyword) {
     return ST_UNTIL;
   if (keyword == "SEED")
     return ST_SEED;
+  if (keyword == "FLUSH" || keyword == "FLUSH#")
+    return ST_FLUSH;
+  if (keyword == "TRACE")
+    return ST_TRACE;
+  if (keyword == "RESUME")
+    return ST_RESUME;
   return ST_UNKNOWN;
 }
 
-void runInterpreter(PROGRAM_STRUCTURE &program) {
+// Leading keyword of a statement: its run of letters (plus the '#' of
+// PRINT#/INPUT#), or the first token for ":=" format lines.
+static std::string statementKeyword(const std::string &code) {
+  size_t pos = code.find_first_not_of(" \t");
+  if (pos == std::string::npos)
+    return "";
+  if (!std::isalpha(static_cast<unsigned char>(code[pos]))) {
+    size_t op = code.find_first_not_of("0123456789 \t", pos);
+    if (op != std::string::npos && code.compare(op, 2, ":=") == 0)
+      return ":="; // format line, optionally labelled
+    std::istringstream iss(code);
+    std::string token;
+    iss >> token;
+    return token;
+  }
+  std::string keyword;
+  while (pos < code.size() &&
+         std::isalpha(static_cast<unsigned char>(code[pos])))
+    keyword += static_cast<char>(std::toupper(code[pos++]));
+  size_t hash = code.find_first_not_of(" \t", pos);
+  if (hash != std::string::npos && code[hash] == '#')
+    keyword += '#';
+  return keyword;
+}
+
+StatementType classifyStatement(const std::string &code) {
+  static const std::regex onError(R"(^\s*ON\s+ERROR\b)", std::regex::icase);
+  StatementType kind = identifyStatement(statementKeyword(code));
+  if (kind == ST_ON && std::regex_search(code, onError))
+    return ST_ON_ERROR;
+  return kind;
+}
+
+// True when a statement starts with REM (which keeps any '\' after it)
+static bool isRemark(const std::string &text, size_t pos) {
+  return classifyStatement(text.substr(pos)) == ST_REM;
+}
+
+std::vector<std::string> splitStatements(const std::string &text) {
+  std::vector<std::string> parts;
+  if (text.find('\\') == std::string::npos) {
+    parts.push_back(text);
+    return parts;
+  }
+  for (size_t start = 0; start <= text.size();) {
+    if (isRemark(text, start)) {
+      parts.push_back(trim(text.substr(start)));
+      break;
+    }
+    size_t end = start;
+    bool quoted = false;
+    for (; end < text.size() && (quoted || text[end] != '\\'); ++end)
+      if (text[end] == '"')
+        quoted = !quoted;
+    std::string part = trim(text.substr(start, end - start));
+    if (!part.empty())
+      parts.push_back(part);
+    start = end + 1;
+  }
+  if (parts.empty())
+    parts.push_back(text);
+  return parts;
+}
+
+// `X = 1` stands for `LET X = 1`, also after THEN
+static void addImplicitLet(std::string &code) {
+  static const std::regex implicitLet(R"(^\s*[A-Z][A-Z0-9_]{0,31}\$?\s*=)",
+                                      std::regex::icase);
+  static const std::regex ifThen(R"(^(\s*IF\s+.+?\s+THEN\s+)(.+)$)",
+                                 std::regex::icase);
+  StatementType type = classifyStatement(code);
+  if (type == ST_UNKNOWN && std::regex_search(code, implicitLet)) {
+    code.insert(0, "LET ");
+  } else if (type == ST_IF) {
+    std::smatch m;
+    if (std::regex_match(code, m, ifThen)) {
+      std::string then = m[2].str();
+      addImplicitLet(then);
+      code = m[1].str() + then;
+    }
+  }
+}
+
+void buildStatementTable(PROGRAM_STRUCTURE &program) {
+  program.statements.clear();
   for (const auto &entry : program.programSource) {
-    auto linenum = entry.first;
-    auto code2 = entry.second;
-    std::string code = code2;
-
-    {
-      std::cout << "Executing line " << linenum << ": " << code << std::endl;
-      // TODO: Add interpreter logic here
-      std::string keyword = code.substr(code.find(" "));
-      std::cout << "keyword(" << keyword << ")" << std::endl;
-
-      StatementType stmt = identifyStatement(keyword);
-      switch (stmt) {
-      case ST_PRINTFILEUSING:
-        executePRINTexpr(code);
-      case ST_LET:
-        executeLET(code);
-        break;
-      case ST_PRINTexpr:
-        executePRINTexpr(code);
-        break;
-      case ST_INPUTops:
-        executeINPUTops(code);
-        break;
-      case ST_GOTO:
-        executeGOTO(code);
-        break;
-      case ST_IF:
-        executeIF(code);
-        break;
-      case ST_FOR:
-        executeFOR(code);
-        break;
-      case ST_NEXT:
-        executeNEXT(code);
-        break;
-      case ST_READ:
-        executeREAD(code);
-        break;
-      case ST_DATA:
-        executeDATA(code);
-        break;
-      case ST_RESTORE:
-        executeRESTORE(code);
-        break;
-      case ST_END:
-        executeEND(code);
-        break;
-      case ST_DEF:
-        executeDEF(code);
-        break;
-      case ST_DIM:
-        executeDIM(code);
-        break;
-      case ST_REM:
-        executeREM(code);
-        break;
-      case ST_STOP:
-        executeSTOP(code);
-        break;
-      case ST_GOSUB:
-        executeGOSUB(code);
-        break;
-      case ST_RETURN:
-        executeRETURN(code);
-        break;
-      case ST_ON:
-        executeON(code);
-        break;
-      case ST_MATops:
-        executeMATops(code);
-        break;
-      case ST_FORMAT:
-        executeFORMAT(code);
-        break;
-      case ST_BEEP:
-        executeBEEP(code);
-        break;
-      case ST_OPEN:
-        executeOPEN(code);
-        break;
-      case ST_CLOSE:
-        executeCLOSE(code);
-        break;
-      case ST_WHILE:
-        executeWHILE(code);
-        break;
-      case ST_WEND:
-        executeWEND(code);
-        break;
-      case ST_REPEAT:
-        executeREPEAT(code);
-        break;
-      case ST_UNTIL:
-        executeUNTIL(code);
-        break;
-      case ST_SEED:
-        executeSEED(code);
-        break;
-      default:
-        std::runtime_error("Unhandled statement: " + code);
+    size_t from = 0;
+    for (std::string &code : splitStatements(entry.second)) {
+      size_t at = entry.second.find(code, from);
+      if (at != std::string::npos)
+        from = at + code.size();
+      int column = at != std::string::npos ? static_cast<int>(at) + 1 : 1;
+      addImplicitLet(code);
+      program.statements.push_back({entry.first, std::move(code), column});
+    }
+  }
+}
+
+int statementIndex(const PROGRAM_STRUCTURE &program, int line) {
+  const std::vector<ProgramStatement> &st = program.statements;
+  auto it = std::lower_bound(
+      st.begin(), st.end(), line,
+      [](const ProgramStatement &s, int n) { return s.line < n; });
+  return it != st.end() && it->line == line ? static_cast<int>(it - st.begin())
+                                            : -1;
+}
+
+void moveToLine(PROGRAM_STRUCTURE &program, int line) {
+  int i = statementIndex(program, line);
+  if (i < 0)
+    throw std::runtime_error("RUNTIME ERROR: Undefined line " +
+                             std::to_string(line));
+  moveToStatement(program, i);
+}
+
+void moveToStatement(PROGRAM_STRUCTURE &program, int statement) {
+  program.currentLine = program.statements[statement].line;
+  program.currentStatement = statement;
+  program.nextLineNumberSet = false;
+  program.nextStatementSet = false;
+}
+
+// Reset the run state and position the session on its first statement.
+void startInterpreter(PROGRAM_STRUCTURE &program) {
+  program.error = RunError();
+  program.errorHandler = -1;
+  program.inErrorHandler = false;
+  program.errCode = 0;
+  program.errLine = 0;
+  program.currentLine = 0;
+  program.frames.clear();
+  buildStatementTable(program);
+  buildLoopTable(program);
+  buildJumpTables(program);
+  buildDataPool(program);
+  program.printUsingFormats.clear();
+  closeAllChannels(program);
+  program.nextLineNumberSet = false;
+  program.nextStatementSet = false;
+  program.running = !program.statements.empty();
+  program.currentStatement = 0;
+  if (program.running)
+    program.currentLine = program.statements.front().line;
+}
+
+void resetRunState(PROGRAM_STRUCTURE &program) {
+  program.frames.clear();
+  program.matrices.clear();
+  program.stringMatrices.clear();
+  // Swap in fresh containers so no arena memory (node or bucket) is still
+  // referenced when the arena is released.
+  RunArena *arena = program.arena.get();
+  decltype(program.numericVariables)(arena).swap(program.numericVariables);
+  decltype(program.stringVariables)(arena).swap(program.stringVariables);
+  decltype(program.userFunctions)(arena).swap(program.userFunctions);
+  arena->release();
+  program.loopEnds.clear();
+  program.loopStarts.clear();
+  program.loopReach.clear();
+  program.jumpTables.clear();
+}
+
+void executeStatement(PROGRAM_STRUCTURE &program, StatementType kind,
+                      const std::string &code) {
+  switch (kind) {
+  case ST_LET:
+    executeLET(program, code);
+    break;
+  case ST_PRINTexpr:
+  case ST_PRINTFILEUSING:
+    executePRINTexpr(program, code);
+    break;
+  case ST_INPUTops:
+    executeINPUTops(program, code);
+    break;
+  case ST_INPUTFILE:
+    executeINPUTFILE(program, code);
+    break;
+  case ST_GOTO:
+    executeGOTO(program, code);
+    break;
+  case ST_IF:
+    executeIF(program, code);
+    break;
+  case ST_FOR:
+    executeFOR(program, code);
+    break;
+  case ST_NEXT:
+    executeNEXT(program, code);
+    break;
+  case ST_READ:
+    executeREAD(program, code);
+    break;
+  case ST_DATA:
+    executeDATA(program, code);
+    break;
+  case ST_RESTORE:
+    executeRESTORE(program, code);
+    break;
+  case ST_END:
+    executeEND(program, code);
+    break;
+  case ST_DEF:
+    executeDEF(program, code);
+    break;
+  case ST_DIM:
+    executeDIM(program, code);
+    break;
+  case ST_REM:
+    executeREM(program, code);
+    break;
+  case ST_STOP:
+    executeSTOP(program, code);
+    break;
+  case ST_GOSUB:
+    executeGOSUB(program, code);
+    break;
+  case ST_RETURN:
+    executeRETURN(program, code);
+    break;
+  case ST_ON:
+    executeON(program, code);
+    break;
+  case ST_ON_ERROR:
+    executeONERROR(program, code);
+    break;
+  case ST_RESUME:
+    executeRESUME(program, code);
+    break;
+  case ST_MATops:
+    executeMATops(program, code);
+    break;
+  case ST_FORMAT:
+    executeFORMAT(program, code);
+    break;
+  case ST_BEEP:
+    executeBEEP(program, code);
+    break;
+  case ST_OPEN:
+    executeOPEN(program, code);
+    break;
+  case ST_CLOSE:
+    executeCLOSE(program, code);
+    break;
+  case ST_WHILE:
+    executeWHILE(program, code);
+    break;
+  case ST_WEND:
+    executeWEND(program, code);
+    break;
+  case ST_REPEAT:
+    executeREPEAT(program, code);
+    break;
+  case ST_UNTIL:
+    executeUNTIL(program, code);
+    break;
+  case ST_SEED:
+    executeSEED(program, code);
+    break;
+  case ST_FLUSH:
+    executeFLUSH(program, code);
+    break;
+  case ST_TRACE:
+    executeTRACE(program, code);
+    break;
+  default:
+    throw std::runtime_error("SYNTAX ERROR: Unknown statement: " + code);
+  }
+}
+
+// Execute program.currentStatement, then move to the jump target scheduled
+// by GOTO/GOSUB/RETURN/NEXT... or to the following statement. Returns false
+// once halted.
+static bool stepStatement(PROGRAM_STRUCTURE &program) {
+  if (!program.running)
+    return false;
+  const std::vector<ProgramStatement> &st = program.statements;
+  if (program.currentStatement >= static_cast<int>(st.size()))
+    throw std::runtime_error("RUNTIME ERROR: Undefined line " +
+                             std::to_string(program.currentLine));
+  const ProgramStatement &s = st[program.currentStatement];
+  program.currentLine = s.line;
+
+  if (program.trace)
+    basicWrite(program, "[" + std::to_string(s.line) + "] " + s.code + "\n");
+  executeStatement(program, classifyStatement(s.code), s.code);
+
+  if (!program.running)
+    return false;
+  if (program.nextStatementSet) {
+    program.currentStatement = program.nextStatement;
+    program.nextStatementSet = false;
+  } else if (program.nextLineNumberSet) {
+    int line = static_cast<int>(program.nextLineNumber);
+    program.nextLineNumberSet = false;
+    int next = statementIndex(program, line);
+    if (next < 0)
+      throw std::runtime_error("RUNTIME ERROR: Undefined line " +
+                               std::to_string(line));
+    program.currentStatement = next;
+  } else if (++program.currentStatement == static_cast<int>(st.size())) {
+    program.running = false;
+    return false;
+  }
+  program.currentLine = st[program.currentStatement].line;
+  return true;
+}
+
+bool stepInterpreter(PROGRAM_STRUCTURE &program) {
+  try {
+    return stepStatement(program);
+  } catch (const std::runtime_error &e) {
+    // Not logic_error (stoi/stod on bad program text) or bad_alloc: those
+    // end the run rather than reach an ON ERROR handler
+    if (!trapError(program, e.what()))
+      throw;
+    return true; // at the ON ERROR handler
+  }
+}
+
+RunStatus failRun(PROGRAM_STRUCTURE &program, const std::string &message) {
+  RunError &error = program.error;
+  error.line = program.currentLine;
+  error.column = 0;
+  if (error.line != 0 &&
+      program.currentStatement < static_cast<int>(program.statements.size()))
+    error.column = program.statements[program.currentStatement].column;
+  error.message = message;
+  program.running = false;
+  return RUN_ERROR;
+}
+
+RunStatus continueInterpreter(PROGRAM_STRUCTURE &program, size_t maxSteps) {
+  RunStatus status = RUN_HALTED;
+  try {
+    if (maxSteps == 0) {
+      status = runDecoded(program);
+    } else {
+      for (size_t steps = 0; program.running; ++steps) {
+        if (steps == maxSteps) {
+          status = RUN_YIELDED;
+          break;
+        }
+        stepInterpreter(program);
       }
     }
+  } catch (const std::runtime_error &e) {
+    // Handlers raise errors deep inside evaluation; they stop the run here
+    status = failRun(program, e.what());
+  } catch (const std::logic_error &e) {
+    status = failRun(program, e.what()); // stoi/stod on bad program text
+  }
+  basicFlush(program);
+  return status;
+}
+
+RunStatus runInterpreter(PROGRAM_STRUCTURE &program) {
+  try {
+    startInterpreter(program);
+  } catch (const std::runtime_error &e) {
+    return failRun(program, e.what()); // e.g. malformed DATA
   }
+  return continueInterpreter(program);
 }
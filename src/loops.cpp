@@ -0,0 +1,308 @@
+#include "interpreter.h"
+#include "program_structure.h"
+
+#include <algorithm>
+#include <cctype>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Upper-cased leading word of a statement ("NEXT I" -> "NEXT").
+static std::string firstWord(const std::string &code) {
+  std::string word;
+  size_t pos = code.find_first_not_of(" \t");
+  while (pos < code.size() &&
+         std::isalpha(static_cast<unsigned char>(code[pos])))
+    word += static_cast<char>(std::toupper(code[pos++]));
+  return word;
+}
+
+// Length of the loop variable name at text[pos] (a letter and up to 31
+// letters, digits or '_'), 0 when there is none.
+static size_t loopNameLength(const std::string &text, size_t pos) {
+  if (pos >= text.size() ||
+      !std::isalpha(static_cast<unsigned char>(text[pos])))
+    return 0;
+  size_t end = pos + 1;
+  while (end < text.size() && end - pos < 32 &&
+         (std::isalnum(static_cast<unsigned char>(text[end])) ||
+          text[end] == '_'))
+    ++end;
+  return end - pos;
+}
+
+// How many loops a closing statement ends: "NEXT I, J" closes two.
+static int closes(const std::string &word, const std::string &code) {
+  if (word != "NEXT")
+    return 1;
+  size_t pos = code.find_first_not_of(" \t");
+  pos = code.find_first_not_of(" \t", pos + 4);
+  if (pos == std::string::npos)
+    return 1;
+  return 1 + static_cast<int>(std::count(code.begin() + pos, code.end(), ','));
+}
+
+// The loop variable of a FOR statement, "" when it has none.
+static std::string forName(const std::string &code) {
+  size_t pos = matchWord(code, skipBlanks(code, 0), "FOR");
+  if (pos == std::string::npos)
+    return std::string();
+  pos = skipBlanks(code, pos);
+  return code.substr(pos, loopNameLength(code, pos));
+}
+
+// Calls `visit` with each name of a NEXT statement; a bare NEXT gets "".
+template <typename Visit>
+static void forEachNextName(const std::string &code, Visit visit) {
+  size_t pos = skipBlanks(code, matchWord(code, skipBlanks(code, 0), "NEXT"));
+  if (pos == code.size())
+    visit(std::string());
+  while (pos < code.size()) {
+    size_t n = loopNameLength(code, pos);
+    if (n == 0)
+      return;
+    visit(code.substr(pos, n));
+    pos = skipBlanks(code, pos + n);
+    if (pos < code.size() && code[pos] == ',')
+      pos = skipBlanks(code, pos + 1);
+  }
+}
+
+void buildLoopTable(PROGRAM_STRUCTURE &program) {
+  program.loopEnds.clear();
+  program.loopStarts.clear();
+  program.loopReach.clear();
+  // Open lines per kind; each kind nests independently, as BASIC allows
+  // FOR/NEXT to interleave with the structured loops.
+  std::vector<int> fors, whiles, repeats;
+  auto close = [&](std::vector<int> &open, int at, bool both) {
+    if (open.empty())
+      return;
+    program.loopEnds[open.back()] = at;
+    if (both)
+      program.loopStarts[at] = open.back();
+    open.pop_back();
+  };
+  const std::vector<ProgramStatement> &st = program.statements;
+  for (int i = 0; i < static_cast<int>(st.size()); ++i) {
+    std::string word = firstWord(st[i].code);
+    if (word == "FOR")
+      fors.push_back(i);
+    else if (word == "WHILE")
+      whiles.push_back(i);
+    else if (word == "REPEAT")
+      repeats.push_back(i);
+    else if (word == "NEXT")
+      for (int n = closes(word, st[i].code); n > 0; --n)
+        close(fors, i, false);
+    else if (word == "WEND")
+      close(whiles, i, true);
+    else if (word == "UNTIL")
+      close(repeats, i, true);
+  }
+
+  // Pairing is by text, but a FOR body may branch to another NEXT of its
+  // variable, so a jump only leaves the loop when it lands past the last
+  // NEXT that could close it.
+  std::unordered_map<std::string, int> lastNext;
+  int lastBare = -1;
+  for (int i = 0; i < static_cast<int>(st.size()); ++i)
+    if (firstWord(st[i].code) == "NEXT")
+      forEachNextName(st[i].code, [&](const std::string &name) {
+        if (name.empty())
+          lastBare = i;
+        else
+          lastNext[name] = i;
+      });
+  for (int i = 0; i < static_cast<int>(st.size()); ++i) {
+    if (firstWord(st[i].code) != "FOR")
+      continue;
+    auto named = lastNext.find(forName(st[i].code));
+    int reach = std::max(lastBare, named == lastNext.end() ? -1
+                                                           : named->second);
+    if (reach > i)
+      program.loopReach[i] = reach;
+  }
+}
+
+// Partner of statement `at` in a loop table, or -1 when it has none.
+static int paired(const std::unordered_map<int, int> &table, int at) {
+  auto it = table.find(at);
+  return it == table.end() ? -1 : it->second;
+}
+
+// Innermost frame of `kind` above the current subroutine's GOSUB frame
+// (matching `var` for FOR when given). Frames above it are dropped, so it
+// is on top when found; returns nullptr when there is none.
+static Frame *innermost(PROGRAM_STRUCTURE &program, FrameKind kind,
+                        const VarInfo *var = nullptr) {
+  FrameStack &frames = program.frames;
+  for (size_t i = frames.size(); i-- > 0;) {
+    Frame &f = frames.frames[i];
+    if (f.kind == FRAME_GOSUB)
+      break;
+    if (f.kind == kind && (!var || f.var == var)) {
+      frames.truncate(i + 1);
+      return &f;
+    }
+  }
+  return nullptr;
+}
+
+void unwindLoops(PROGRAM_STRUCTURE &program, int target) {
+  FrameStack &frames = program.frames;
+  while (!frames.empty()) {
+    const Frame &f = frames.top();
+    if (f.kind == FRAME_GOSUB)
+      return;
+    bool inside = target >= f.statement && (f.end < 0 || target <= f.end);
+    if (inside)
+      return;
+    frames.pop();
+  }
+}
+
+// The REPL and BasicSession add the line to the message.
+static std::runtime_error unmatched(const char *what) {
+  return std::runtime_error(std::string("RUNTIME ERROR: ") + what);
+}
+
+// FOR var = start TO limit [STEP step]
+void executeFOR(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(
+      R"(^\s*FOR\s+([A-Z][A-Z0-9_]{0,31})\s*=\s*(.+?)\s+TO\s+(.+?)(?:\s+STEP\s+(.+?))?\s*$)",
+      std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid FOR: " + line);
+
+  double start = evalExpression(program, m[2].str());
+  double limit = evalExpression(program, m[3].str());
+  double step = m[4].matched ? evalExpression(program, m[4].str()) : 1.0;
+  VarInfo &slot = program.numericVariables[m[1].str()];
+  slot.numericValue = start;
+  slot.isString = false;
+
+  // Re-running a FOR for the same variable replaces its old frame
+  if (innermost(program, FRAME_FOR, &slot))
+    program.frames.pop();
+
+  int here = program.currentStatement;
+  int end = paired(program.loopEnds, here);
+  if (step >= 0 ? start > limit : start < limit) {
+    if (end < 0)
+      throw unmatched("FOR without NEXT");
+    jumpAfter(program, end);
+    return;
+  }
+  program.frames.push({FRAME_FOR, program.currentLine, here,
+                       paired(program.loopReach, here), &slot, limit, step});
+}
+
+// Step the loop of `name` ("" for the innermost); true when it goes round
+// again, false when it ended and its frame was popped.
+static bool nextLoop(PROGRAM_STRUCTURE &program, std::string_view name) {
+  const VarInfo *var = nullptr;
+  if (!name.empty()) {
+    auto it = program.numericVariables.find(name);
+    if (it == program.numericVariables.end())
+      throw unmatched("NEXT without FOR");
+    var = &it->second;
+  }
+  Frame *f = innermost(program, FRAME_FOR, var);
+  if (!f)
+    throw unmatched("NEXT without FOR");
+  double v = (f->var->numericValue += f->step);
+  if (f->step >= 0 ? v <= f->limit : v >= f->limit) {
+    jumpAfter(program, f->statement);
+    return true;
+  }
+  program.frames.pop();
+  return false;
+}
+
+// NEXT [var {, var}]
+// The names are checked first, then stepped as views of the statement.
+void executeNEXT(PROGRAM_STRUCTURE &program, const std::string &line) {
+  size_t first = matchWord(line, skipBlanks(line, 0), "NEXT");
+  if (first == std::string::npos)
+    throw std::runtime_error("SYNTAX ERROR: Invalid NEXT: " + line);
+  first = skipBlanks(line, first);
+  for (size_t pos = first; pos < line.size();) {
+    size_t n = loopNameLength(line, pos);
+    if (n == 0)
+      throw std::runtime_error("SYNTAX ERROR: Invalid NEXT: " + line);
+    pos = skipBlanks(line, pos + n);
+    if (pos == line.size())
+      break;
+    if (line[pos] != ',' || (pos = skipBlanks(line, pos + 1)) == line.size())
+      throw std::runtime_error("SYNTAX ERROR: Invalid NEXT: " + line);
+  }
+
+  if (first == line.size()) {
+    nextLoop(program, std::string_view());
+    return;
+  }
+  for (size_t pos = first; pos < line.size();) {
+    size_t n = loopNameLength(line, pos);
+    if (nextLoop(program, std::string_view(line.data() + pos, n)))
+      return;
+    pos = skipBlanks(line, pos + n);
+    if (pos < line.size())
+      pos = skipBlanks(line, pos + 1);
+  }
+}
+
+void stepNEXT(PROGRAM_STRUCTURE &program,
+              const std::vector<std::string> &names) {
+  for (const std::string &name : names)
+    if (nextLoop(program, name))
+      return;
+}
+
+// WHILE cond ... WEND. Neither end keeps a frame: a true condition falls
+// into the body, a false one branches past the paired WEND, and WEND
+// branches back to its WHILE.
+// The condition of `WHILE cond` / `UNTIL cond`, evaluated in place.
+static double loopCondition(PROGRAM_STRUCTURE &program,
+                            const std::string &line, const char *keyword) {
+  size_t pos = matchWord(line, skipBlanks(line, 0), keyword);
+  if (pos == std::string::npos || pos == line.size() ||
+      !std::isspace(static_cast<unsigned char>(line[pos])) ||
+      (pos = skipBlanks(line, pos)) == line.size())
+    throw std::runtime_error(std::string("SYNTAX ERROR: Invalid ") + keyword +
+                             ": " + line);
+  return evalExpressionFrom(program, line, pos);
+}
+
+void executeWHILE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  if (loopCondition(program, line, "WHILE") != 0.0)
+    return;
+  int end = paired(program.loopEnds, program.currentStatement);
+  if (end < 0)
+    throw unmatched("WHILE without WEND");
+  jumpAfter(program, end);
+}
+
+void executeWEND(PROGRAM_STRUCTURE &program, const std::string & /*line*/) {
+  int start = paired(program.loopStarts, program.currentStatement);
+  if (start < 0)
+    throw unmatched("WEND without WHILE");
+  program.nextStatement = start;
+  program.nextStatementSet = true;
+}
+
+// REPEAT ... UNTIL cond: REPEAT only marks the top of the body.
+void executeREPEAT(PROGRAM_STRUCTURE & /*program*/,
+                   const std::string & /*line*/) {}
+
+void executeUNTIL(PROGRAM_STRUCTURE &program, const std::string &line) {
+  double cond = loopCondition(program, line, "UNTIL");
+  int start = paired(program.loopStarts, program.currentStatement);
+  if (start < 0)
+    throw unmatched("UNTIL without REPEAT");
+  if (cond == 0.0)
+    jumpAfter(program, start);
+}
@@ -0,0 +1,187 @@
+#include "matrixops.h"
+#include "program_structure.h"
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <regex>
+#include <stdexcept>
+#include <sys/mman.h>
+
+// Binary matrix records for MAT WRITE #, MAT READ # and MAT MAP #.
+// Layout, all little-endian:
+//   "BMAT"  uint32 rank (=2)  uint64 rows  uint64 cols  double[rows*cols]
+// Values are row-major. Records may follow each other on one channel; the
+// 24-byte header keeps every record's values 8-byte aligned.
+static const char MAT_MAGIC[4] = {'B', 'M', 'A', 'T'};
+static const size_t MAT_HEADER_SIZE = 24;
+// Doubles converted per block when a matrix can't be written in place.
+static const size_t MAT_CHUNK = 8192;
+
+static bool hostLittleEndian() {
+  const uint16_t one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+static void swapBytes(double *values, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    unsigned char *b = reinterpret_cast<unsigned char *>(values + i);
+    std::reverse(b, b + sizeof(double));
+  }
+}
+
+static void putLE(unsigned char *p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; ++i)
+    p[i] = static_cast<unsigned char>(v >> (8 * i));
+}
+
+static uint64_t getLE(const unsigned char *p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; ++i)
+    v |= static_cast<uint64_t>(p[i]) << (8 * i);
+  return v;
+}
+
+static FileHandle &binaryChannel(PROGRAM_STRUCTURE &program, int channel,
+                                 ChannelMode mode) {
+  FileHandle &fh = openChannel(program, channel);
+  if (!fh.binary || fh.mode != mode)
+    throw std::runtime_error(
+        "RUNTIME ERROR: Channel " + std::to_string(channel) +
+        (mode == CHANNEL_INPUT ? " is not open for BINARY INPUT"
+                               : " is not open for BINARY OUTPUT"));
+  return fh;
+}
+
+// Read and check a record header; returns rows and cols.
+static std::pair<int, int> readMatHeader(FileHandle &fh) {
+  unsigned char h[MAT_HEADER_SIZE];
+  readChannelBytes(fh, h, sizeof(h));
+  if (std::memcmp(h, MAT_MAGIC, 4) != 0 || getLE(h + 4, 4) != 2)
+    throw std::runtime_error("RUNTIME ERROR: Not a binary matrix record in " +
+                             fh.filename);
+  uint64_t rows = getLE(h + 8, 8), cols = getLE(h + 16, 8);
+  if (rows == 0 || cols == 0 || rows > INT_MAX || cols > INT_MAX ||
+      rows > SIZE_MAX / sizeof(double) / cols)
+    throw std::runtime_error("RUNTIME ERROR: Bad matrix dimensions in " +
+                             fh.filename);
+  return {static_cast<int>(rows), static_cast<int>(cols)};
+}
+
+// Names from "A, B, C"
+static std::vector<std::string> nameList(const std::string &list) {
+  static const std::regex name(R"([A-Z][A-Z0-9_]*)", std::regex::icase);
+  std::vector<std::string> names;
+  for (std::sregex_iterator it(list.begin(), list.end(), name), end; it != end;
+       ++it)
+    names.push_back(it->str());
+  return names;
+}
+
+static void writeMatrix(FileHandle &fh, const MatrixValue &mat,
+                        const std::string &name) {
+  if (mat.isString || mat.dimensions.size() != 2)
+    throw std::runtime_error(
+        "MAT ERROR: MAT WRITE# needs a numeric 2D matrix: " + name);
+  unsigned char h[MAT_HEADER_SIZE];
+  std::memcpy(h, MAT_MAGIC, 4);
+  putLE(h + 4, 2, 4);
+  putLE(h + 8, static_cast<uint64_t>(mat.dimensions[0]), 8);
+  putLE(h + 16, static_cast<uint64_t>(mat.dimensions[1]), 8);
+  writeChannelBytes(fh, h, sizeof(h));
+
+  const double *p = mat.data();
+  if (p && hostLittleEndian()) {
+    writeChannelBytes(fh, p, mat.totalSize * sizeof(double));
+    return;
+  }
+  // Sparse storage or a big-endian host: convert block by block
+  std::vector<double> chunk;
+  for (size_t start = 0; start < mat.totalSize; start += MAT_CHUNK) {
+    size_t n = std::min(MAT_CHUNK, mat.totalSize - start);
+    chunk.resize(n);
+    for (size_t k = 0; k < n; ++k)
+      chunk[k] = p ? p[start + k]
+                   : mat.get(mat.unflattenIndex(start + k)).numericValue;
+    if (!hostLittleEndian())
+      swapBytes(chunk.data(), n);
+    writeChannelBytes(fh, chunk.data(), n * sizeof(double));
+  }
+}
+
+// MAT WRITE #n, A {, B}
+void executeMATWRITEFILE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*MAT\s+WRITE\s*#\s*(\d+)\s*,\s*(.+)$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid MAT WRITE#: " + line);
+  FileHandle &fh = binaryChannel(program, std::stoi(m[1]), CHANNEL_OUTPUT);
+  for (const std::string &name : nameList(m[2]))
+    writeMatrix(fh, matrixNamed(program, name), name);
+}
+
+// MAT READ #n, A {, B}: each matrix takes the size stored in its record.
+void executeMATREADFILE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*MAT\s+READ\s*#\s*(\d+)\s*,\s*(.+)$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid MAT READ#: " + line);
+  FileHandle &fh = binaryChannel(program, std::stoi(m[1]), CHANNEL_INPUT);
+  for (const std::string &name : nameList(m[2])) {
+    std::pair<int, int> dims = readMatHeader(fh);
+    MatrixValue mat;
+    mat.configureStorage({dims.first, dims.second}, true);
+    readChannelBytes(fh, mat.denseValues.data(),
+                     mat.totalSize * sizeof(double));
+    if (!hostLittleEndian())
+      swapBytes(mat.denseValues.data(), mat.totalSize);
+    program.matrices[name] = std::move(mat);
+  }
+}
+
+// MAT MAP #n, A {, B}: like MAT READ #, but the matrix elements are the
+// file's pages mapped read-only; the first write to A makes a private copy.
+// Falls back to reading on big-endian hosts.
+void executeMATMAP(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*MAT\s+MAP\s*#\s*(\d+)\s*,\s*(.+)$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid MAT MAP#: " + line);
+  if (!hostLittleEndian()) {
+    executeMATREADFILE(program, "MAT READ #" + m[1].str() + ", " + m[2].str());
+    return;
+  }
+  FileHandle &fh = binaryChannel(program, std::stoi(m[1]), CHANNEL_INPUT);
+  for (const std::string &name : nameList(m[2])) {
+    std::pair<int, int> dims = readMatHeader(fh);
+    size_t bytes =
+        static_cast<size_t>(dims.first) * dims.second * sizeof(double);
+    int64_t offset = channelTell(fh);
+    size_t length = static_cast<size_t>(offset) + bytes;
+    std::error_code ec;
+    if (std::filesystem::file_size(fh.filename, ec) < length || ec)
+      throw std::runtime_error("RUNTIME ERROR: Unexpected end of file on " +
+                               fh.filename);
+
+    void *base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE,
+                      fileno(fh.file.get()), 0);
+    if (base == MAP_FAILED)
+      throw std::runtime_error("RUNTIME ERROR: Cannot map " + fh.filename);
+    auto *values = reinterpret_cast<const double *>(
+        static_cast<const char *>(base) + offset);
+    channelSkip(fh, static_cast<int64_t>(bytes));
+
+    MatrixValue mat;
+    mat.dimensions = {dims.first, dims.second};
+    mat.totalSize = static_cast<size_t>(dims.first) * dims.second;
+    mat.mapped = std::shared_ptr<const double>(
+        values, [base, length](const double *) { munmap(base, length); });
+    program.matrices[name] = std::move(mat);
+  }
+}
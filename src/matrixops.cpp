@@ -1,5 +1,11 @@
 #include "matrixops.h"
+#include "interpreter.h"
 #include "program_structure.h"
+#include "threadpool.h"
+#include "vecmath.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <regex>
 #include <stdexcept>
 #include <vector>
@@ -16,39 +22,9 @@ double matTrace(const MatrixValue &A);
 int matRank(const MatrixValue &A);
 void matLU(const MatrixValue &A, MatrixValue &L, MatrixValue &U);
 
-// extern std::map<int, std::string>::const_iterator findLine(int ln);
-extern int evalIntExpr(const std::string &expr);
-MatrixValue executeMATOperation(const std::string &);
-
-extern void executeMATREAD(const std::string &);
-extern void executeMATPRINT(const std::string &, std::ostream &);
-extern void executeMATPRINTFILE(const std::string &);
-
 MatrixValue matInverse(const MatrixValue &);
 MatrixValue matMultiply(const MatrixValue &, const MatrixValue &);
 
-extern PROGRAM_STRUCTURE program;
-
-// Helper to find a line in programSource or throw
-
-
-  // Given a linear index, return (row, col) based on dimensions
-  MatrixIndex unflattenIndex(size_t idx) const {
-    int cols = dimensions[1];
-    return { 
-      static_cast<int>(idx / cols), 
-      static_cast<int>(idx % cols) 
-    };
-  }
-
-static std::map<int, std::string>::const_iterator findLine(int ln) {
-  auto it = program.programSource.find(ln);
-  if (it == program.programSource.end())
-    throw std::runtime_error("RUNTIME ERROR: Undefined line " +
-                             std::to_string(ln));
-  return it;
-}
-
 
 double getMatrixValue(const MatrixValue &mat, int i, int j) {
   VarInfo v = mat.get({i, j});
@@ -151,9 +127,10 @@ double matTrace(const MatrixValue &A) {
   return sum;
 }
 // Helper to evaluate a BASIC expression to an int
-extern int evalIntExpression(const std::string &expr);
+extern int evalIntExpression(PROGRAM_STRUCTURE &program,
+                             const std::string &expr);
 
-void executeDIM(const std::string &line) {
+void executeDIM(PROGRAM_STRUCTURE &program, const std::string &line) {
     // Expect: DIM <name>(<expr1>,<expr2>)
     static const std::regex dimRe(R"(^\s*DIM\s+([A-Z][A-Z0-9_]*)\s*\(\s*(.+?)\s*,\s*(.+?)\s*\)\s*$)",
                                   std::regex::icase);
@@ -166,8 +143,8 @@ void executeDIM(const std::string &line) {
     std::string exprRows = m[2];
     std::string exprCols = m[3];
 
-    int rows = evalIntExpression(exprRows);
-    int cols = evalIntExpression(exprCols);
+    int rows = evalIntExpression(program, exprRows);
+    int cols = evalIntExpression(program, exprCols);
     if (rows <= 0 || cols <= 0) {
         throw std::runtime_error("DIM: dimensions must be positive");
     }
@@ -264,14 +241,14 @@ double matDeterminant(const MatrixValue &A) {
   int n = dims[0];
   // build a working copy in double
   std::vector<std::vector<double>> M(n, std::vector<double>(n));
+  const double *dense = A.data();
   for (int i = 0; i < n; ++i) {
     for (int j = 0; j < n; ++j) {
       size_t idx = i * n + j;
       if (!A.isSparse) {
-        M[i][j] = A.denseValues[idx].numericValue;
+        M[i][j] = dense[idx];
       } else {
-        MatrixIndex mi;
-        mi.dimensions = {i, j};
+        MatrixIndex mi{i, j};
         auto it = A.sparseValues.find(mi);
         M[i][j] = (it != A.sparseValues.end() ? it->second.numericValue : 0.0);
       }
@@ -350,7 +327,390 @@ int matRank(const MatrixValue &A) {
   return rank;
 }
 
-void executeMAT(const std::string &line) {
+MatrixValue &matrixNamed(PROGRAM_STRUCTURE &program, const std::string &name) {
+  auto it = program.matrices.find(name);
+  if (it == program.matrices.end())
+    throw std::runtime_error("RUNTIME ERROR: Undefined matrix " + name);
+  return it->second;
+}
+
+int evalIntExpression(PROGRAM_STRUCTURE &program, const std::string &expr) {
+  return static_cast<int>(std::lround(evalExpression(program, expr)));
+}
+
+// Row-major working copy of a 2D numeric matrix.
+static std::vector<double> denseCopy(const MatrixValue &A) {
+  if (A.dimensions.size() != 2)
+    throw std::runtime_error("MAT ERROR: 2D matrix required");
+  const double *p = A.data();
+  if (p)
+    return std::vector<double>(p, p + A.totalSize);
+  std::vector<double> out(A.totalSize, 0.0);
+  for (const auto &e : A.sparseValues)
+    out[A.flattenIndex(e.first)] = e.second.numericValue;
+  return out;
+}
+
+static MatrixValue fromDense(int rows, int cols, std::vector<double> values) {
+  MatrixValue R;
+  R.configureStorage({rows, cols}, true);
+  R.denseValues = std::move(values);
+  return R;
+}
+
+// A's row-major elements: its own storage when dense, else a copy in `copy`.
+static const double *denseView(const MatrixValue &A,
+                               std::vector<double> &copy) {
+  if (A.isString)
+    throw std::runtime_error("MAT ERROR: numeric matrix required");
+  if (A.dimensions.size() != 2)
+    throw std::runtime_error("MAT ERROR: 2D matrix required");
+  const double *x = A.data();
+  if (!x) {
+    copy = denseCopy(A);
+    x = copy.data();
+  }
+  return x;
+}
+
+MatrixValue matTranspose(const MatrixValue &A) {
+  std::vector<double> a = denseCopy(A);
+  int rows = A.dimensions[0], cols = A.dimensions[1];
+  std::vector<double> t(a.size());
+  for (int i = 0; i < rows; ++i)
+    for (int j = 0; j < cols; ++j)
+      t[static_cast<size_t>(j) * rows + i] = a[static_cast<size_t>(i) * cols + j];
+  return fromDense(cols, rows, std::move(t));
+}
+
+// Gauss-Jordan elimination with partial pivoting on [A | B]; returns X with
+// A X = B. Throws when A is singular.
+static std::vector<double> gaussJordan(std::vector<double> a, int n,
+                                       std::vector<double> b, int bCols) {
+  for (int k = 0; k < n; ++k) {
+    int pivot = k;
+    for (int i = k + 1; i < n; ++i)
+      if (std::fabs(a[i * n + k]) > std::fabs(a[pivot * n + k]))
+        pivot = i;
+    if (std::fabs(a[pivot * n + k]) < 1e-12)
+      throw std::runtime_error("MAT ERROR: Matrix is singular");
+    if (pivot != k) {
+      for (int j = 0; j < n; ++j)
+        std::swap(a[k * n + j], a[pivot * n + j]);
+      for (int j = 0; j < bCols; ++j)
+        std::swap(b[k * bCols + j], b[pivot * bCols + j]);
+    }
+    double inv = 1.0 / a[k * n + k];
+    for (int j = 0; j < n; ++j)
+      a[k * n + j] *= inv;
+    for (int j = 0; j < bCols; ++j)
+      b[k * bCols + j] *= inv;
+    for (int i = 0; i < n; ++i) {
+      double f = a[i * n + k];
+      if (i == k || f == 0.0)
+        continue;
+      for (int j = 0; j < n; ++j)
+        a[i * n + j] -= f * a[k * n + j];
+      for (int j = 0; j < bCols; ++j)
+        b[i * bCols + j] -= f * b[k * bCols + j];
+    }
+  }
+  return b;
+}
+
+MatrixValue matInverse(const MatrixValue &A) {
+  if (A.dimensions.size() != 2 || A.dimensions[0] != A.dimensions[1])
+    throw std::runtime_error("MAT ERROR: INVERSE requires a square matrix");
+  int n = A.dimensions[0];
+  std::vector<double> id(static_cast<size_t>(n) * n, 0.0);
+  for (int i = 0; i < n; ++i)
+    id[static_cast<size_t>(i) * n + i] = 1.0;
+  return fromDense(n, n, gaussJordan(denseCopy(A), n, std::move(id), n));
+}
+
+MatrixValue matSolve(const MatrixValue &A, const MatrixValue &B) {
+  if (A.dimensions.size() != 2 || A.dimensions[0] != A.dimensions[1])
+    throw std::runtime_error("MAT ERROR: SOLVE requires a square matrix");
+  if (B.dimensions.size() != 2 || B.dimensions[0] != A.dimensions[0])
+    throw std::runtime_error("MAT ERROR: SOLVE dimension mismatch");
+  int n = A.dimensions[0], bCols = B.dimensions[1];
+  return fromDense(n, bCols,
+                   gaussJordan(denseCopy(A), n, denseCopy(B), bCols));
+}
+
+// A with everything off the main diagonal cleared
+MatrixValue matDiagonal(const MatrixValue &A) {
+  std::vector<double> a = denseCopy(A);
+  int rows = A.dimensions[0], cols = A.dimensions[1];
+  for (int i = 0; i < rows; ++i)
+    for (int j = 0; j < cols; ++j)
+      if (i != j)
+        a[static_cast<size_t>(i) * cols + j] = 0.0;
+  return fromDense(rows, cols, std::move(a));
+}
+
+MatrixValue matIdentity(int n) {
+  MatrixValue R = matZeros(n, n);
+  for (int i = 0; i < n; ++i)
+    R.set({i, i}, VarInfo(1.0));
+  return R;
+}
+
+MatrixValue matOnes(int rows, int cols) {
+  return fromDense(rows, cols,
+                   std::vector<double>(static_cast<size_t>(rows) * cols, 1.0));
+}
+
+MatrixValue matZeros(int rows, int cols) {
+  MatrixValue R;
+  R.configureStorage({rows, cols});
+  return R;
+}
+
+MatrixValue matRandom(RngEngine &rng, int rows, int cols) {
+  MatrixValue R;
+  R.configureStorage({rows, cols}, true);
+  rng.fill(R.data(), R.totalSize);
+  return R;
+}
+
+// Elements per parallelFor chunk: large enough that a chunk outlasts the
+// hand-off to a worker by a wide margin.
+static const size_t MAT_APPLY_GRAIN = 1 << 15;
+
+MatrixValue matApply(const MatrixValue &A, const std::string &function) {
+  std::string name = function;
+  for (char &c : name)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  ArrayKernel kernel = arrayKernel(name.c_str());
+  if (!kernel)
+    throw std::runtime_error("MAT ERROR: " + name +
+                             " cannot be applied elementwise");
+  std::vector<double> copy;
+  const double *x = denseView(A, copy);
+  std::vector<double> y(A.totalSize);
+  double *out = y.data();
+  parallelFor(y.size(), MAT_APPLY_GRAIN, [&](size_t begin, size_t end) {
+    kernel(x + begin, out + begin, end - begin);
+  });
+  return fromDense(A.dimensions[0], A.dimensions[1], std::move(y));
+}
+
+bool matReductionNamed(std::string_view name, MatReduction &op) {
+  static const struct {
+    const char *name;
+    MatReduction op;
+  } table[] = {{"SUM", RED_SUM},       {"MEAN", RED_MEAN},
+               {"MINVAL", RED_MINVAL}, {"MAXVAL", RED_MAXVAL},
+               {"MINLOC", RED_MINLOC}, {"MAXLOC", RED_MAXLOC}};
+  for (const auto &entry : table)
+    if (sameName(name, entry.name)) {
+      op = entry.op;
+      return true;
+    }
+  return false;
+}
+
+// Elements per block of a whole-matrix reduction. Block results are
+// combined the same way however many threads ran, so sums do not depend
+// on the machine. Below REDUCE_MIN_BLOCKS blocks everything runs inline.
+static const size_t REDUCE_BLOCK = 1 << 16;
+static const size_t REDUCE_MIN_BLOCKS = 4;
+
+typedef double (*ReduceKernel)(const double *, size_t);
+
+static ReduceKernel reduceKernel(MatReduction op) {
+  if (op == RED_SUM || op == RED_MEAN)
+    return vecSum;
+  return (op == RED_MINVAL || op == RED_MINLOC) ? vecMin : vecMax;
+}
+
+// Turn the kernel result r over x[0..n) into op's answer: MEAN divides,
+// MINLOC/MAXLOC return the 1-based position of the first match (0 when
+// every element is NaN).
+static double finishReduction(MatReduction op, double r, const double *x,
+                              size_t n, size_t stride = 1) {
+  if (op == RED_MEAN)
+    return r / static_cast<double>(n);
+  if (op == RED_MINLOC || op == RED_MAXLOC) {
+    for (size_t i = 0; i < n; ++i)
+      if (x[i * stride] == r)
+        return static_cast<double>(i + 1);
+    return 0.0;
+  }
+  return r;
+}
+
+static void checkReducible(const MatrixValue &A, MatReduction op) {
+  if (A.totalSize == 0 && op != RED_SUM)
+    throw std::runtime_error("MAT ERROR: reduction of an empty matrix");
+}
+
+double matReduce(const MatrixValue &A, MatReduction op) {
+  std::vector<double> copy;
+  const double *x = denseView(A, copy);
+  checkReducible(A, op);
+  size_t n = A.totalSize;
+  ReduceKernel kernel = reduceKernel(op);
+  size_t blocks = (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+  double r;
+  if (blocks <= 1) {
+    r = kernel(x, n);
+  } else {
+    std::vector<double> partial(blocks);
+    parallelFor(blocks, REDUCE_MIN_BLOCKS, [&](size_t begin, size_t end) {
+      for (size_t b = begin; b < end; ++b) {
+        size_t first = b * REDUCE_BLOCK;
+        partial[b] = kernel(x + first, std::min(REDUCE_BLOCK, n - first));
+      }
+    });
+    r = kernel(partial.data(), blocks);
+  }
+  return finishReduction(op, r, x, n);
+}
+
+// acc[0..w) = sum of rows [lo, hi) of a row-major matrix with `cols`
+// columns, starting at column c0. Halves the row range down to 8 rows, so
+// column sums are pairwise too.
+static void sumRows(const double *x, size_t cols, size_t lo, size_t hi,
+                    size_t c0, size_t w, double *acc) {
+  if (hi - lo <= 8) {
+    std::fill(acc, acc + w, 0.0);
+    for (size_t r = lo; r < hi; ++r)
+      vecAddTo(acc, x + r * cols + c0, w);
+    return;
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  sumRows(x, cols, lo, mid, c0, w, acc);
+  std::vector<double> rest(w);
+  sumRows(x, cols, mid, hi, c0, w, rest.data());
+  vecAddTo(acc, rest.data(), w);
+}
+
+// Columns [c0, c1) of a rows x cols matrix reduced down the rows.
+static void reduceColumns(MatReduction op, const double *x, size_t rows,
+                          size_t cols, size_t c0, size_t c1, double *out) {
+  size_t w = c1 - c0;
+  if (op == RED_SUM || op == RED_MEAN) {
+    sumRows(x, cols, 0, rows, c0, w, out);
+  } else {
+    bool isMin = op == RED_MINVAL || op == RED_MINLOC;
+    std::fill(out, out + w, isMin ? HUGE_VAL : -HUGE_VAL);
+    for (size_t r = 0; r < rows; ++r)
+      (isMin ? vecMinTo : vecMaxTo)(out, x + r * cols + c0, w);
+  }
+  for (size_t j = 0; j < w; ++j)
+    out[j] = finishReduction(op, out[j], x + c0 + j, rows, cols);
+}
+
+MatrixValue matReduceAlong(const MatrixValue &A, MatReduction op, int dim) {
+  std::vector<double> copy;
+  const double *x = denseView(A, copy);
+  checkReducible(A, op);
+  size_t rows = A.dimensions[0], cols = A.dimensions[1];
+  if (dim == 1) {
+    // One value per column: a 1 x cols row vector
+    std::vector<double> out(cols);
+    parallelFor(cols, std::max<size_t>(1, REDUCE_BLOCK / rows),
+                [&](size_t begin, size_t end) {
+                  reduceColumns(op, x, rows, cols, begin, end,
+                                out.data() + begin);
+                });
+    return fromDense(1, static_cast<int>(cols), std::move(out));
+  }
+  if (dim == 2) {
+    // One value per row: a rows x 1 column vector
+    std::vector<double> out(rows);
+    ReduceKernel kernel = reduceKernel(op);
+    parallelFor(rows, std::max<size_t>(1, REDUCE_BLOCK / cols),
+                [&](size_t begin, size_t end) {
+                  for (size_t r = begin; r < end; ++r) {
+                    const double *row = x + r * cols;
+                    out[r] = finishReduction(op, kernel(row, cols), row, cols);
+                  }
+                });
+    return fromDense(static_cast<int>(rows), 1, std::move(out));
+  }
+  throw std::runtime_error("MAT ERROR: reduction dimension must be 1 or 2");
+}
+
+// MAT READ <id>: fill a DIM'd matrix row by row from the DATA pool. A
+// dense numeric matrix takes the whole run of items in one copy.
+void executeMATREAD(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*MAT\s+READ\s+([A-Z][A-Z0-9_]*)\s*$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid MAT READ: " + line);
+  MatrixValue &mat = matrixNamed(program, m[1]);
+  if (double *dst = mat.data()) {
+    readDataNumbers(program, dst, mat.totalSize);
+    return;
+  }
+  const DataPool &pool = program.data;
+  for (size_t n = 0; n < mat.totalSize; ++n) {
+    if (program.dataPointer >= pool.size())
+      throw std::runtime_error("RUNTIME ERROR: Out of DATA");
+    size_t item = program.dataPointer++;
+    mat.set(mat.unflattenIndex(n), pool.isString(item)
+                                       ? VarInfo(pool.text(item))
+                                       : VarInfo(pool.numbers[item]));
+  }
+}
+
+// Rows of each listed matrix; ',' (or nothing) between names spaces the
+// elements in 14-column zones, ';' packs them. A blank line ends a matrix.
+static std::string formatMatrices(PROGRAM_STRUCTURE &program,
+                                  const std::string &list) {
+  static const std::regex item(R"(\s*([A-Z][A-Z0-9_]*)\s*([,;]?))",
+                               std::regex::icase);
+  std::string out;
+  for (std::sregex_iterator it(list.begin(), list.end(), item), end;
+       it != end; ++it) {
+    const MatrixValue &mat = matrixNamed(program, (*it)[1]);
+    bool packed = (*it)[2] == ";";
+    if (mat.dimensions.size() != 2)
+      throw std::runtime_error("MAT ERROR: MAT PRINT needs a 2D matrix");
+    for (int i = 0; i < mat.dimensions[0]; ++i) {
+      size_t rowStart = out.size();
+      for (int j = 0; j < mat.dimensions[1]; ++j) {
+        if (j > 0) {
+          if (packed)
+            out += ' ';
+          else
+            out.append(14 - (out.size() - rowStart) % 14, ' ');
+        }
+        VarInfo v = mat.get({i, j});
+        if (v.isString)
+          out += v.stringValue;
+        else
+          appendNumber(out, v.numericValue);
+      }
+      out += '\n';
+    }
+    out += '\n';
+  }
+  return out;
+}
+
+void executeMATPRINT(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*MAT\s+PRINT\s+(.+)$)", std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid MAT PRINT: " + line);
+  basicWrite(program, formatMatrices(program, m[1]));
+}
+
+void executeMATPRINTFILE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*MAT\s+PRINT\s*#\s*(\d+)\s*,\s*(.+)$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid MAT PRINT#: " + line);
+  channelOutput(program, std::stoi(m[1])).write(formatMatrices(program, m[2]));
+}
+
+void executeMAT(PROGRAM_STRUCTURE &program, const std::string &line) {
   static const std::regex elemRe(
       R"(^\s*MAT\s+([A-Z][A-Z0-9_]*)\s*=\s*([A-Z0-9_.]+)\s*([-+*/])\s*([A-Z0-9_.]+)\s*$)",
       std::regex::icase);
@@ -387,9 +747,19 @@ void executeMAT(const std::string &line) {
   static const std::regex zerosRe(
       R"(^\s*MAT\s+([A-Z][A-Z0-9_]*)\s*=\s*ZEROS\s*\(\s*([0-9]+)\s*,\s*([0-9]+)\s*\)\s*$)",
       std::regex::icase);
+  static const std::regex randomRe(
+      R"(^\s*MAT\s+([A-Z][A-Z0-9_]*)\s*=\s*RANDOM\s*\(\s*([0-9]+)\s*,\s*([0-9]+)\s*\)\s*$)",
+      std::regex::icase);
   static const std::regex invRe(
       R"(^\s*MAT\s+([A-Z][A-Z0-9_]*)\s*=\s*INVERSE\s*\(\s*([A-Z][A-Z0-9_]*)\s*\)\s*$)",
       std::regex::icase);
+  static const std::regex reduceRe(
+      R"(^\s*MAT\s+([A-Z][A-Z0-9_]*)\s*=\s*(SUM|MEAN|MINVAL|MAXVAL|MINLOC|MAXLOC)\s*\(\s*([A-Z][A-Z0-9_]*)\s*(?:,\s*([0-9]+)\s*)?\)\s*$)",
+      std::regex::icase);
+  // Any other one-argument builtin, applied to every element
+  static const std::regex applyRe(
+      R"(^\s*MAT\s+([A-Z][A-Z0-9_]*)\s*=\s*([A-Z][A-Z0-9]*)\s*\(\s*([A-Z][A-Z0-9_]*)\s*\)\s*$)",
+      std::regex::icase);
 
   std::smatch m;
   if (std::regex_match(line, m, elemRe)) {
@@ -399,76 +769,58 @@ void executeMAT(const std::string &line) {
     bool BisScalar = std::isdigit(B[0]) || B.find('.') != std::string::npos;
 
     if (AisScalar && !BisScalar) {
-      double scalar = std::stod(A);
-      program.matrices[X] = executeMATOperation(
-          (op == '+') ? 1 : 2, program.matrices[B], {}, scalar);
+      program.matrices[X] =
+          matScalarOp(matrixNamed(program, B), std::stod(A), op, true);
     } else if (!AisScalar && BisScalar) {
-      double scalar = std::stod(B);
-      program.matrices[X] = executeMATOperation(
-          (op == '+') ? 1 : 2, program.matrices[A], {}, scalar);
-    } else {
       program.matrices[X] =
-          executeMATOperation(3, program.matrices[A], program.matrices[B]);
+          matScalarOp(matrixNamed(program, A), std::stod(B), op, false);
+    } else {
+      program.matrices[X] = matElementWiseOp(matrixNamed(program, A),
+                                             matrixNamed(program, B), op);
     }
   } else if (std::regex_match(line, m, detRe)) {
-    VarInfo v;
-    v.numericValue = executeMATOperation(4, {}, program.matrices[m[2]])[0][0];
-    v.isString = false;
-    program.numericVariables[m[1]] = v;
+    program.numericVariables[m[1]] =
+        VarInfo(matDeterminant(matrixNamed(program, m[2])));
   } else if (std::regex_match(line, m, multRe)) {
     program.matrices[m[1]] =
-        executeMATOperation(5, program.matrices[m[2]], program.matrices[m[3]]);
+        matMultiply(matrixNamed(program, m[2]), matrixNamed(program, m[3]));
   } else if (std::regex_match(line, m, powRe)) {
-    int exponent = std::stoi(m[3]);
     program.matrices[m[1]] =
-        executeMATOperation(6, {}, program.matrices[m[2]], 0.0, exponent);
+        matPower(matrixNamed(program, m[2]), std::stoi(m[3]));
   } else if (std::regex_match(line, m, diagRe)) {
-    program.matrices[m[1]] = executeMATOperation(7, {}, program.matrices[m[2]]);
+    program.matrices[m[1]] = matDiagonal(matrixNamed(program, m[2]));
   } else if (std::regex_match(line, m, rankRe)) {
-    VarInfo v;
-    v.numericValue = executeMATOperation(8, {}, program.matrices[m[2]])[0][0];
-    v.isString = false;
-    program.numericVariables[m[1]] = v;
+    program.numericVariables[m[1]] =
+        VarInfo(static_cast<double>(matRank(matrixNamed(program, m[2]))));
   } else if (std::regex_match(line, m, solveRe)) {
     program.matrices[m[1]] =
-        executeMATOperation(9, program.matrices[m[2]], program.matrices[m[3]]);
+        matSolve(matrixNamed(program, m[2]), matrixNamed(program, m[3]));
   } else if (std::regex_match(line, m, identRe)) {
-    int size = std::stoi(m[2]);
-    program.matrices[m[1]] = executeMATOperation(10, {}, {}, 0.0, size);
+    program.matrices[m[1]] = matIdentity(std::stoi(m[2]));
   } else if (std::regex_match(line, m, traceRe)) {
-    VarInfo v;
-    v.numericValue = executeMATOperation(11, {}, program.matrices[m[2]])[0][0];
-    v.isString = false;
-    program.numericVariables[m[1]] = v;
+    program.numericVariables[m[1]] =
+        VarInfo(matTrace(matrixNamed(program, m[2])));
   } else if (std::regex_match(line, m, transRe)) {
-    program.matrices[m[1]] =
-        executeMATOperation(12, {}, program.matrices[m[2]]);
+    program.matrices[m[1]] = matTranspose(matrixNamed(program, m[2]));
   } else if (std::regex_match(line, m, onesRe)) {
-    int rows = std::stoi(m[2]);
-    int cols = std::stoi(m[3]);
-    if (rows >= 4 || cols >= 4 || rows * cols >= 10000) {
-      SparseMatrix sm;
-      for (int i = 0; i < rows; ++i)
-        for (int j = 0; j < cols; ++j)
-          sm[{i, j}] = 1.0;
-      program.sparseMatrices[m[1]] = sm;
-    } else {
-      program.matrices[m[1]] =
-          executeMATOperation(13, {}, {}, static_cast<double>(cols), rows);
-    }
+    program.matrices[m[1]] = matOnes(std::stoi(m[2]), std::stoi(m[3]));
   } else if (std::regex_match(line, m, zerosRe)) {
-    int rows = std::stoi(m[2]);
-    int cols = std::stoi(m[3]);
-    if (rows >= 4 || cols >= 4 || rows * cols >= 10000) {
-      SparseMatrix sm; // empty = all zero
-      program.sparseMatrices[m[1]] = sm;
-    } else {
-      program.matrices[m[1]] =
-          executeMATOperation(14, {}, {}, static_cast<double>(cols), rows);
-    }
-  } else if (std::regex_match(line, m, invRe)) {
+    program.matrices[m[1]] = matZeros(std::stoi(m[2]), std::stoi(m[3]));
+  } else if (std::regex_match(line, m, randomRe)) {
     program.matrices[m[1]] =
-        executeMATOperation(15, {}, program.matrices[m[2]]);
+        matRandom(program.rng, std::stoi(m[2]), std::stoi(m[3]));
+  } else if (std::regex_match(line, m, invRe)) {
+    program.matrices[m[1]] = matInverse(matrixNamed(program, m[2]));
+  } else if (std::regex_match(line, m, reduceRe)) {
+    MatReduction op = RED_SUM;
+    matReductionNamed(m[2].str(), op);
+    const MatrixValue &A = matrixNamed(program, m[3]);
+    if (m[4].matched)
+      program.matrices[m[1]] = matReduceAlong(A, op, std::stoi(m[4]));
+    else
+      program.matrices[m[1]] = fromDense(1, 1, {matReduce(A, op)});
+  } else if (std::regex_match(line, m, applyRe)) {
+    program.matrices[m[1]] = matApply(matrixNamed(program, m[3]), m[2]);
   } else {
     throw std::runtime_error("SYNTAX ERROR: Invalid MAT statement: " + line);
   }
@@ -479,10 +831,11 @@ void executeMAT(const std::string &line) {
  *
  *   MAT <id> = <matexpr>             → executeMAT
  *   MAT READ <id>                     → executeMATREAD
+ *   MAT READ|WRITE|MAP #<chan>, <ids> → binary matrix file I/O
  *   MAT PRINT #<chan>, <id1>,<id2>    → executeMATPRINTFILE
  *   MAT PRINT <id1>,<id2>,…           → executeMATPRINT
  */
-void executeMATops(const std::string &line) {
+void executeMATops(PROGRAM_STRUCTURE &program, const std::string &line) {
   static const std::regex assignRe(R"(^\s*MAT\s+([A-Z][A-Z0-9_]*)\s*=\s*(.+)$)",
                                    std::regex::icase);
   static const std::regex readRe(R"(^\s*MAT\s+READ\s+([A-Z][A-Z0-9_]*)\s*$)",
@@ -491,26 +844,38 @@ void executeMATops(const std::string &line) {
       R"(^\s*MAT\s+PRINT\s*#\s*(\d+)\s*,\s*(.+)$)", std::regex::icase);
   static const std::regex printRe(R"(^\s*MAT\s+PRINT\s+(.+)$)",
                                   std::regex::icase);
+  static const std::regex binaryRe(R"(^\s*MAT\s+(READ|WRITE|MAP)\s*#.*$)",
+                                   std::regex::icase);
 
   std::smatch m;
-  if (std::regex_match(line, m, assignRe)) {
+  if (std::regex_match(line, m, binaryRe)) {
+    // MAT READ|WRITE|MAP #<chan>, <id list>
+    char op = static_cast<char>(std::toupper(m[1].str()[0]));
+    if (op == 'R')
+      executeMATREADFILE(program, line);
+    else if (op == 'W')
+      executeMATWRITEFILE(program, line);
+    else
+      executeMATMAP(program, line);
+  } else if (std::regex_match(line, m, assignRe)) {
     // MAT <id> = <matexpr>
-    executeMAT(line);
+    executeMAT(program, line);
   } else if (std::regex_match(line, m, readRe)) {
     // MAT READ <id>
-    executeMATREAD(line);
+    executeMATREAD(program, line);
   } else if (std::regex_match(line, m, printFileRe)) {
     // MAT PRINT #<chan>, <id list>
-    executeMATPRINTFILE(line);
+    executeMATPRINTFILE(program, line);
   } else if (std::regex_match(line, m, printRe)) {
     // MAT PRINT <id list>
-    executeMATPRINT(line, std::cout);
+    executeMATPRINT(program, line);
   } else {
     throw std::runtime_error("SYNTAX ERROR: Invalid MAT statement: " + line);
   }
 }
 
-MatrixValue executeMATOperation(const std::string &line) {
+MatrixValue executeMATOperation(PROGRAM_STRUCTURE &program,
+                                const std::string &line) {
   std::smatch m;
 
   static const std::regex detRe(
@@ -0,0 +1,231 @@
+#include "native.h"
+#include "interpreter.h"
+#include "matrixops.h"
+#include "transpile.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+// Compile flags; part of the cache key along with the compiler.
+static const char NATIVE_CXXFLAGS[] = "-std=c++17 -O2 -fPIC -shared";
+
+static std::runtime_error nativeError(const std::string &what) {
+  return std::runtime_error("NATIVE ERROR: " + what);
+}
+
+// 64-bit FNV-1a
+static uint64_t hashText(const std::string &text,
+                         uint64_t h = 0xcbf29ce484222325ull) {
+  for (unsigned char c : text) {
+    h ^= c;
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+static std::string envOr(const char *name, const std::string &fallback) {
+  const char *v = std::getenv(name);
+  return v && *v ? v : fallback;
+}
+
+static std::string cacheDirectory() {
+  if (const char *dir = std::getenv("BASIC_NATIVE_CACHE"))
+    if (*dir)
+      return dir;
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME"))
+    if (*xdg)
+      return std::string(xdg) + "/basic-native";
+  if (const char *home = std::getenv("HOME"))
+    if (*home)
+      return std::string(home) + "/.cache/basic-native";
+  return "";
+}
+
+// Without a home directory: /tmp/basic-native-<uid>. /tmp is shared, so
+// the directory must be ours and closed to everyone else; otherwise
+// another user could plant a module for us to load.
+static std::string privateTempDirectory() {
+  std::string dir = "/tmp/basic-native-" + std::to_string(getuid());
+  if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+    throw nativeError("Cannot create cache directory " + dir);
+  struct stat st;
+  if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+      st.st_uid != getuid() || (st.st_mode & 077) != 0)
+    throw nativeError("Cache directory " + dir +
+                      " is not a private directory owned by this user");
+  return dir;
+}
+
+// mkdir -p
+static void makeDirectories(const std::string &path) {
+  for (size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1)) {
+    std::string part = path.substr(0, slash);
+    if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+      throw nativeError("Cannot create cache directory " + part);
+    if (slash == std::string::npos)
+      return;
+  }
+}
+
+// Single-quoted for /bin/sh
+static std::string shellQuote(const std::string &s) {
+  std::string out = "'";
+  for (char c : s)
+    out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return out + "'";
+}
+
+static bool fileExists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+// Compile `source` into `object`. The object is built under a temporary
+// name and renamed into place, so concurrent sessions never load a
+// half-written file.
+static void compileModule(const std::string &compiler,
+                          const std::string &source,
+                          const std::string &object) {
+  std::string partial = object + "." + std::to_string(getpid());
+  std::string log = partial + ".log";
+  std::string command = compiler + " " + NATIVE_CXXFLAGS + " " +
+                        shellQuote(source) + " -o " + shellQuote(partial) +
+                        " > " + shellQuote(log) + " 2>&1";
+  if (std::system(command.c_str()) != 0) {
+    std::remove(partial.c_str());
+    throw nativeError("Compiler failed, see " + log);
+  }
+  if (std::rename(partial.c_str(), object.c_str()) != 0) {
+    std::remove(partial.c_str());
+    throw nativeError("Cannot write " + object);
+  }
+  std::remove(log.c_str());
+}
+
+// Modules loaded by this process, by cache key. They are never unloaded:
+// a module's code may still be on the stack of an exception in flight.
+static std::mutex moduleMutex;
+static std::unordered_map<uint64_t, NativeEntry> loadedModules;
+
+NativeEntry loadNativeModule(PROGRAM_STRUCTURE &program) {
+  std::ostringstream generated;
+  try {
+    transpileProgram(program, generated, TRANSPILE_MODULE);
+  } catch (const std::runtime_error &e) {
+    throw nativeError(e.what());
+  }
+  std::string source = generated.str();
+  std::string compiler = envOr("BASIC_CXX", "c++");
+  uint64_t key = hashText(compiler + "\n" + NATIVE_CXXFLAGS + "\n" + source);
+
+  std::lock_guard<std::mutex> lock(moduleMutex);
+  auto loaded = loadedModules.find(key);
+  if (loaded != loadedModules.end())
+    return loaded->second;
+
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx",
+                static_cast<unsigned long long>(key));
+  std::string dir = cacheDirectory();
+  if (dir.empty())
+    dir = privateTempDirectory();
+  std::string object = dir + "/" + name + ".so";
+  if (!fileExists(object)) {
+    makeDirectories(dir);
+    // Per process like the object, so concurrent builds of one program
+    // never write into each other's source
+    std::string path =
+        dir + "/" + name + "." + std::to_string(getpid()) + ".cpp";
+    std::ofstream out(path);
+    out << source;
+    out.close();
+    if (!out) {
+      std::remove(path.c_str());
+      throw nativeError("Cannot write " + path);
+    }
+    compileModule(compiler, path, object); // keeps it when it fails
+    std::remove(path.c_str());
+  }
+
+  void *handle = dlopen(object.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle)
+    throw nativeError(dlerror());
+  auto abi = reinterpret_cast<int (*)()>(dlsym(handle, "basic_native_abi"));
+  auto entry = reinterpret_cast<NativeEntry>(dlsym(handle, "basic_native_run"));
+  if (!abi || !entry || abi() != BASIC_NATIVE_ABI) {
+    dlclose(handle);
+    throw nativeError(object + " is not a module for this interpreter");
+  }
+  loadedModules.emplace(key, entry);
+  return entry;
+}
+
+//-----------------------------------------------------------------------------
+// NativeHost callbacks; `p` is the session
+//-----------------------------------------------------------------------------
+
+static PROGRAM_STRUCTURE &session(void *p) {
+  return *static_cast<PROGRAM_STRUCTURE *>(p);
+}
+
+static double *hostVariable(void *p, const char *name) {
+  VarInfo &slot = session(p).numericVariables[name];
+  slot.isString = false;
+  return &slot.numericValue;
+}
+
+// Run one statement through the interpreter; the statement it continues
+// at, or -1 once the program has stopped.
+static int hostStep(void *p, int statement) {
+  PROGRAM_STRUCTURE &program = session(p);
+  moveToStatement(program, statement);
+  return stepInterpreter(program) ? program.currentStatement : -1;
+}
+
+static double hostEval(void *p, const char *expr) {
+  return evalExpression(session(p), expr);
+}
+
+static void hostMat(void *p, const char *line) {
+  executeMATops(session(p), line);
+}
+
+static double hostReduce(void *p, const char *matrix, int op) {
+  return matReduce(matrixNamed(session(p), matrix),
+                   static_cast<MatReduction>(op));
+}
+
+static double hostRnd(void *p) { return session(p).rng.nextDouble(); }
+
+static void hostFinish(void *p) { session(p).running = false; }
+
+RunStatus runNative(PROGRAM_STRUCTURE &program) {
+  NativeEntry entry = loadNativeModule(program);
+  NativeHost host{&program, hostVariable, hostStep,   hostEval,
+                  hostMat,  hostReduce,   hostRnd,    hostFinish};
+  RunStatus status = RUN_HALTED;
+  try {
+    startInterpreter(program);
+    entry(&host);
+  } catch (const std::runtime_error &e) {
+    status = failRun(program, e.what());
+  } catch (const std::logic_error &e) {
+    status = failRun(program, e.what());
+  } catch (...) {
+    basicFlush(program);
+    throw;
+  }
+  basicFlush(program);
+  return status;
+}
@@ -0,0 +1,123 @@
+#include "numformat.h"
+
+#include <charconv>
+#include <cmath>
+
+size_t formatNumber(double v, char *buf) {
+  if (v == 0.0) { // also folds -0 to "0"
+    buf[0] = '0';
+    return 1;
+  }
+  if (std::isnan(v)) {
+    buf[0] = 'N', buf[1] = 'a', buf[2] = 'N';
+    return 3;
+  }
+  auto res = std::to_chars(buf, buf + NUMBER_TEXT_MAX, v);
+  return static_cast<size_t>(res.ptr - buf);
+}
+
+void appendNumber(std::string &out, double v) {
+  char buf[NUMBER_TEXT_MAX];
+  out.append(buf, formatNumber(v, buf));
+}
+
+std::string formatNumber(double v) {
+  char buf[NUMBER_TEXT_MAX];
+  return std::string(buf, formatNumber(v, buf));
+}
+
+CompiledFormat compileFormat(const std::string &spec) {
+  CompiledFormat fmt;
+  size_t i = 0;
+  while (i < spec.size()) {
+    char c = spec[i];
+    FormatField f;
+    size_t start = i;
+    if (c == '#' || (c == '$' && i + 1 < spec.size() && spec[i + 1] == '#')) {
+      // $##,###.## -- ',' and '.' only count inside a run of '#'
+      f.type = FIELD_NUMERIC;
+      f.dollar = (c == '$');
+      if (f.dollar)
+        ++i;
+      bool point = false;
+      while (i < spec.size()) {
+        char d = spec[i];
+        bool digitNext = i + 1 < spec.size() && spec[i + 1] == '#';
+        if (d == '#') {
+          if (point)
+            ++f.decimals;
+        } else if (d == ',' && !point && digitNext) {
+          f.grouping = true;
+        } else if (d == '.' && !point && digitNext) {
+          point = true;
+        } else {
+          break;
+        }
+        ++i;
+      }
+      ++fmt.valueCount;
+    } else if (c == 'l' || c == 'r' || c == 'c') {
+      f.type = FIELD_STRING;
+      f.align = c;
+      while (i < spec.size() && spec[i] == c)
+        ++i;
+      ++fmt.valueCount;
+    } else {
+      while (i < spec.size() && spec[i] != '#' && spec[i] != 'l' &&
+             spec[i] != 'r' && spec[i] != 'c' &&
+             !(spec[i] == '$' && i + 1 < spec.size() && spec[i + 1] == '#'))
+        ++i;
+    }
+    f.width = static_cast<int>(i - start);
+    if (f.type == FIELD_TEXT)
+      f.text = spec.substr(start, i - start);
+    fmt.fields.push_back(std::move(f));
+  }
+  return fmt;
+}
+
+void renderNumericField(std::string &out, const FormatField &f, double v) {
+  char digits[352]; // fixed notation of DBL_MAX plus decimals
+  auto res = std::to_chars(digits, digits + sizeof(digits), std::fabs(v),
+                           std::chars_format::fixed, f.decimals);
+  if (res.ec != std::errc() || !std::isfinite(v)) {
+    out += '%';
+    appendNumber(out, v);
+    return;
+  }
+  size_t len = static_cast<size_t>(res.ptr - digits);
+  size_t intLen = f.decimals ? len - f.decimals - 1 : len;
+  bool negative = std::signbit(v) && v != 0.0;
+
+  char buf[512];
+  size_t n = 0;
+  if (negative)
+    buf[n++] = '-';
+  if (f.dollar)
+    buf[n++] = '$';
+  for (size_t k = 0; k < intLen; ++k) {
+    if (f.grouping && k > 0 && (intLen - k) % 3 == 0)
+      buf[n++] = ',';
+    buf[n++] = digits[k];
+  }
+  for (size_t k = intLen; k < len; ++k)
+    buf[n++] = digits[k];
+
+  size_t width = static_cast<size_t>(f.width);
+  if (n > width)
+    out += '%'; // overflow: print in full, flagged
+  else
+    out.append(width - n, ' ');
+  out.append(buf, n);
+}
+
+void renderStringField(std::string &out, const FormatField &f,
+                       const std::string &s) {
+  size_t width = static_cast<size_t>(f.width);
+  size_t len = s.size() < width ? s.size() : width;
+  size_t pad = width - len;
+  size_t left = f.align == 'r' ? pad : f.align == 'c' ? pad / 2 : 0;
+  out.append(left, ' ');
+  out.append(s, 0, len);
+  out.append(pad - left, ' ');
+}
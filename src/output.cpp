@@ -0,0 +1,65 @@
+#include "interpreter.h"
+#include "program_structure.h"
+
+#include <iostream>
+#include <regex>
+#include <stdexcept>
+#include <string>
+
+// Buffer PRINT output on the console; it reaches the terminal (or the host
+// hook) when the buffer fills or basicFlush() is called.
+void basicWrite(PROGRAM_STRUCTURE &program, const std::string &text) {
+  program.console.write(text);
+}
+
+// Flush the console and every open PRINT# channel.
+void basicFlush(PROGRAM_STRUCTURE &program) {
+  program.console.flush();
+  for (FileHandle &fh : program.channels)
+    if (fh.isOpen())
+      fh.out.flush();
+}
+
+// Read one INPUT line from the host hook, or from std::cin. Pending output
+// is flushed first so the prompt is visible; the reply's Enter puts the
+// console back at column 0.
+bool basicReadLine(PROGRAM_STRUCTURE &program, std::string &line) {
+  program.console.flush();
+  program.console.column = 0;
+  if (program.inputHook)
+    return program.inputHook(line);
+  return static_cast<bool>(std::getline(std::cin, line));
+}
+
+// Write-behind buffer of an OUTPUT/APPEND channel for PRINT#.
+OutputBuffer &channelOutput(PROGRAM_STRUCTURE &program, int channel) {
+  FileHandle &fh = openChannel(program, channel);
+  if (fh.mode != CHANNEL_OUTPUT)
+    throw std::runtime_error("RUNTIME ERROR: Channel " +
+                             std::to_string(channel) +
+                             " is not open for OUTPUT");
+  return fh.out;
+}
+
+// FLUSH [#n]  -- without a channel, flushes the console and all channels
+void executeFLUSH(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*FLUSH\s*(?:#\s*(\d+))?\s*$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid FLUSH: " + line);
+  if (m[1].matched)
+    channelOutput(program, std::stoi(m[1].str())).flush();
+  else
+    basicFlush(program);
+}
+
+// TRACE ON | TRACE OFF
+void executeTRACE(PROGRAM_STRUCTURE &program, const std::string &line) {
+  static const std::regex rgx(R"(^\s*TRACE\s+(ON|OFF)\s*$)",
+                              std::regex::icase);
+  std::smatch m;
+  if (!std::regex_match(line, m, rgx))
+    throw std::runtime_error("SYNTAX ERROR: Invalid TRACE: " + line);
+  program.trace = (std::toupper(m[1].str()[1]) == 'N');
+}
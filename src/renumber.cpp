@@ -4,7 +4,8 @@
 #include <regex>
 #include <sstream>
 
-void handleRENUMBER(int newStart, int delta, int oldStart) {
+void handleRENUMBER(PROGRAM_STRUCTURE &program, int newStart, int delta,
+                   int oldStart) {
   if (program.programSource.empty()) {
     std::cerr << "ERROR: No program loaded.\n";
     return;
@@ -0,0 +1,88 @@
+#include "rng.h"
+
+#include <cstring>
+
+static uint64_t splitmix64(uint64_t &x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+void RngEngine::seed(uint64_t value, uint64_t stream) {
+  for (uint64_t &word : s)
+    word = splitmix64(value);
+  for (uint64_t i = 0; i < stream; ++i)
+    longJump();
+}
+
+// Replace the state by the jump polynomial `poly` applied to it.
+void RngEngine::jumpBy(const uint64_t (&poly)[4]) {
+  uint64_t t[4] = {0, 0, 0, 0};
+  for (uint64_t word : poly)
+    for (int b = 0; b < 64; ++b) {
+      if (word & (1ULL << b))
+        for (int i = 0; i < 4; ++i)
+          t[i] ^= s[i];
+      next();
+    }
+  std::memcpy(s, t, sizeof(s));
+}
+
+void RngEngine::jump() {
+  static const uint64_t JUMP[4] = {
+      0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL,
+      0x39abdc4529b1661cULL};
+  jumpBy(JUMP);
+}
+
+void RngEngine::longJump() {
+  static const uint64_t LONG_JUMP[4] = {
+      0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL,
+      0x39109bb02acbe635ULL};
+  jumpBy(LONG_JUMP);
+}
+
+void RngEngine::fill(double *out, size_t n) {
+  // One GCC/Clang vector per state word holds every lane, so a step is a
+  // handful of SIMD ops (one AVX2 register per state word).
+  typedef uint64_t Lanes __attribute__((vector_size(RNG_LANES * 8)));
+  typedef double Units __attribute__((vector_size(RNG_LANES * 8)));
+  Lanes s0, s1, s2, s3, exponent;
+  RngEngine lane = *this;
+  for (int k = 0; k < RNG_LANES; ++k) {
+    exponent[k] = 0x3ff0000000000000ULL;
+    s0[k] = lane.s[0];
+    s1[k] = lane.s[1];
+    s2[k] = lane.s[2];
+    s3[k] = lane.s[3];
+    if (k + 1 < RNG_LANES)
+      lane.jump();
+  }
+
+  for (size_t i = 0; i < n; i += RNG_LANES) {
+    Lanes sum = s0 + s3;
+    Lanes result = ((sum << 23) | (sum >> 41)) + s0;
+    Lanes t = s1 << 17;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = (s3 << 45) | (s3 >> 19);
+    // [1, 2) from the top 52 bits under a fixed exponent, minus 1: no
+    // integer-to-double conversion, which SSE2/AVX2 lack for 64 bits
+    Lanes bits = (result >> 12) | exponent;
+    Units u;
+    std::memcpy(&u, &bits, sizeof(u));
+    u -= 1.0;
+    if (n - i >= RNG_LANES)
+      std::memcpy(out + i, &u, sizeof(u));
+    else
+      std::memcpy(out + i, &u, (n - i) * sizeof(double));
+  }
+  s[0] = s0[0];
+  s[1] = s1[0];
+  s[2] = s2[0];
+  s[3] = s3[0];
+}
@@ -1,4 +1,5 @@
 #include "syntax.h"
+#include "interpreter.h"
 #include <iostream>
 #include <map>
 #include <regex>
@@ -14,7 +15,9 @@ void checkSyntax(const std::map<int, std::string> &programSource) {
       "SIN",   "COS",   "TAN",     "ATN",     "ASN",   "ACS",   "COT",
       "SEC",   "CSC",   "LOG",     "LOGX",    "LOG10", "CLOG",  "EXP",
       "RND",   "INT",   "DEG2RAD", "RAD2DEG", "ASCII", "VALUE", "POW",
-      "ROUND", "FLOOR", "CEIL",    "TIME",    "SQR"};
+      "ROUND", "FLOOR", "CEIL",    "TIME",    "SQR",   "EOF",   "LOC",
+      "LOF",   "INSTR", "SUM",     "MEAN",    "MINVAL", "MAXVAL", "MINLOC",
+      "MAXLOC", "ABS",  "SGN"};
   std::set<std::string> validStringFunctions = {"LEFT$", "RIGHT$", "MID$",
                                                 "LEN$",  "CHR$",   "STRING$",
                                                 "TIME$", "DATE$",  "TEST$"};
@@ -79,7 +82,9 @@ void checkSyntax(const std::map<int, std::string> &programSource) {
     check = upper;
     while (std::regex_search(check, func_match, func_rgx)) {
       std::string fname = func_match[1];
-      if (validMathFunctions.find(fname) == validMathFunctions.end() &&
+      // FN<name>: a DEF FN function
+      if (fname.compare(0, 2, "FN") != 0 &&
+          validMathFunctions.find(fname) == validMathFunctions.end() &&
           validStringFunctions.find(fname) == validStringFunctions.end()) {
         std::cout << "SYNTAX ERROR: Unknown function '" << fname << "' in line "
                   << lineNumber << ": " << line << std::endl;
@@ -98,9 +103,10 @@ void checkSyntax(const std::map<int, std::string> &programSource) {
     std::regex repeat_rgx(R"(^REPEAT)");
     std::regex until_rgx(R"(^UNTIL\s+.+)");
 
+    std::string stmt;
     auto check_match = [&](const std::regex &rgx,
                            const std::string &tag) -> bool {
-      if (!std::regex_match(upper, rgx)) {
+      if (!std::regex_match(stmt, rgx)) {
         std::cout << "SYNTAX ERROR: Invalid " << tag << " syntax at line "
                   << lineNumber << ": " << line << std::endl;
         return false;
@@ -108,52 +114,59 @@ void checkSyntax(const std::map<int, std::string> &programSource) {
       return true;
     };
 
-    if (upper.find("LET ") == 0)
-      ok &= check_match(let_rgx, "LET");
-    else if (upper.find("IF ") == 0)
-      ok &= check_match(if_rgx, "IF");
-    else if (upper.find("INPUT") == 0)
-      ok &= check_match(input_rgx, "INPUT");
-    else if (upper.find("FOR ") == 0)
-      ok &= check_match(for_rgx, "FOR");
-    else if (upper.find("NEXT") == 0)
-      ok &= check_match(next_rgx, "NEXT");
-    else if (upper.find("WHILE ") == 0) {
-      ok &= check_match(while_rgx, "WHILE");
-      controlStack.push_back("WHILE");
-      if (controlStack.size() > 15) {
-        std::cout << "SYNTAX ERROR: Loop nesting exceeds 15 levels at line "
-                  << lineNumber << ": " << line << std::endl;
-        ok = false;
-      }
-    } else if (upper == "WEND") {
-      if (!controlStack.empty() && controlStack.back() == "WHILE")
-        controlStack.pop_back();
-      else {
-        std::cout << "SYNTAX ERROR: WEND without matching WHILE at line "
-                  << lineNumber << ": " << line << std::endl;
-        ok = false;
-      }
-    } else if (upper == "REPEAT") {
-      controlStack.push_back("REPEAT");
-      if (controlStack.size() > 15) {
-        std::cout << "SYNTAX ERROR: Loop nesting exceeds 15 levels at line "
-                  << lineNumber << ": " << line << std::endl;
-        ok = false;
-      }
-    } else if (upper.find("UNTIL ") == 0) {
-      if (!controlStack.empty() && controlStack.back() == "REPEAT")
-        controlStack.pop_back();
-      else {
-        std::cout << "SYNTAX ERROR: UNTIL without matching REPEAT at line "
-                  << lineNumber << ": " << line << std::endl;
-        ok = false;
+    // Statement checks, once per '\'-separated statement
+    for (const std::string &part : splitStatements(line)) {
+      stmt = part;
+      for (size_t i = 0; i < stmt.length(); ++i)
+        stmt[i] = toupper(stmt[i]);
+      if (stmt.find("LET ") == 0)
+        ok &= check_match(let_rgx, "LET");
+      else if (stmt.find("IF ") == 0)
+        ok &= check_match(if_rgx, "IF");
+      else if (stmt.find("INPUT") == 0)
+        ok &= check_match(input_rgx, "INPUT");
+      else if (stmt.find("FOR ") == 0)
+        ok &= check_match(for_rgx, "FOR");
+      else if (stmt.find("NEXT") == 0)
+        ok &= check_match(next_rgx, "NEXT");
+      else if (stmt.find("WHILE ") == 0) {
+        ok &= check_match(while_rgx, "WHILE");
+        controlStack.push_back("WHILE");
+        if (controlStack.size() > 15) {
+          std::cout << "SYNTAX ERROR: Loop nesting exceeds 15 levels at line "
+                    << lineNumber << ": " << line << std::endl;
+          ok = false;
+        }
+      } else if (stmt == "WEND") {
+        if (!controlStack.empty() && controlStack.back() == "WHILE")
+          controlStack.pop_back();
+        else {
+          std::cout << "SYNTAX ERROR: WEND without matching WHILE at line "
+                    << lineNumber << ": " << line << std::endl;
+          ok = false;
+        }
+      } else if (stmt == "REPEAT") {
+        controlStack.push_back("REPEAT");
+        if (controlStack.size() > 15) {
+          std::cout << "SYNTAX ERROR: Loop nesting exceeds 15 levels at line "
+                    << lineNumber << ": " << line << std::endl;
+          ok = false;
+        }
+      } else if (stmt.find("UNTIL ") == 0) {
+        if (!controlStack.empty() && controlStack.back() == "REPEAT")
+          controlStack.pop_back();
+        else {
+          std::cout << "SYNTAX ERROR: UNTIL without matching REPEAT at line "
+                    << lineNumber << ": " << line << std::endl;
+          ok = false;
+        }
       }
     }
   }
 
   for (int ref : referencedLines) {
-    if (definedLines.find(ref) == definedLines.end()) {
+    // ON ERROR GOTO 0 turns trapping off
+    if (ref != 0 && definedLines.find(ref) == definedLines.end()) {
       std::cout << "SYNTAX ERROR: Missing referenced line " << ref << std::endl;
       ok = false;
     }
@@ -0,0 +1,134 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// One parallelFor call. Lives on the caller's stack; the caller waits
+// until every worker that picked it up has let go (users == 0).
+struct Job {
+  const std::function<void(size_t, size_t)> *body;
+  size_t n, chunk, chunks;
+  std::atomic<size_t> next{0}, done{0};
+  std::atomic<int> users{0};
+  std::mutex m;
+  std::condition_variable cv;
+
+  // Claim and run chunks until none are left.
+  void work() {
+    for (;;) {
+      size_t c = next.fetch_add(1);
+      if (c >= chunks)
+        return;
+      size_t begin = c * chunk;
+      (*body)(begin, std::min(n, begin + chunk));
+      if (done.fetch_add(1) + 1 == chunks) {
+        std::lock_guard<std::mutex> lock(m);
+        cv.notify_all();
+      }
+    }
+  }
+};
+
+class Pool {
+public:
+  Pool() {
+    unsigned hw = std::thread::hardware_concurrency();
+    size_t workers = hw > 1 ? hw - 1 : 0;
+    for (size_t i = 0; i < workers; ++i)
+      threads_.emplace_back([this] { workerLoop(); });
+  }
+
+  ~Pool() {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread &t : threads_)
+      t.join();
+  }
+
+  size_t width() const { return threads_.size() + 1; }
+
+  void run(Job &job) {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      jobs_.push_back(&job);
+    }
+    cv_.notify_all();
+    job.work();
+    {
+      // No worker can pick the job up after this
+      std::lock_guard<std::mutex> lock(m_);
+      auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+      if (it != jobs_.end())
+        jobs_.erase(it);
+    }
+    std::unique_lock<std::mutex> lock(job.m);
+    job.cv.wait(lock, [&] {
+      return job.done.load() == job.chunks && job.users.load() == 0;
+    });
+  }
+
+private:
+  void workerLoop() {
+    for (;;) {
+      Job *job;
+      {
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+        if (stop_)
+          return;
+        job = jobs_.front();
+        ++job->users;
+        // Everything claimed: stop handing it out
+        if (job->next.load() >= job->chunks)
+          jobs_.pop_front();
+      }
+      job->work();
+      std::lock_guard<std::mutex> lock(job->m);
+      --job->users;
+      job->cv.notify_all();
+    }
+  }
+
+  std::vector<std::thread> threads_;
+  std::deque<Job *> jobs_;
+  std::mutex m_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+};
+
+Pool &pool() {
+  static Pool instance;
+  return instance;
+}
+
+} // namespace
+
+size_t parallelWidth() { return pool().width(); }
+
+void parallelFor(size_t n, size_t minChunk,
+                 const std::function<void(size_t, size_t)> &body) {
+  if (n == 0)
+    return;
+  size_t width = parallelWidth();
+  size_t chunk = std::max(minChunk, (n + width * 4 - 1) / (width * 4));
+  if (width == 1 || chunk >= n) {
+    body(0, n);
+    return;
+  }
+  Job job;
+  job.body = &body;
+  job.n = n;
+  job.chunk = chunk;
+  job.chunks = (n + chunk - 1) / chunk;
+  pool().run(job);
+}
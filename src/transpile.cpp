@@ -0,0 +1,1257 @@
+#include "transpile.h"
+#include "interpreter.h"
+#include "native.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Text of a macro's expansion
+#define NATIVE_TEXT(...) #__VA_ARGS__
+#define NATIVE_XTEXT(...) NATIVE_TEXT(__VA_ARGS__)
+
+namespace {
+
+// Thrown inside the expression translator for anything it does not cover;
+// the caller then emits an evalExpression call instead.
+struct Unsupported {};
+
+// C++ string literal for `text`
+std::string cppLiteral(const std::string &text) {
+  std::string out = "\"";
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < 0x20 || c == 0x7f) {
+      char esc[8];
+      std::snprintf(esc, sizeof(esc), "\\%03o", c);
+      out += esc;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  return out + "\"";
+}
+
+std::string upper(std::string s) {
+  for (char &c : s)
+    c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  return s;
+}
+
+// Numeric builtins with a direct C++ form; %0 and %1 are the arguments.
+struct Builtin {
+  const char *name;
+  int arity;
+  const char *form;
+};
+
+const Builtin BUILTINS[] = {
+    {"SIN", 1, "std::sin(%0)"},
+    {"COS", 1, "std::cos(%0)"},
+    {"TAN", 1, "std::tan(%0)"},
+    {"ATN", 1, "std::atan(%0)"},
+    {"ASN", 1, "std::asin(%0)"},
+    {"ACS", 1, "std::acos(%0)"},
+    {"COT", 1, "(1.0 / std::tan(%0))"},
+    {"SEC", 1, "(1.0 / std::cos(%0))"},
+    {"CSC", 1, "(1.0 / std::sin(%0))"},
+    {"SQR", 1, "std::sqrt(%0)"},
+    {"ABS", 1, "std::fabs(%0)"},
+    {"SGN", 1, "b_sgn(%0)"},
+    {"EXP", 1, "std::exp(%0)"},
+    {"LOG10", 1, "std::log10(%0)"},
+    {"LOGX", 2, "(std::log(%1) / std::log(%0))"},
+    {"CLOG", 1, "std::log(%0)"},
+    {"INT", 1, "std::floor(%0)"},
+    {"ROUND", 1, "std::floor(%0 + 0.5)"},
+    {"FLOOR", 1, "std::floor(%0)"},
+    {"CEIL", 1, "std::ceil(%0)"},
+    {"POW", 2, "std::pow(%0, %1)"},
+    {"DEG2RAD", 1, "(%0 * M_PI / 180.0)"},
+    {"RAD2DEG", 1, "(%0 * 180.0 / M_PI)"},
+};
+
+// Reduction names in MatReduction order; b_reduce takes the index.
+const char *const REDUCTIONS[] = {"SUM",    "MEAN",   "MINVAL",
+                                  "MAXVAL", "MINLOC", "MAXLOC"};
+
+// The FOR and NEXT forms with native code
+const std::regex FOR_RE(
+    R"(^\s*FOR\s+([A-Z][A-Z0-9_]{0,31})\s*=\s*(.+?)\s+TO\s+(.+?)(?:\s+STEP\s+(.+?))?\s*$)",
+    std::regex::icase);
+const std::regex NEXT_RE(
+    R"(^\s*NEXT\s*((?:[A-Z][A-Z0-9_]{0,31})(?:\s*,\s*[A-Z][A-Z0-9_]{0,31})*)?\s*$)",
+    std::regex::icase);
+
+// Variable types from the inference pass
+struct VarTypes {
+  std::set<std::string> ints;    // integer FOR counters (long long locals)
+  std::set<std::string> strings; // names only ever holding a string
+};
+
+// Numeric expression -> C++ expression, following the grammar of
+// ExprParser in evalExpression.cpp so both agree on precedence. Variables
+// become V_<name>; relations and AND/OR/NOT use the b_* helpers, which
+// give BASIC's -1/0 truth values.
+struct ExprTranslator {
+  const std::string &expr;
+  const VarTypes &types;
+  std::set<std::string> vars;
+  int rndCalls = 0;
+  size_t pos = 0;
+
+  ExprTranslator(const std::string &e, const VarTypes &t)
+      : expr(e), types(t) {}
+
+  void skipWS() {
+    while (pos < expr.size() && std::isspace(static_cast<unsigned char>(
+                                    expr[pos])))
+      ++pos;
+  }
+
+  bool identChar(size_t p) const {
+    return p < expr.size() &&
+           (std::isalnum(static_cast<unsigned char>(expr[p])) ||
+            expr[p] == '_');
+  }
+
+  bool keyword(const char *kw) {
+    size_t n = std::char_traits<char>::length(kw);
+    if (pos + n > expr.size())
+      return false;
+    for (size_t i = 0; i < n; ++i)
+      if (std::toupper(static_cast<unsigned char>(expr[pos + i])) != kw[i])
+        return false;
+    if (identChar(pos + n))
+      return false;
+    pos += n;
+    skipWS();
+    return true;
+  }
+
+  std::string translate() {
+    std::string out = logical();
+    skipWS();
+    if (pos != expr.size())
+      throw Unsupported();
+    if (rndCalls > 1) // C++ leaves operand order open; BASIC does not
+      throw Unsupported();
+    return out;
+  }
+
+  std::string logical() {
+    std::string value = logicalOperand();
+    for (;;) {
+      skipWS();
+      if (keyword("AND"))
+        value = "b_and(" + value + ", " + logicalOperand() + ")";
+      else if (keyword("OR"))
+        value = "b_or(" + value + ", " + logicalOperand() + ")";
+      else
+        return value;
+    }
+  }
+
+  std::string logicalOperand() {
+    skipWS();
+    if (keyword("NOT"))
+      return "b_not(" + relation() + ")";
+    return relation();
+  }
+
+  std::string relation() {
+    skipWS();
+    if (pos < expr.size() && expr[pos] == '"')
+      throw Unsupported();
+    std::string lhs = sum();
+    skipWS();
+    if (pos >= expr.size())
+      return lhs;
+    char c = expr[pos];
+    char d = pos + 1 < expr.size() ? expr[pos + 1] : '\0';
+    const char *op = nullptr;
+    size_t len = 1;
+    if (c == '=')
+      op = "==";
+    else if (c == '<' && d == '>')
+      op = "!=", len = 2;
+    else if (c == '<' && d == '=')
+      op = "<=", len = 2;
+    else if (c == '>' && d == '=')
+      op = ">=", len = 2;
+    else if (c == '<')
+      op = "<";
+    else if (c == '>')
+      op = ">";
+    if (!op)
+      return lhs;
+    pos += len;
+    skipWS();
+    return "b_rel(" + lhs + " " + op + " " + sum() + ")";
+  }
+
+  std::string sum() {
+    std::string value = term();
+    for (;;) {
+      skipWS();
+      if (pos < expr.size() && (expr[pos] == '+' || expr[pos] == '-')) {
+        char op = expr[pos++];
+        value = "(" + value + " " + op + " " + term() + ")";
+      } else {
+        return value;
+      }
+    }
+  }
+
+  std::string term() {
+    std::string value = factor();
+    for (;;) {
+      skipWS();
+      if (pos < expr.size() && expr[pos] == '*') {
+        ++pos;
+        value = "(" + value + " * " + factor() + ")";
+      } else if (pos < expr.size() && expr[pos] == '/') {
+        ++pos;
+        value = "b_div(" + value + ", " + factor() + ")";
+      } else {
+        return value;
+      }
+    }
+  }
+
+  // [-] atom { ^ [-] atom }, grouped left to right as in evalExpression
+  std::string factor() {
+    skipWS();
+    bool neg = false;
+    if (pos < expr.size() && expr[pos] == '-') {
+      neg = true;
+      ++pos;
+      skipWS();
+    }
+    std::string value = atom();
+    for (;;) {
+      skipWS();
+      if (pos >= expr.size() || expr[pos] != '^')
+        break;
+      ++pos;
+      skipWS();
+      bool negExp = pos < expr.size() && expr[pos] == '-';
+      if (negExp)
+        ++pos;
+      std::string exponent = atom();
+      value = "std::pow(" + value + ", " + (negExp ? "-" : "") + exponent +
+              ")";
+    }
+    return neg ? "(-" + value + ")" : value;
+  }
+
+  std::string atom() {
+    skipWS();
+    std::string value;
+    if (pos < expr.size() && expr[pos] == '(') {
+      ++pos;
+      value = "(" + logical() + ")";
+      skipWS();
+      if (pos >= expr.size() || expr[pos] != ')')
+        throw Unsupported();
+      ++pos;
+    } else if (pos < expr.size() &&
+               (std::isdigit(static_cast<unsigned char>(expr[pos])) ||
+                expr[pos] == '.')) {
+      double v;
+      const char *first = expr.data() + pos;
+      auto res = std::from_chars(first, expr.data() + expr.size(), v);
+      if (res.ec != std::errc())
+        throw Unsupported();
+      value.assign(first, res.ptr);
+      pos += value.size();
+      if (value.find_first_of(".eE") == std::string::npos)
+        value += ".0";
+    } else {
+      value = primary();
+    }
+    return value;
+  }
+
+  std::string identifier() {
+    size_t start = pos;
+    while (identChar(pos))
+      ++pos;
+    if (pos == start || !std::isalpha(static_cast<unsigned char>(expr[start])))
+      throw Unsupported();
+    return expr.substr(start, pos - start);
+  }
+
+  std::string primary() {
+    skipWS();
+    std::string id = identifier();
+    if (pos < expr.size() && expr[pos] == '$')
+      throw Unsupported();
+    skipWS();
+    if (pos >= expr.size() || expr[pos] != '(') {
+      // The interpreter reads a string variable as a number through stod,
+      // and PI as the constant only while no variable has that name
+      if (types.strings.count(id) || upper(id) == "PI")
+        throw Unsupported();
+      vars.insert(id);
+      return types.ints.count(id) ? "double(V_" + id + ")" : "V_" + id;
+    }
+    ++pos;
+    std::string name = upper(id);
+
+    for (const auto &r : REDUCTIONS)
+      if (name == r) {
+        skipWS();
+        std::string matrix = identifier();
+        skipWS();
+        if (pos >= expr.size() || expr[pos] != ')')
+          throw Unsupported();
+        ++pos;
+        return std::string("b_reduce(rt, ") + cppLiteral(matrix) + ", " +
+               std::to_string(&r - REDUCTIONS) + ")";
+      }
+
+    std::vector<std::string> args;
+    skipWS();
+    if (pos < expr.size() && expr[pos] != ')') {
+      for (;;) {
+        args.push_back(sum());
+        skipWS();
+        if (pos < expr.size() && expr[pos] == ',') {
+          ++pos;
+          continue;
+        }
+        break;
+      }
+    }
+    if (pos >= expr.size() || expr[pos] != ')')
+      throw Unsupported();
+    ++pos;
+
+    if (name == "RND") {
+      if (args.size() > 1)
+        throw Unsupported(); // the interpreter reports the argument count
+      ++rndCalls;
+      return "b_rnd(rt)";
+    }
+    for (const Builtin &b : BUILTINS)
+      if (name == b.name) {
+        if (static_cast<int>(args.size()) != b.arity)
+          throw Unsupported();
+        std::string out;
+        for (const char *f = b.form; *f; ++f)
+          if (f[0] == '%' && (f[1] == '0' || f[1] == '1'))
+            out += args[*++f - '0'];
+          else
+            out += *f;
+        return out;
+      }
+    throw Unsupported(); // FN..., INSTR, EOF, LOC, ...
+  }
+};
+
+// Identifiers in a line outside string literals, without function and
+// matrix names (followed by '(') or string variables (followed by '$').
+std::set<std::string> namesIn(const std::string &code) {
+  std::set<std::string> names;
+  bool quoted = false;
+  for (size_t i = 0; i < code.size();) {
+    unsigned char c = code[i];
+    if (c == '"') {
+      quoted = !quoted;
+      ++i;
+    } else if (!quoted && std::isalpha(c)) {
+      size_t start = i;
+      while (i < code.size() &&
+             (std::isalnum(static_cast<unsigned char>(code[i])) ||
+              code[i] == '_'))
+        ++i;
+      size_t after = code.find_first_not_of(" \t", i);
+      if (after == std::string::npos ||
+          (code[after] != '(' && code[i] != '$'))
+        names.insert(code.substr(start, i - start));
+    } else {
+      ++i;
+    }
+  }
+  return names;
+}
+
+// Statements whose handlers may assign a variable named in the line
+bool assignsVariables(StatementType kind) {
+  switch (kind) {
+  case ST_PRINTexpr:
+  case ST_PRINTFILEUSING:
+  case ST_PRINT:
+  case ST_GOTO:
+  case ST_GOSUB:
+  case ST_RETURN:
+  case ST_END:
+  case ST_STOP:
+  case ST_REM:
+  case ST_DATA:
+  case ST_RESTORE:
+  case ST_FORMAT:
+  case ST_BEEP:
+  case ST_OPEN:
+  case ST_CLOSE:
+  case ST_FLUSH:
+  case ST_TRACE:
+  case ST_SEED:
+  case ST_DIM:
+  case ST_DEF:
+    return false;
+  default:
+    return true;
+  }
+}
+
+// True when `expr` only takes integer values given that the variables in
+// `ints` do: integer literals below 2^31, those variables, unary minus, +,
+// - and parentheses. Products are left out so values stay far from 2^53.
+class IntegerCheck {
+public:
+  IntegerCheck(const std::string &expr, const std::set<std::string> &ints)
+      : expr_(expr), ints_(ints) {}
+
+  bool valid() {
+    bool ok = sum();
+    skipWS();
+    return ok && pos_ == expr_.size();
+  }
+
+private:
+  const std::string &expr_;
+  const std::set<std::string> &ints_;
+  size_t pos_ = 0;
+
+  void skipWS() {
+    while (pos_ < expr_.size() && (expr_[pos_] == ' ' || expr_[pos_] == '\t'))
+      ++pos_;
+  }
+
+  bool sum() {
+    if (!operand())
+      return false;
+    for (;;) {
+      skipWS();
+      if (pos_ >= expr_.size() || (expr_[pos_] != '+' && expr_[pos_] != '-'))
+        return true;
+      ++pos_;
+      if (!operand())
+        return false;
+    }
+  }
+
+  bool operand() {
+    skipWS();
+    if (pos_ < expr_.size() && expr_[pos_] == '-') {
+      ++pos_;
+      skipWS();
+    }
+    if (pos_ >= expr_.size())
+      return false;
+    unsigned char c = expr_[pos_];
+    if (c == '(') {
+      ++pos_;
+      if (!sum())
+        return false;
+      skipWS();
+      return pos_ < expr_.size() && expr_[pos_++] == ')';
+    }
+    size_t start = pos_;
+    if (std::isdigit(c)) {
+      while (pos_ < expr_.size() &&
+             std::isdigit(static_cast<unsigned char>(expr_[pos_])))
+        ++pos_;
+      if (pos_ - start > 9 || (pos_ < expr_.size() &&
+                               (expr_[pos_] == '.' || expr_[pos_] == 'e' ||
+                                expr_[pos_] == 'E')))
+        return false;
+      return true;
+    }
+    if (!std::isalpha(c))
+      return false;
+    while (pos_ < expr_.size() &&
+           (std::isalnum(static_cast<unsigned char>(expr_[pos_])) ||
+            expr_[pos_] == '_'))
+      ++pos_;
+    if (pos_ < expr_.size() && (expr_[pos_] == '$' || expr_[pos_] == '('))
+      return false;
+    return ints_.count(expr_.substr(start, pos_ - start)) != 0;
+  }
+};
+
+class Transpiler {
+public:
+  // `known` lists the numeric variables with native locals; the first
+  // pass runs without it (and without types) to collect the facts that
+  // infer() works from.
+  Transpiler(PROGRAM_STRUCTURE &program, TranspileTarget target,
+             const VarTypes &types = VarTypes(),
+             const std::set<std::string> &known = {})
+      : program_(program), target_(target), types_(types), known_(known) {}
+
+  void translate() {
+    // Every entry of the statement table gets its own labelled block, so
+    // a line may hold several '\'-separated statements
+    buildStatementTable(program_);
+    const std::vector<ProgramStatement> &st = program_.statements;
+    // Compiled code cannot be re-entered at an error handler
+    for (const ProgramStatement &s : st)
+      if (classifyStatement(s.code) == ST_ON_ERROR)
+        throw std::runtime_error("TRANSPILE ERROR: ON ERROR at line " +
+                                 std::to_string(s.line) +
+                                 " needs the interpreter");
+    buildLoopTable(program_);
+    loopEnds_.insert(program_.loopEnds.begin(), program_.loopEnds.end());
+    loopStarts_.insert(program_.loopStarts.begin(), program_.loopStarts.end());
+    for (const auto &entry : loopEnds_)
+      if (classifyStatement(st[entry.first].code) == ST_FOR)
+        forsClosedBy_[entry.second].push_back(entry.first);
+    for (auto &entry : forsClosedBy_) // innermost (latest) FOR first
+      std::sort(entry.second.rbegin(), entry.second.rend());
+    for (const ProgramStatement &s : st)
+      returns_ = returns_ || classifyStatement(s.code) == ST_RETURN;
+    for (const ProgramStatement &s : st)
+      if (classifyStatement(s.code) == ST_DEF)
+        for (const std::string &name : namesIn(s.code))
+          fnReads_.insert(name);
+
+    for (size_t i = 0; i < st.size(); ++i) {
+      stmt_ = static_cast<int>(i);
+      line_ = st[i].line;
+      body_.str("");
+      statement(st[i].code);
+      blocks_.push_back(body_.str());
+    }
+  }
+
+  // Type inference over the translated program:
+  //   - a name used with '$' and never assigned as a number is a string;
+  //     numeric reads of it stay with the interpreter, which converts it
+  //   - a FOR counter is an integer when no LET or interpreted line
+  //     assigns it and every FOR on it starts and steps by integers
+  //     (which may involve other integer counters; iterated to a fixed
+  //     point)
+  //   - everything else is a double
+  VarTypes infer() const {
+    VarTypes types;
+    for (const auto &entry : program_.programSource)
+      for (const std::string &name : stringFormsIn(entry.second))
+        if (!letTargets_.count(name) && !forDefs_.count(name) &&
+            !sessionWritten_.count(name))
+          types.strings.insert(name);
+
+    for (const auto &def : forDefs_)
+      if (!letTargets_.count(def.first) && !sessionWritten_.count(def.first))
+        types.ints.insert(def.first);
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (auto it = types.ints.begin(); it != types.ints.end();) {
+        bool integral = true;
+        for (const auto &bounds : forDefs_.at(*it))
+          integral = integral &&
+                     IntegerCheck(bounds.first, types.ints).valid() &&
+                     IntegerCheck(bounds.second, types.ints).valid();
+        if (integral) {
+          ++it;
+        } else {
+          it = types.ints.erase(it);
+          changed = true;
+        }
+      }
+    }
+    return types;
+  }
+
+  // Variables the translated code reads or writes natively
+  std::set<std::string> nativeVariables(const VarTypes &types) const {
+    std::set<std::string> vars;
+    for (const std::string &v : vars_)
+      if (!types.strings.count(v))
+        vars.insert(v);
+    return vars;
+  }
+
+private:
+  PROGRAM_STRUCTURE &program_;
+  TranspileTarget target_;
+  VarTypes types_;
+  std::set<std::string> known_;                  // variables with locals
+  std::ostringstream body_;            // code of the current statement
+  std::vector<std::string> blocks_;    // code of each statement
+  int stmt_ = 0, line_ = 0;            // current statement and its line
+  std::set<std::string> vars_;
+  std::vector<std::string> strings_;   // S0, S1, ...: fallback texts
+  std::set<int> endLabels_;            // statements with an X label
+  std::map<int, bool> forStatements_;  // FOR -> integer counter
+  std::map<int, std::vector<int>> forsClosedBy_; // NEXT -> FORs
+  std::map<int, int> loopEnds_, loopStarts_;     // the loop table
+  int returnSites_ = 0;                // R0, R1, ...: after each GOSUB
+  bool returns_ = false;               // the program has a RETURN
+
+  // Facts for infer()
+  std::set<std::string> letTargets_;
+  std::map<std::string, std::vector<std::pair<std::string, std::string>>>
+      forDefs_;                          // counter -> (start, step) per FOR
+  std::set<std::string> sessionWritten_; // named in interpreted writers
+  std::set<std::string> fnReads_;        // named in DEF FN lines
+
+  // Names written with a '$' suffix
+  static std::set<std::string> stringFormsIn(const std::string &code) {
+    std::set<std::string> names;
+    bool quoted = false;
+    for (size_t i = 0; i < code.size();) {
+      if (code[i] == '"') {
+        quoted = !quoted;
+        ++i;
+      } else if (!quoted && std::isalpha(static_cast<unsigned char>(code[i]))) {
+        size_t start = i;
+        while (i < code.size() &&
+               (std::isalnum(static_cast<unsigned char>(code[i])) ||
+                code[i] == '_'))
+          ++i;
+        if (i < code.size() && code[i] == '$')
+          names.insert(code.substr(start, i - start));
+      } else {
+        ++i;
+      }
+    }
+    return names;
+  }
+
+  // Session slot stores for the native variables `code` may read, with
+  // those a DEF FN body it calls may read
+  std::vector<std::string> spills(const std::string &code) const {
+    static const std::regex fnCall(R"(\bFN\s*[A-Z][A-Z0-9_]*\s*\()",
+                                   std::regex::icase);
+    std::set<std::string> names = namesIn(code);
+    if (std::regex_search(code, fnCall))
+      names.insert(fnReads_.begin(), fnReads_.end());
+    std::vector<std::string> out;
+    for (const std::string &name : names)
+      if (known_.count(name))
+        out.push_back("S_" + name + " = " +
+                      (types_.ints.count(name) ? "double(V_" + name + ")"
+                                               : "V_" + name));
+    return out;
+  }
+
+  // Reloads after the interpreter ran `code`, and the note for infer()
+  void reload(const std::string &code) {
+    for (const std::string &name : namesIn(code)) {
+      sessionWritten_.insert(name);
+      if (known_.count(name) && !types_.ints.count(name))
+        body_ << "  V_" << name << " = S_" << name << ";\n";
+    }
+  }
+
+  // Statement that runs `call` on the session's copy of the variables
+  void sessionCall(const std::string &code, const std::string &call,
+                   bool writes) {
+    for (const std::string &store : spills(code))
+      body_ << "  " << store << ";\n";
+    body_ << "  " << call << ";\n";
+    if (writes)
+      reload(code);
+  }
+
+  std::string stringConstant(const std::string &text) {
+    strings_.push_back(text);
+    return "S" + std::to_string(strings_.size() - 1);
+  }
+
+  // Native C++ for a numeric expression, or an interpreted fallback (which
+  // only reads variables, so it needs their current values stored back)
+  std::string numeric(const std::string &expr) {
+    ExprTranslator t(expr, types_);
+    try {
+      std::string out = t.translate();
+      vars_.insert(t.vars.begin(), t.vars.end());
+      return out;
+    } catch (const Unsupported &) {
+      std::string call = "b_eval(rt, " + stringConstant(trim(expr)) + ")";
+      std::vector<std::string> stores = spills(expr);
+      if (stores.empty())
+        return call;
+      std::string out = "(";
+      for (const std::string &store : stores)
+        out += store + ", ";
+      return out + call + ")";
+    }
+  }
+
+  std::string runtimeError(const std::string &message) {
+    return "throw std::runtime_error(" + cppLiteral("RUNTIME ERROR: " + message) +
+           ");";
+  }
+
+  // Label of statement i: L<line> for the first statement of a line,
+  // L<line>_2, L<line>_3, ... for the ones after it. The X form marks the
+  // point just past the statement, F the FOR variables of a FOR.
+  std::string label(char kind, int i) const {
+    const std::vector<ProgramStatement> &st = program_.statements;
+    int first = i;
+    while (first > 0 && st[first - 1].line == st[i].line)
+      --first;
+    std::string name = kind + std::to_string(st[i].line);
+    if (i > first)
+      name += "_" + std::to_string(i - first + 1);
+    return name;
+  }
+
+  // Index of the statement after the current one, -1 past the end
+  int nextStatementIndex() const {
+    return stmt_ + 1 < static_cast<int>(program_.statements.size())
+               ? stmt_ + 1
+               : -1;
+  }
+
+  // Code for a jump to the line after the current statement's
+  std::string jumpPastLine() const {
+    const std::vector<ProgramStatement> &st = program_.statements;
+    size_t i = stmt_;
+    while (i < st.size() && st[i].line == line_)
+      ++i;
+    return i == st.size() ? "goto done;"
+                          : "goto L" + std::to_string(st[i].line) + ";";
+  }
+
+  // Code for a jump to line `target`
+  std::string jumpTo(int target) {
+    if (!program_.programSource.count(target))
+      return runtimeError("Undefined line " + std::to_string(target));
+    return "goto L" + std::to_string(target) + ";";
+  }
+
+  // Code that calls line `target` as a subroutine; the return site label
+  // is placed right after it.
+  std::string gosubTo(int target, int &site) {
+    site = returnSites_++;
+    return "if (sp == GOSUB_LIMIT) " +
+           runtimeError("Stack overflow (" +
+                        std::to_string(DEFAULT_FRAME_LIMIT) +
+                        " frames) at line " + std::to_string(line_)) +
+           "\n  " + pushReturn(site) + "\n  " + jumpTo(target);
+  }
+
+  // Records return site `site`; with no RETURN in the program only the
+  // depth is kept, for the stack overflow check.
+  std::string pushReturn(int site) const {
+    if (!returns_)
+      return "++sp;";
+    return "gosubStack[sp++] = " + std::to_string(site) + ";";
+  }
+
+  // Where a GOSUB's RETURN comes back to (no label when nothing returns,
+  // as it would be unused)
+  void returnLabel(int site) {
+    if (returns_)
+      body_ << "R" << site << ":;\n";
+  }
+
+  // Statement through the interpreter's handler; leave the native flow
+  // when the handler moved elsewhere (GOTO in an IF, END, ...).
+  void interpret(const std::string &code) {
+    sessionCall(code, "next = interp(rt, " + std::to_string(stmt_) + ")",
+                assignsVariables(classifyStatement(code)));
+    body_ << "  if (next != " << nextStatementIndex()
+          << ")\n    goto dispatch;\n";
+  }
+
+  void statement(const std::string &code) {
+    static const std::regex letRe(
+        R"(^\s*LET\s+([A-Z][A-Z0-9_]{0,31})\s*=\s*(.+)$)", std::regex::icase);
+    static const std::regex gotoRe(R"(^\s*GO\s*TO\s+(\d+)\s*$)",
+                                   std::regex::icase);
+    static const std::regex gosubRe(R"(^\s*GOSUB\s+(\d+)\s*$)",
+                                    std::regex::icase);
+    static const std::regex ifRe(R"(^\s*IF\s+(.+?)\s+THEN\s+(.+)$)",
+                                 std::regex::icase);
+    static const std::regex whileRe(R"(^\s*WHILE\s+(.+)$)", std::regex::icase);
+    static const std::regex untilRe(R"(^\s*UNTIL\s+(.+)$)", std::regex::icase);
+
+    std::smatch m;
+    switch (classifyStatement(code)) {
+    case ST_REM:
+    case ST_DATA: // DATA items were pooled from the embedded source
+    case ST_REPEAT:
+      return;
+    case ST_END:
+      body_ << "  goto done;\n";
+      return;
+    case ST_LET:
+      if (std::regex_match(code, m, letRe)) {
+        std::string value = numeric(m[2]);
+        vars_.insert(m[1]);
+        letTargets_.insert(m[1]);
+        body_ << "  V_" << m[1] << " = " << value << ";\n";
+        return;
+      }
+      break; // string LET
+    case ST_GOTO:
+      if (std::regex_match(code, m, gotoRe)) {
+        body_ << "  " << jumpTo(std::stoi(m[1])) << "\n";
+        return;
+      }
+      break;
+    case ST_GOSUB:
+      if (std::regex_match(code, m, gosubRe)) {
+        int site;
+        body_ << "  " << gosubTo(std::stoi(m[1]), site) << "\n";
+        returnLabel(site);
+        return;
+      }
+      break;
+    case ST_RETURN:
+      body_ << "  goto do_return;\n";
+      return;
+    case ST_IF:
+      if (std::regex_match(code, m, ifRe) && ifStatement(m[1], m[2]))
+        return;
+      break;
+    case ST_ON: {
+      JumpTable table;
+      if (!parseON(code, table))
+        throw std::runtime_error("TRANSPILE ERROR: Invalid ON at line " +
+                                 std::to_string(line_));
+      onStatement(table);
+      return;
+    }
+    case ST_FOR:
+      if (nativeLoop(stmt_) && std::regex_match(code, m, FOR_RE)) {
+        forStatement(m[1], m[2], m[3], m[4].matched ? m[4].str() : "1");
+        return;
+      }
+      break;
+    case ST_NEXT:
+      if (nativeNext(stmt_) && std::regex_match(code, m, NEXT_RE)) {
+        nextStatement(m[1]);
+        return;
+      }
+      break;
+    case ST_WHILE:
+      if (std::regex_match(code, m, whileRe)) {
+        auto end = loopEnds_.find(stmt_);
+        body_ << "  if (" << numeric(m[1]) << " == 0.0)\n    ";
+        if (end == loopEnds_.end()) {
+          body_ << runtimeError("WHILE without WEND at line " +
+                                std::to_string(line_))
+                << "\n";
+        } else {
+          endLabels_.insert(end->second);
+          body_ << "goto " << label('X', end->second) << ";\n";
+        }
+        return;
+      }
+      break;
+    case ST_WEND: {
+      auto start = loopStarts_.find(stmt_);
+      if (start == loopStarts_.end())
+        body_ << "  "
+              << runtimeError("WEND without WHILE at line " +
+                              std::to_string(line_))
+              << "\n";
+      else
+        body_ << "  goto " << label('L', start->second) << ";\n";
+      return;
+    }
+    case ST_UNTIL:
+      if (std::regex_match(code, m, untilRe)) {
+        auto start = loopStarts_.find(stmt_);
+        if (start == loopStarts_.end()) {
+          body_ << "  "
+                << runtimeError("UNTIL without REPEAT at line " +
+                                std::to_string(line_))
+                << "\n";
+        } else {
+          endLabels_.insert(start->second);
+          body_ << "  if (" << numeric(m[1]) << " == 0.0)\n    goto "
+                << label('X', start->second) << ";\n";
+        }
+        return;
+      }
+      break;
+    case ST_MATops:
+      sessionCall(code, "b_mat(rt, " + stringConstant(code) + ")", true);
+      return;
+    default:
+      break;
+    }
+    interpret(code);
+  }
+
+  // IF cond THEN <line> | GOTO n | GOSUB n | LET ... | END. Returns
+  // false for other statements, which take the interpreted path. A false
+  // condition also skips the statements after the IF on its line.
+  bool ifStatement(const std::string &cond, const std::string &then) {
+    static const std::regex lineRe(R"(^\s*(?:GO\s*TO\s+)?(\d+)\s*$)",
+                                   std::regex::icase);
+    static const std::regex gosubRe(R"(^\s*GOSUB\s+(\d+)\s*$)",
+                                    std::regex::icase);
+    static const std::regex letRe(
+        R"(^\s*LET\s+([A-Z][A-Z0-9_]{0,31})\s*=\s*(.+)$)", std::regex::icase);
+    static const std::regex endRe(R"(^\s*END\s*$)", std::regex::icase);
+    std::smatch m;
+    std::string action;
+    int site = -1;
+    if (std::regex_match(then, m, lineRe)) {
+      action = jumpTo(std::stoi(m[1]));
+    } else if (std::regex_match(then, m, gosubRe)) {
+      action = gosubTo(std::stoi(m[1]), site);
+    } else if (std::regex_match(then, m, letRe)) {
+      std::string value = numeric(m[2]);
+      vars_.insert(m[1]);
+      letTargets_.insert(m[1]);
+      action = "V_" + m[1].str() + " = " + value + ";";
+    } else if (std::regex_match(then, endRe)) {
+      action = "goto done;";
+    } else {
+      return false;
+    }
+    size_t at = 0;
+    while ((at = action.find('\n', at)) != std::string::npos)
+      action.replace(at, 1, "\n  "), at += 3;
+    body_ << "  if (" << numeric(cond) << " != 0.0) {\n    " << action
+          << "\n  }";
+    const std::vector<ProgramStatement> &st = program_.statements;
+    if (stmt_ + 1 < static_cast<int>(st.size()) && st[stmt_ + 1].line == line_)
+      body_ << " else {\n    " << jumpPastLine() << "\n  }";
+    body_ << "\n";
+    if (site >= 0)
+      returnLabel(site);
+    return true;
+  }
+
+  // ON expr GOTO|GOSUB l1, l2, ...: a switch on INT(expr); values outside
+  // 1..n fall through to the next line.
+  void onStatement(const JumpTable &table) {
+    const std::vector<int> &targets = table.lines;
+    bool gosub = table.gosub;
+    int site = -1;
+    if (gosub)
+      site = returnSites_++;
+    body_ << "  switch (b_index(" << numeric(table.selector) << ", "
+          << targets.size() << ")) {\n";
+    for (size_t i = 0; i < targets.size(); ++i) {
+      body_ << "  case " << i + 1 << ":\n";
+      if (gosub)
+        body_ << "    if (sp == GOSUB_LIMIT) "
+              << runtimeError("Stack overflow (" +
+                              std::to_string(DEFAULT_FRAME_LIMIT) +
+                              " frames) at line " + std::to_string(line_))
+              << "\n    " << pushReturn(site) << "\n";
+      body_ << "    " << jumpTo(targets[i]) << "\n";
+    }
+    body_ << "  }\n";
+    if (gosub)
+      returnLabel(site);
+  }
+
+  // A loop runs natively only when its FOR and the NEXT that closes it
+  // both do: the two halves share the F<n> limit and step, and a NEXT
+  // left to the interpreter looks for the interpreter's FOR frame.
+  bool nativeNext(int next) const {
+    auto fors = forsClosedBy_.find(next);
+    if (!std::regex_match(program_.statements[next].code, NEXT_RE))
+      return false;
+    if (fors != forsClosedBy_.end())
+      for (int f : fors->second)
+        if (!std::regex_match(program_.statements[f].code, FOR_RE))
+          return false;
+    return true;
+  }
+
+  bool nativeLoop(int forStatement) const {
+    auto end = loopEnds_.find(forStatement);
+    return end == loopEnds_.end() || nativeNext(end->second);
+  }
+
+  void forStatement(const std::string &var, const std::string &start,
+                    const std::string &limit, const std::string &step) {
+    vars_.insert(var);
+    forDefs_[var].emplace_back(start, step);
+    bool integer = types_.ints.count(var) != 0;
+    auto end = loopEnds_.find(stmt_);
+    if (integer) // integral start and step; the limit becomes integral too
+      body_ << "  {\n    long long s = static_cast<long long>("
+            << numeric(start) << ");\n    double l = " << numeric(limit)
+            << ";\n    long long st = static_cast<long long>("
+            << numeric(step) << ");\n";
+    else
+      body_ << "  {\n    double s = " << numeric(start)
+            << ", l = " << numeric(limit) << ", st = " << numeric(step)
+            << ";\n";
+    body_ << "    V_" << var << " = s;\n";
+    if (end == loopEnds_.end()) {
+      // No NEXT closes it, so the loop never goes round: it needs no
+      // limit, step or label to come back to
+      body_ << "    if (st >= 0 ? s > l : s < l)\n      "
+            << runtimeError("FOR without NEXT at line " +
+                            std::to_string(line_))
+            << "\n  }\n";
+      return;
+    }
+    forStatements_[stmt_] = integer;
+    std::string f = label('F', stmt_);
+    body_ << "    " << f << "_lim = " << (integer ? "b_ilimit(l, st)" : "l")
+          << ";\n    " << f << "_step = st;\n"
+          << "    if (st >= 0 ? s > l : s < l)\n      goto "
+          << label('X', end->second) << ";\n  }\n";
+    endLabels_.insert(end->second);
+    endLabels_.insert(stmt_); // NEXT loops back to just past the FOR
+  }
+
+  void nextStatement(const std::string &list) {
+    static const std::regex forVarRe(R"(^\s*FOR\s+([A-Z][A-Z0-9_]{0,31}))",
+                                     std::regex::icase);
+    std::vector<std::string> names;
+    std::stringstream ss(list);
+    std::string tok;
+    while (std::getline(ss, tok, ','))
+      names.push_back(trim(tok));
+    if (names.empty())
+      names.push_back("");
+
+    const std::vector<int> &fors = forsClosedBy_[stmt_];
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (i >= fors.size()) // e.g. a second NEXT for one FOR
+        throw std::runtime_error("TRANSPILE ERROR: NEXT at line " +
+                                 std::to_string(line_) +
+                                 " pairs with no FOR");
+      std::smatch m;
+      const std::string &forCode = program_.statements[fors[i]].code;
+      std::regex_search(forCode, m, forVarRe);
+      std::string var = m[1];
+      if (!names[i].empty() && names[i] != var)
+        throw std::runtime_error("TRANSPILE ERROR: NEXT " + names[i] +
+                                 " at line " + std::to_string(line_) +
+                                 " closes FOR " + var + " at line " +
+                                 std::to_string(
+                                     program_.statements[fors[i]].line));
+      std::string f = label('F', fors[i]);
+      body_ << "  V_" << var << " += " << f << "_step;\n  if (" << f
+            << "_step >= 0 ? V_" << var << " <= " << f << "_lim : V_" << var
+            << " >= " << f << "_lim)\n    goto " << label('X', fors[i])
+            << ";\n";
+    }
+  }
+
+public:
+  void emit(std::ostream &out) {
+    bool module = target_ == TRANSPILE_MODULE;
+    out << "// Generated by TRANSPILE";
+    if (!program_.filename.empty())
+      out << " from " << program_.filename;
+    if (module)
+      out << ": RUN NATIVE module (see native.h)\n\n";
+    else
+      out << ". Build against the interpreter\n"
+             "// sources (src/*.cpp except basic_runtime_env.cpp), e.g.\n"
+             "//   g++ -std=c++17 -O2 -Iinclude prog.cpp src/... -pthread\n\n"
+             "#include \"interpreter.h\"\n"
+             "#include \"matrixops.h\"\n"
+             "#include \"program_structure.h\"\n\n";
+    out << "#include <cmath>\n";
+    if (!module)
+      out << "#include <iostream>\n";
+    out << "#include <stdexcept>\n"
+           "#include <string>\n\n";
+
+    if (!module) {
+      out << "static const struct {\n  int line;\n  const char *code;\n"
+             "} SOURCE[] = {\n";
+      for (const auto &entry : program_.programSource)
+        out << "    {" << entry.first << ", " << cppLiteral(entry.second)
+            << "},\n";
+      out << "};\n\n";
+    }
+
+    for (size_t i = 0; i < strings_.size(); ++i)
+      out << "static const char *const S" << i << " = "
+          << cppLiteral(strings_[i]) << ";\n";
+    if (!strings_.empty())
+      out << "\n";
+
+    // Session access: b_var, interp, b_eval, b_mat, b_reduce, b_rnd,
+    // b_finish. The helpers are inline: a program uses only some of them,
+    // and unused inline functions draw no warning.
+    if (module)
+      out << "struct NativeHost {\n  "
+             NATIVE_XTEXT(BASIC_NATIVE_HOST_FIELDS)
+             "\n};\n"
+             "typedef const NativeHost Runtime;\n\n"
+             "static inline double &b_var(Runtime &rt, const char *name) {\n"
+             "  return *rt.variable(rt.program, name);\n}\n"
+             "static inline int interp(Runtime &rt, int statement) {\n"
+             "  return rt.step(rt.program, statement);\n}\n"
+             "static inline double b_eval(Runtime &rt, const char *expr) {\n"
+             "  return rt.eval(rt.program, expr);\n}\n"
+             "static inline void b_mat(Runtime &rt, const char *line) {\n"
+             "  rt.mat(rt.program, line);\n}\n"
+             "static inline double b_reduce(Runtime &rt, const char *matrix, "
+             "int op) {\n"
+             "  return rt.reduce(rt.program, matrix, op);\n}\n"
+             "static inline double b_rnd(Runtime &rt) {\n"
+             "  return rt.rnd(rt.program);\n}\n"
+             "static inline void b_finish(Runtime &rt) {\n"
+             "  rt.finish(rt.program);\n}\n\n";
+    else
+      out << "typedef PROGRAM_STRUCTURE Runtime;\n\n"
+             "static inline double &b_var(Runtime &rt, const char *name) {\n"
+             "  return rt.numericVariables[name].numericValue;\n}\n"
+             "// Run one statement through the interpreter; the statement it "
+             "continues\n// at, or -1 once the program has stopped.\n"
+             "static inline int interp(Runtime &rt, int statement) {\n"
+             "  moveToStatement(rt, statement);\n"
+             "  return stepInterpreter(rt) ? rt.currentStatement : -1;\n}\n"
+             "static inline double b_eval(Runtime &rt, const char *expr) {\n"
+             "  return evalExpression(rt, expr);\n}\n"
+             "static inline void b_mat(Runtime &rt, const char *line) {\n"
+             "  executeMATops(rt, line);\n}\n"
+             "static inline double b_reduce(Runtime &rt, const char *matrix, "
+             "int op) {\n"
+             "  return matReduce(matrixNamed(rt, matrix), "
+             "static_cast<MatReduction>(op));\n}\n"
+             "static inline double b_rnd(Runtime &rt) {\n"
+             "  return rt.rng.nextDouble();\n}\n"
+             "static inline void b_finish(Runtime &rt) {\n"
+             "  rt.running = false;\n}\n\n";
+
+    out << "static inline double b_rel(bool c) { return c ? -1.0 : 0.0; }\n"
+           "static inline double b_not(double a) {\n"
+           "  return a == 0.0 ? -1.0 : 0.0;\n}\n"
+           "static inline double b_and(double a, double b) {\n"
+           "  return a != 0.0 && b != 0.0 ? -1.0 : 0.0;\n}\n"
+           "static inline double b_or(double a, double b) {\n"
+           "  return a != 0.0 || b != 0.0 ? -1.0 : 0.0;\n}\n"
+           "static inline double b_sgn(double a) {\n"
+           "  return a > 0.0 ? 1.0 : a < 0.0 ? -1.0 : 0.0;\n}\n"
+           "static inline double b_div(double a, double b) {\n"
+           "  if (b == 0.0)\n"
+           "    throw std::runtime_error(\"Division by zero\");\n"
+           "  return a / b;\n}\n"
+           "// ON index: INT(v) when it is within 1..n, else 0\n"
+           "static inline int b_index(double v, size_t n) {\n"
+           "  double k = std::floor(v);\n"
+           "  return k >= 1 && k <= static_cast<double>(n) ? "
+           "static_cast<int>(k) : 0;\n}\n"
+           "// Integer counters: the session value on entry, and the last "
+           "value a FOR\n// limit allows (clamped so stepping cannot "
+           "overflow)\n"
+           "static inline long long b_toint(double v) {\n"
+           "  return std::fabs(v) < 0x1p62 ? static_cast<long long>(v) : 0;\n}\n"
+           "static inline long long b_ilimit(double l, long long step) {\n"
+           "  if (std::isnan(l))\n"
+           "    return step >= 0 ? -(1LL << 62) : 1LL << 62;\n"
+           "  l = step >= 0 ? std::floor(l) : std::ceil(l);\n"
+           "  return l > 0x1p62    ? 1LL << 62\n"
+           "         : l < -0x1p62 ? -(1LL << 62)\n"
+           "                       : static_cast<long long>(l);\n}\n\n";
+
+    out << "static const size_t GOSUB_LIMIT = " << DEFAULT_FRAME_LIMIT
+        << ";\n\n"
+           "static void run(Runtime &rt) {\n";
+    // S_<name> is the session's slot (M_ would meet the <cmath>
+    // constants: M_E, M_PI), V_<name> the local the code runs on;
+    // slots are brought up to date around interpreted lines and on exit.
+    std::string storeAll;
+    for (const std::string &v : known_) {
+      bool integer = types_.ints.count(v) != 0;
+      out << "  double &S_" << v << " = b_var(rt, " << cppLiteral(v)
+          << ");\n";
+      if (integer)
+        out << "  long long V_" << v << " = b_toint(S_" << v << ");\n";
+      else
+        out << "  double V_" << v << " = S_" << v << ";\n";
+      storeAll += "  S_" + v + " = " +
+                  (integer ? "double(V_" + v + ")" : "V_" + v) + ";\n";
+    }
+    for (const auto &f : forStatements_)
+      out << "  " << (f.second ? "long long" : "double") << " "
+          << label('F', f.first) << "_lim = 0, " << label('F', f.first)
+          << "_step = 0;\n";
+    if (returns_)
+      out << "  int gosubStack[GOSUB_LIMIT];\n";
+    if (returns_ || returnSites_ > 0)
+      out << "  size_t sp = 0;\n";
+    // `next` is the statement to go on at, -1 once the program has
+    // stopped; the run enters through the same switch as the returns from
+    // interpreted statements.
+    out << "  int next = 0;\n\n"
+           "  try {\n"
+           "  goto dispatch;\n";
+    for (int i = 0; i < static_cast<int>(blocks_.size()); ++i) {
+      out << label('L', i) << ":\n" << blocks_[i];
+      if (endLabels_.count(i))
+        out << label('X', i) << ":;\n";
+    }
+    out << "  goto done;\n\n";
+
+    out << "dispatch:\n  switch (next) {\n";
+    for (int i = 0; i < static_cast<int>(blocks_.size()); ++i)
+      out << "  case " << i << ":\n    goto " << label('L', i) << ";\n";
+    out << "  }\n  goto done;\n";
+
+    if (returns_) {
+      out << "\ndo_return:\n  if (sp == 0)\n    throw std::runtime_error("
+             "\"RUNTIME ERROR: RETURN without GOSUB\");\n"
+             "  switch (gosubStack[--sp]) {\n";
+      for (int i = 0; i < returnSites_; ++i)
+        out << "  case " << i << ":\n    goto R" << i << ";\n";
+      out << "  }\n";
+    }
+    out << "  } catch (...) {\n"
+        << storeAll << "    throw;\n  }\n\ndone:\n"
+        << storeAll << "  b_finish(rt);\n}\n\n";
+
+    if (module) {
+      out << "extern \"C\" int basic_native_abi() { return "
+          << BASIC_NATIVE_ABI
+          << "; }\n\n"
+             "extern \"C\" void basic_native_run(const NativeHost *host) {\n"
+             "  run(*host);\n}\n";
+      return;
+    }
+    out << "int main() {\n"
+           "  PROGRAM_STRUCTURE rt;\n"
+           "  for (const auto &line : SOURCE)\n"
+           "    rt.programSource[line.line] = line.code;\n"
+           "  try {\n"
+           "    startInterpreter(rt);\n"
+           "    run(rt);\n"
+           "  } catch (const std::exception &e) {\n"
+           "    basicFlush(rt);\n"
+           "    std::cerr << \"Runtime error: \" << e.what() << std::endl;\n"
+           "    return 1;\n"
+           "  }\n"
+           "  basicFlush(rt);\n"
+           "  return 0;\n"
+           "}\n";
+  }
+};
+
+} // namespace
+
+void transpileProgram(PROGRAM_STRUCTURE &program, std::ostream &out,
+                      TranspileTarget target) {
+  // The first pass gathers the facts for type inference; the second
+  // translates with the inferred types.
+  Transpiler facts(program, target);
+  facts.translate();
+  VarTypes types = facts.infer();
+  Transpiler typed(program, target, types, facts.nativeVariables(types));
+  typed.translate();
+  typed.emit(out);
+}
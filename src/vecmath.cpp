@@ -0,0 +1,440 @@
+#include "vecmath.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Four lanes of doubles / 64-bit integers as GCC/Clang vector types: one
+// AVX2 register, or two SSE2 registers on a baseline x86-64 build.
+constexpr int VLEN = 4;
+// The vectors never cross a translation-unit boundary
+#pragma GCC diagnostic ignored "-Wpsabi"
+typedef double VecD __attribute__((vector_size(VLEN * 8)));
+typedef int64_t VecI __attribute__((vector_size(VLEN * 8)));
+
+// Everything below is inlined into the exported kernels, which are built
+// twice (AVX2+FMA and baseline) and picked at load time, so baseline
+// builds still run the 4-lane code on AVX2 machines.
+#define VM_INLINE static inline __attribute__((always_inline))
+#if defined(__x86_64__) && defined(__gnu_linux__) && !defined(__AVX2__)
+#define VM_CLONES __attribute__((target_clones("avx2,fma", "default")))
+#else
+#define VM_CLONES
+#endif
+
+template <class To, class From> VM_INLINE To bitsAs(const From &v) {
+  static_assert(sizeof(To) == sizeof(From), "size mismatch");
+  To t;
+  std::memcpy(&t, &v, sizeof(t));
+  return t;
+}
+
+VM_INLINE VecD splat(double v) { return VecD{v, v, v, v}; }
+
+VM_INLINE bool allLanes(const VecI &mask) {
+  for (int k = 0; k < VLEN; ++k)
+    if (!mask[k])
+      return false;
+  return true;
+}
+
+// mask ? a : b, lane by lane (mask lanes are all ones or all zeros)
+VM_INLINE VecD select(const VecI &mask, const VecD &a, const VecD &b) {
+  return bitsAs<VecD>((mask & bitsAs<VecI>(a)) | (~mask & bitsAs<VecI>(b)));
+}
+
+// 1.5 * 2^52: adding it rounds to an integer, which then sits in the low
+// mantissa bits.
+static const double ROUND_MAGIC = 6755399441055744.0;
+
+// round(v) both as a double and as an integer
+VM_INLINE VecD roundLanes(const VecD &v, VecI &asInt) {
+  VecD t = v + ROUND_MAGIC;
+  asInt = bitsAs<VecI>(t) - bitsAs<VecI>(splat(ROUND_MAGIC));
+  return t - ROUND_MAGIC;
+}
+
+// Integer lanes (|i| < 2^51) converted to double without cvtqq2pd
+VM_INLINE VecD toDouble(const VecI &i) {
+  return bitsAs<VecD>(i + bitsAs<VecI>(splat(ROUND_MAGIC))) - ROUND_MAGIC;
+}
+
+// One vector through Block, or lane by lane through Scalar when any lane
+// fails InRange.
+template <VecD (*Block)(const VecD &), VecI (*InRange)(const VecD &),
+          double (*Scalar)(double)>
+VM_INLINE void kernelStep(const double *x, double *y) {
+  VecD v;
+  std::memcpy(&v, x, sizeof(v));
+  if (allLanes(InRange(v))) {
+    VecD r = Block(v);
+    std::memcpy(y, &r, sizeof(r));
+  } else {
+    for (int k = 0; k < VLEN; ++k)
+      y[k] = Scalar(x[k]);
+  }
+}
+
+// Full vectors straight from x; the tail is padded into a local block so it
+// goes through the same code as the body.
+template <VecD (*Block)(const VecD &), VecI (*InRange)(const VecD &),
+          double (*Scalar)(double)>
+VM_INLINE void runKernel(const double *x, double *y, size_t n) {
+  size_t i = 0;
+  for (; i + VLEN <= n; i += VLEN)
+    kernelStep<Block, InRange, Scalar>(x + i, y + i);
+  if (i < n) {
+    double in[VLEN], out[VLEN];
+    for (int k = 0; k < VLEN; ++k)
+      in[k] = x[i + k < n ? i + k : i];
+    kernelStep<Block, InRange, Scalar>(in, out);
+    for (size_t k = 0; i + k < n; ++k)
+      y[i + k] = out[k];
+  }
+}
+
+//---------------------------------------------------------------------------
+// sin / cos / tan
+//---------------------------------------------------------------------------
+
+static const double TWO_OVER_PI = 6.36619772367581382433e-01;
+// pi/2 in three parts (fdlibm); j * PIO2_1 is exact for |j| < 2^20
+static const double PIO2_1 = 1.57079632673412561417e+00;
+static const double PIO2_2 = 6.07710050630396597660e-11;
+static const double PIO2_3 = 2.02226624871116645580e-21;
+static const double TRIG_LIMIT = 1e5;
+
+// sin and cos on [-pi/4, pi/4] (Cephes coefficients), z = r * r
+VM_INLINE VecD sinPoly(const VecD &r, const VecD &z) {
+  VecD p = 1.58962301576546568060e-10 * z - 2.50507477628578072866e-8;
+  p = p * z + 2.75573136213857245213e-6;
+  p = p * z - 1.98412698295895385996e-4;
+  p = p * z + 8.33333333332211858878e-3;
+  p = p * z - 1.66666666666666307295e-1;
+  return r + r * z * p;
+}
+
+VM_INLINE VecD cosPoly(const VecD &z) {
+  VecD p = -1.13585365213876817300e-11 * z + 2.08757008419747316778e-9;
+  p = p * z - 2.75573141792967388112e-7;
+  p = p * z + 2.48015872888517045348e-5;
+  p = p * z - 1.38888888888730564116e-3;
+  p = p * z + 4.16666666666665929218e-2;
+  return (1.0 - 0.5 * z) + z * z * p;
+}
+
+// x = j * pi/2 + r with |r| <= pi/4; returns r, j in q
+VM_INLINE VecD reduceHalfPi(const VecD &x, VecI &q) {
+  VecD j = roundLanes(x * TWO_OVER_PI, q);
+  return ((x - j * PIO2_1) - j * PIO2_2) - j * PIO2_3;
+}
+
+VM_INLINE VecI trigInRange(const VecD &x) {
+  return (x <= TRIG_LIMIT) & (x >= -TRIG_LIMIT);
+}
+
+VM_INLINE VecD sinBlock(const VecD &x) {
+  VecI q;
+  VecD r = reduceHalfPi(x, q);
+  VecD z = r * r;
+  VecD v = select((q & 1) == 1, cosPoly(z), sinPoly(r, z));
+  return bitsAs<VecD>(bitsAs<VecI>(v) ^ ((q & 2) << 62));
+}
+
+VM_INLINE VecD cosBlock(const VecD &x) {
+  VecI q;
+  VecD r = reduceHalfPi(x, q);
+  VecD z = r * r;
+  VecD v = select((q & 1) == 1, sinPoly(r, z), cosPoly(z));
+  return bitsAs<VecD>(bitsAs<VecI>(v) ^ (((q + 1) & 2) << 62));
+}
+
+VM_INLINE VecD tanBlock(const VecD &x) {
+  VecI q;
+  VecD r = reduceHalfPi(x, q);
+  VecD z = r * r;
+  VecD s = sinPoly(r, z), c = cosPoly(z);
+  VecI odd = (q & 1) == 1;
+  return select(odd, -c / s, s / c);
+}
+
+static double scalarSin(double v) { return std::sin(v); }
+static double scalarCos(double v) { return std::cos(v); }
+static double scalarTan(double v) { return std::tan(v); }
+
+VM_CLONES void vecSin(const double *x, double *y, size_t n) {
+  runKernel<sinBlock, trigInRange, scalarSin>(x, y, n);
+}
+VM_CLONES void vecCos(const double *x, double *y, size_t n) {
+  runKernel<cosBlock, trigInRange, scalarCos>(x, y, n);
+}
+VM_CLONES void vecTan(const double *x, double *y, size_t n) {
+  runKernel<tanBlock, trigInRange, scalarTan>(x, y, n);
+}
+
+//---------------------------------------------------------------------------
+// exp / log
+//---------------------------------------------------------------------------
+
+static const double LOG2E = 1.44269504088896338700e+00;
+static const double LN2_HI = 6.93147180369123816490e-01;
+static const double LN2_LO = 1.90821492927058770002e-10;
+static const double EXP_LIMIT = 708.0;
+
+VM_INLINE VecI expInRange(const VecD &x) {
+  return (x <= EXP_LIMIT) & (x >= -EXP_LIMIT);
+}
+
+// exp(x) = 2^k * exp(r), |r| <= ln2/2; Taylor series to r^13
+VM_INLINE VecD expBlock(const VecD &x) {
+  VecI k;
+  VecD kd = roundLanes(x * LOG2E, k);
+  VecD r = (x - kd * LN2_HI) - kd * LN2_LO;
+  VecD p = (1.0 / 6227020800.0) * r + 1.0 / 479001600.0;
+  p = p * r + 1.0 / 39916800.0;
+  p = p * r + 1.0 / 3628800.0;
+  p = p * r + 1.0 / 362880.0;
+  p = p * r + 1.0 / 40320.0;
+  p = p * r + 1.0 / 5040.0;
+  p = p * r + 1.0 / 720.0;
+  p = p * r + 1.0 / 120.0;
+  p = p * r + 1.0 / 24.0;
+  p = p * r + 1.0 / 6.0;
+  p = p * r + 0.5;
+  p = p * r + 1.0;
+  p = p * r + 1.0;
+  return p * bitsAs<VecD>((k + 1023) << 52);
+}
+
+static const double DBL_NORMAL_MIN = 2.2250738585072014e-308;
+static const double DBL_FINITE_MAX = 1.7976931348623157e308;
+static const double SQRT2 = 1.41421356237309504880;
+static const double INV_LN10 = 4.34294481903251827651e-01;
+
+VM_INLINE VecI logInRange(const VecD &x) {
+  return (x >= DBL_NORMAL_MIN) & (x <= DBL_FINITE_MAX);
+}
+
+// x = 2^e * m with m in [sqrt(1/2), sqrt(2)); log(m) = 2 atanh(s),
+// s = (m - 1) / (m + 1), |s| < 0.172, summed to s^21
+VM_INLINE VecD logMantissa(const VecD &x, VecD &ed) {
+  VecI b = bitsAs<VecI>(x);
+  VecI e = ((b >> 52) & 0x7ff) - 1023;
+  VecD m = bitsAs<VecD>((b & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+  VecI big = m > SQRT2;
+  m = select(big, m * 0.5, m);
+  e -= big; // big lanes are -1
+  VecD s = (m - 1.0) / (m + 1.0);
+  VecD z = s * s;
+  VecD p = (1.0 / 21.0) * z + 1.0 / 19.0;
+  p = p * z + 1.0 / 17.0;
+  p = p * z + 1.0 / 15.0;
+  p = p * z + 1.0 / 13.0;
+  p = p * z + 1.0 / 11.0;
+  p = p * z + 1.0 / 9.0;
+  p = p * z + 1.0 / 7.0;
+  p = p * z + 1.0 / 5.0;
+  p = p * z + 1.0 / 3.0;
+  ed = toDouble(e);
+  return 2.0 * s + 2.0 * s * z * p;
+}
+
+VM_INLINE VecD logBlock(const VecD &x) {
+  VecD ed;
+  VecD logm = logMantissa(x, ed);
+  return ed * LN2_HI + (logm + ed * LN2_LO);
+}
+
+// log10(2) split like LN2 so e * LOG10_2_HI is exact
+static const double LOG10_2_HI = 3.01029995549470186234e-01;
+static const double LOG10_2_LO = 1.14511008980218384211e-10;
+
+VM_INLINE VecD log10Block(const VecD &x) {
+  VecD ed;
+  VecD logm = logMantissa(x, ed);
+  return ed * LOG10_2_HI + (logm * INV_LN10 + ed * LOG10_2_LO);
+}
+
+static double scalarExp(double v) { return std::exp(v); }
+static double scalarLog(double v) { return std::log(v); }
+static double scalarLog10(double v) { return std::log10(v); }
+
+VM_CLONES void vecExp(const double *x, double *y, size_t n) {
+  runKernel<expBlock, expInRange, scalarExp>(x, y, n);
+}
+VM_CLONES void vecLog(const double *x, double *y, size_t n) {
+  runKernel<logBlock, logInRange, scalarLog>(x, y, n);
+}
+VM_CLONES void vecLog10(const double *x, double *y, size_t n) {
+  runKernel<log10Block, logInRange, scalarLog10>(x, y, n);
+}
+
+//---------------------------------------------------------------------------
+// Reductions
+//---------------------------------------------------------------------------
+
+// Elements summed directly (two 4-lane accumulators) before pairwise
+// combining takes over
+static const size_t SUM_BLOCK = 128;
+
+VM_INLINE VecD loadD(const double *x) {
+  VecD v;
+  std::memcpy(&v, x, sizeof(v));
+  return v;
+}
+
+VM_INLINE double laneSum(const VecD &v) {
+  return (v[0] + v[1]) + (v[2] + v[3]);
+}
+
+VM_INLINE double sumBlock(const double *x, size_t n) {
+  VecD a = splat(0.0), b = splat(0.0);
+  size_t i = 0;
+  for (; i + 2 * VLEN <= n; i += 2 * VLEN) {
+    a += loadD(x + i);
+    b += loadD(x + i + VLEN);
+  }
+  double tail = 0.0;
+  for (; i < n; ++i)
+    tail += x[i];
+  return laneSum(a + b) + tail;
+}
+
+// Pairwise over SUM_BLOCK blocks without recursion: after block b, merge
+// the top of the stack once per trailing zero bit of b, the way a binary
+// counter carries. The stack never holds more than log2(blocks) partials.
+VM_CLONES double vecSum(const double *x, size_t n) {
+  double stack[64];
+  int depth = 0;
+  size_t b = 0;
+  for (size_t i = 0; i < n; i += SUM_BLOCK) {
+    double s = sumBlock(x + i, n - i < SUM_BLOCK ? n - i : SUM_BLOCK);
+    for (size_t c = ++b; !(c & 1); c >>= 1)
+      s += stack[--depth];
+    stack[depth++] = s;
+  }
+  double total = 0.0;
+  while (depth > 0)
+    total += stack[--depth];
+  return total;
+}
+
+VM_CLONES double vecMin(const double *x, size_t n) {
+  VecD m = splat(HUGE_VAL);
+  size_t i = 0;
+  for (; i + VLEN <= n; i += VLEN) {
+    VecD v = loadD(x + i);
+    m = select(v < m, v, m);
+  }
+  double r = HUGE_VAL;
+  for (int k = 0; k < VLEN; ++k)
+    r = m[k] < r ? m[k] : r;
+  for (; i < n; ++i)
+    r = x[i] < r ? x[i] : r;
+  return r;
+}
+
+VM_CLONES double vecMax(const double *x, size_t n) {
+  VecD m = splat(-HUGE_VAL);
+  size_t i = 0;
+  for (; i + VLEN <= n; i += VLEN) {
+    VecD v = loadD(x + i);
+    m = select(v > m, v, m);
+  }
+  double r = -HUGE_VAL;
+  for (int k = 0; k < VLEN; ++k)
+    r = m[k] > r ? m[k] : r;
+  for (; i < n; ++i)
+    r = x[i] > r ? x[i] : r;
+  return r;
+}
+
+VM_CLONES void vecAddTo(double *acc, const double *x, size_t n) {
+  size_t i = 0;
+  for (; i + VLEN <= n; i += VLEN) {
+    VecD r = loadD(acc + i) + loadD(x + i);
+    std::memcpy(acc + i, &r, sizeof(r));
+  }
+  for (; i < n; ++i)
+    acc[i] += x[i];
+}
+
+VM_CLONES void vecMinTo(double *acc, const double *x, size_t n) {
+  size_t i = 0;
+  for (; i + VLEN <= n; i += VLEN) {
+    VecD v = loadD(x + i), m = loadD(acc + i);
+    VecD r = select(v < m, v, m);
+    std::memcpy(acc + i, &r, sizeof(r));
+  }
+  for (; i < n; ++i)
+    acc[i] = x[i] < acc[i] ? x[i] : acc[i];
+}
+
+VM_CLONES void vecMaxTo(double *acc, const double *x, size_t n) {
+  size_t i = 0;
+  for (; i + VLEN <= n; i += VLEN) {
+    VecD v = loadD(x + i), m = loadD(acc + i);
+    VecD r = select(v > m, v, m);
+    std::memcpy(acc + i, &r, sizeof(r));
+  }
+  for (; i < n; ++i)
+    acc[i] = x[i] > acc[i] ? x[i] : acc[i];
+}
+
+//---------------------------------------------------------------------------
+// Name lookup; everything else is a <cmath> loop
+//---------------------------------------------------------------------------
+
+template <double (*F)(double)>
+static void mapKernel(const double *x, double *y, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    y[i] = F(x[i]);
+}
+
+static double sqrOf(double v) { return std::sqrt(v); }
+static double absOf(double v) { return std::fabs(v); }
+static double sgnOf(double v) { return v > 0.0 ? 1.0 : v < 0.0 ? -1.0 : 0.0; }
+static double atnOf(double v) { return std::atan(v); }
+static double asnOf(double v) { return std::asin(v); }
+static double acsOf(double v) { return std::acos(v); }
+static double cotOf(double v) { return 1.0 / std::tan(v); }
+static double secOf(double v) { return 1.0 / std::cos(v); }
+static double cscOf(double v) { return 1.0 / std::sin(v); }
+static double floorOf(double v) { return std::floor(v); }
+static double ceilOf(double v) { return std::ceil(v); }
+static double roundOf(double v) { return std::floor(v + 0.5); }
+static double deg2radOf(double v) { return v * M_PI / 180.0; }
+static double rad2degOf(double v) { return v * 180.0 / M_PI; }
+
+ArrayKernel arrayKernel(const char *name) {
+  static const struct {
+    const char *name;
+    ArrayKernel kernel;
+  } table[] = {
+      {"SIN", vecSin},
+      {"COS", vecCos},
+      {"TAN", vecTan},
+      {"EXP", vecExp},
+      {"CLOG", vecLog},
+      {"LOG10", vecLog10},
+      {"SQR", mapKernel<sqrOf>},
+      {"ABS", mapKernel<absOf>},
+      {"SGN", mapKernel<sgnOf>},
+      {"ATN", mapKernel<atnOf>},
+      {"ASN", mapKernel<asnOf>},
+      {"ACS", mapKernel<acsOf>},
+      {"COT", mapKernel<cotOf>},
+      {"SEC", mapKernel<secOf>},
+      {"CSC", mapKernel<cscOf>},
+      {"INT", mapKernel<floorOf>},
+      {"FLOOR", mapKernel<floorOf>},
+      {"CEIL", mapKernel<ceilOf>},
+      {"ROUND", mapKernel<roundOf>},
+      {"DEG2RAD", mapKernel<deg2radOf>},
+      {"RAD2DEG", mapKernel<rad2degOf>},
+  };
+  for (const auto &entry : table)
+    if (std::strcmp(entry.name, name) == 0)
+      return entry.kernel;
+  return nullptr;
+}